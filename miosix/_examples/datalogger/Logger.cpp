@@ -28,8 +28,10 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/ioctl.h>
 #include <stdexcept>
 #include <interfaces/atomic_ops.h>
+#include <filesystem/ioctl.h>
 #include <tscpp/buffer.h>
 #include "Logger.h"
 
@@ -69,6 +71,11 @@ void Logger::start()
         throw runtime_error("Error opening log file");
     setbuf(file, NULL);
 
+    // Reserve contiguous space in the log file, so that the write thread does
+    // not allocate clusters. Not an error if the filesystem does not support it
+    off_t reserve = preallocSize;
+    ioctl(fileno(file), IOCTL_PREALLOCATE, &reserve);
+
     // The boring part, start threads one by one and if they fail, undo
     // Perhaps excessive defensive programming as thread creation failure is
     // highly unlikely (only if ram is full)
@@ -160,6 +160,7 @@ private:
     static const unsigned int numRecords       = 128; ///< Size of record queues
     static const unsigned int bufferSize       = 4096;///< Size of each buffer
     static const unsigned int numBuffers       = 4;   ///< Number of buffers
+    static const unsigned int preallocSize     = 16*1024*1024;///< Reserved space
     static constexpr bool logStatsEnabled      = true;///< Log logger stats?
 
     /**
@@ -1,9 +1,11 @@
-my $count=0, my $sum=0;
+my $count=0, my $sum=0, my $size=32;
 while(<STDIN>)
 {
     next unless(/time:(\d.\d+)/);
-    $sum+=$1*1000; $count++;
+    my $time=$1;
+    $size=$1 if(/size:(\d+)KB/);
+    $sum+=$time*1000; $count++;
 }
 my $average=$sum/$count;
-my $speed=32*1024/$average;
+my $speed=$size*1024/$average;
 print "Average write time= $average ms\nAverage write speed=$speed KB/s\n";
@@ -1,49 +1,94 @@
 /**
  * This program can be used to test the SD card backend speed, i.e the
- * low level sector read/write functions.
- * 
- * !!!WARNING!!! If you select to test the write speed this program will
+ * low level sector read/write functions, as well as the speed of file access
+ * through the filesystem, to compare filesystem configurations (sector size,
+ * block cache, fast seek, preallocation).
+ *
+ * !!!WARNING!!! If you select to test the device write speed this program will
  * write at random in the SD card, corrupting everything in it (i.e: all files
  * and even the filesystem itself). After testing write speed you WILL need to
  * FORMAT your SD card before you can use it again, losing everythin in it.
- * 
+ * The file test only writes to /sd/bench.dat, which is deleted at the end.
+ *
  * NOTE: this program assumes the SD is larger than 1GByte, and you have
  * 32KByte available in your microcontroller for the disk buffer.
  */
 
 #include <cstdio>
 #include <cstring>
+#include <cstdlib>
 #include <cassert>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
 #include <miosix.h>
+#include <filesystem/ioctl.h>
 
 using namespace std;
 using namespace miosix;
 
+static bool fileAccess;   ///< Access a file or the raw device?
 static bool randomAccess; ///< Random or sequential access?
 static bool writeAccess;  ///< Read or write access?
+static int sizek=32;      ///< Block write size in KByte
+static const char benchFile[]="/sd/bench.dat"; ///< File for the file test
+static const int fileSize=4*1024*1024;         ///< Size of the test file
+
+/**
+ * Create the file for the file test, and fill it so that it can be read
+ * \return the file descriptor, or -1 on failure
+ */
+static int createBenchFile(int *data, int sizeb)
+{
+    int fd=open(benchFile,O_RDWR|O_CREAT|O_TRUNC,0644);
+    if(fd<0)
+    {
+        perror("open");
+        return -1;
+    }
+    off_t reserve=fileSize;
+    ioctl(fd,IOCTL_PREALLOCATE,&reserve); //Not an error if unsupported
+    for(int i=0;i<fileSize/sizeb;i++) if(write(fd,data,sizeb)!=sizeb)
+    {
+        perror("write");
+        close(fd);
+        return -1;
+    }
+    ioctl(fd,IOCTL_FAST_SEEK,0); //Not an error if unsupported
+    return fd;
+}
 
 void testThread(void *)
 {
-    const int sizek=32;                ///< Block write size in KByte
     const int sizeb=sizek*1024;        ///< Block write size in Byte
     const int sizei=sizeb/sizeof(int); ///< Block write size in integers
     int *data=new int[sizei];
     memset(data,0xaa,sizeb);
     Timer timer;
-    const int startAddr=10240; ///< Start address, skip first sectors
-    const int endAddr=2000000; ///< End address ~1GB card
-    int addr=startAddr;
-    int fd=open("/dev/sda",O_RDWR,0);
+    int startAddr, endAddr, fd;
+    if(fileAccess)
+    {
+        startAddr=0;
+        endAddr=fileSize;
+        fd=createBenchFile(data,sizeb);
+    } else {
+        startAddr=10240*512; ///< Start address, skip first sectors
+        endAddr=2000000*512; ///< End address ~1GB card
+        fd=open("/dev/sda",O_RDWR,0);
+        if(fd<0) perror("open");
+    }
     if(fd<0)
     {
-        perror("open");
+        delete[] data;
         return;
     }
+    int addr=startAddr;
+    long long totalBytes=0;
+    float totalTime=0;
     for(;;)
     {
         if(randomAccess)
-            addr=512*((rand() % (endAddr-startAddr-sizeb/512))+startAddr);
+            addr=512*(rand() % ((endAddr-startAddr-sizeb)/512))+startAddr;
         else {
             addr+=sizeb;
             if(addr>endAddr-sizeb) addr=startAddr;
@@ -59,31 +104,50 @@ void testThread(void *)
         time/=TICK_FREQ;
         timer.clear();
         float speed=sizek/static_cast<float>(time);
-        printf("time:%0.3fs speed:%0.1fKB/s\n",time,speed);
+        printf("size:%dKB time:%0.3fs speed:%0.1fKB/s\n",sizek,time,speed);
+        totalBytes+=sizeb;
+        totalTime+=time;
         if(Thread::testTerminate()) break;
     }
+    if(totalTime>0)
+        printf("%s %s %s, %dKB blocks: average speed %0.1fKB/s\n",
+               fileAccess ? "File" : "Device",
+               randomAccess ? "random" : "sequential",
+               writeAccess ? "write" : "read",
+               sizek,totalBytes/1024/totalTime);
     close(fd);
+    if(fileAccess) unlink(benchFile);
     delete[] data;
 }
 
 int main()
 {
     puts("\n====================");
-    puts("Warning, the write test will destroy the formatting of the SD.");
+    puts("Warning, the device write test will destroy the formatting of the SD.");
     puts("After running that test, format your SD card!");
     for(;;)
     {
+        fileAccess=false;
         writeAccess=false;
         randomAccess=false;
         for(;;)
         {
-            puts("Read or write access, or quit (r/w/q)?");
+            puts("Test file or raw device access, or quit (f/d/q)?");
             char line[64];
             fgets(line,sizeof(line),stdin);
             if(line[0]=='q') goto quit;
+            if(line[0]=='f') fileAccess=true;
+            if(line[0]=='f' || line[0]=='d') break;
+            puts("Error: insert 'f' or 'd' or 'q'");
+        }
+        for(;;)
+        {
+            puts("Read or write access (r/w)?");
+            char line[64];
+            fgets(line,sizeof(line),stdin);
             if(line[0]=='w') writeAccess=true;
             if(line[0]=='w' || line[0]=='r') break;
-            puts("Error: insert 'r' or 'w' or 'q'");
+            puts("Error: insert 'r' or 'w'");
         }
         for(;;)
         {
@@ -94,6 +158,15 @@ int main()
             if(line[0]=='r' || line[0]=='s') break;
             puts("Error: insert 'r' or 's'");
         }
+        for(;;)
+        {
+            puts("Block size in KByte (1..32)?");
+            char line[64];
+            fgets(line,sizeof(line),stdin);
+            sizek=atoi(line);
+            if(sizek>=1 && sizek<=32) break;
+            puts("Error: insert a number between 1 and 32");
+        }
         Thread *t=Thread::create(testThread,4096,1,0,Thread::JOINABLE);
         printf("Type enter to stop\n");
         getchar();
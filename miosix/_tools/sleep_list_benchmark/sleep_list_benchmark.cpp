@@ -0,0 +1,126 @@
+/**
+ * This program compares the sorted linked list that the kernel used to keep
+ * sleeping threads with the pairing heap that is now used (kernel/pairing_heap.h).
+ * It runs on the host machine, not on the board. Compile with
+ * g++ -O2 -std=c++11 -I../.. -o sleep_list_benchmark sleep_list_benchmark.cpp
+ *
+ * For 10, 100 and 1000 sleepers it measures the average time to insert a
+ * sleeper, and the average time to insert and then wake all of them in
+ * wakeup time order, like the tick interrupt does.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <vector>
+#include <chrono>
+#include "kernel/pairing_heap.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace miosix;
+
+/**
+ * Same layout as the kernel's SleepData, with both list and heap fields
+ */
+struct Sleeper
+{
+    long long wakeup_time;
+    Sleeper *next;    ///< Used by the sorted list
+    Sleeper *child;   ///< Used by the pairing heap
+    Sleeper *sibling; ///< Used by the pairing heap
+    Sleeper *prev;    ///< Used by the pairing heap
+};
+
+/**
+ * Old implementation of IRQaddToSleepingList()
+ */
+static void listInsert(Sleeper *& list, Sleeper *x)
+{
+    if(list==NULL || x->wakeup_time<=list->wakeup_time)
+    {
+        x->next=list;
+        list=x;
+    } else {
+        Sleeper *cur=list;
+        for(;;)
+        {
+            if(cur->next==NULL || x->wakeup_time<=cur->next->wakeup_time)
+            {
+                x->next=cur->next;
+                cur->next=x;
+                break;
+            }
+            cur=cur->next;
+        }
+    }
+}
+
+static Sleeper *listRemoveMin(Sleeper *& list)
+{
+    Sleeper *result=list;
+    list=list->next;
+    return result;
+}
+
+/**
+ * \param s sleepers to fill with random wakeup times
+ */
+static void randomize(vector<Sleeper>& s)
+{
+    for(auto& x : s) x.wakeup_time=rand() % 100000;
+}
+
+/**
+ * Benchmark a data structure
+ * \param n number of sleepers
+ * \param iterations number of times the test is repeated
+ * \param insertNs average time to insert one sleeper, in ns
+ * \param cycleNs average time to insert and remove one sleeper, in ns
+ */
+template<typename Insert, typename RemoveMin>
+static void benchmark(int n, int iterations, Insert insert, RemoveMin removeMin,
+        double& insertNs, double& cycleNs)
+{
+    vector<Sleeper> s(n);
+    long long insertTime=0, cycleTime=0;
+    for(int i=0;i<iterations;i++)
+    {
+        randomize(s);
+        Sleeper *root=NULL;
+        auto t0=high_resolution_clock::now();
+        for(auto& x : s) insert(root,&x);
+        auto t1=high_resolution_clock::now();
+        long long prev=-1;
+        for(int j=0;j<n;j++)
+        {
+            Sleeper *x=removeMin(root);
+            assert(x->wakeup_time>=prev);
+            prev=x->wakeup_time;
+        }
+        auto t2=high_resolution_clock::now();
+        assert(root==NULL);
+        insertTime+=duration_cast<nanoseconds>(t1-t0).count();
+        cycleTime+=duration_cast<nanoseconds>(t2-t0).count();
+    }
+    insertNs=static_cast<double>(insertTime)/iterations/n;
+    cycleNs=static_cast<double>(cycleTime)/iterations/n;
+}
+
+int main()
+{
+    srand(0);
+    const int sizes[]={10,100,1000};
+    printf("sleepers | list insert | heap insert | list cycle | heap cycle (ns)\n");
+    for(int n : sizes)
+    {
+        const int iterations=1000000/n;
+        double listInsertNs, listCycleNs, heapInsertNs, heapCycleNs;
+        benchmark(n,iterations,listInsert,listRemoveMin,
+                  listInsertNs,listCycleNs);
+        benchmark(n,iterations,pairingHeapInsert<Sleeper>,
+                  pairingHeapRemoveMin<Sleeper>,heapInsertNs,heapCycleNs);
+        printf("%8d | %11.1f | %11.1f | %10.1f | %10.1f\n",n,
+               listInsertNs,heapInsertNs,listCycleNs,heapCycleNs);
+    }
+}
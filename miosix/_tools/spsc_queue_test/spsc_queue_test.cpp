@@ -0,0 +1,106 @@
+/**
+ * This program tests the lock-free single producer single consumer queue
+ * (kernel/spsc_queue.h). It runs on the host machine, not on the board.
+ * Compile with
+ * g++ -O2 -std=c++11 -pthread -I../.. -o spsc_queue_test spsc_queue_test.cpp
+ *
+ * A producer thread writes a sequence of numbers, alternating single element
+ * put() and span writes of random length through reserve()/commit(), and a
+ * consumer thread checks the sequence, alternating get() and span reads
+ * through peek()/consume(). It also measures the throughput.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+#include "kernel/spsc_queue.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace miosix;
+
+/**
+ * Like assert(), but also evaluated when NDEBUG is defined, as many of the
+ * checked expressions have side effects on the queue
+ */
+#define check(x) \
+    do { \
+        if(!(x)) { \
+            fprintf(stderr,"%s:%d: check failed: %s\n",__FILE__,__LINE__,#x); \
+            exit(1); \
+        } \
+    } while(0)
+
+static const unsigned int total=10000000;
+static SpscQueue<unsigned int,256> queue;
+
+static void producer()
+{
+    unsigned int next=0;
+    unsigned int seed=1;
+    while(next<total)
+    {
+        if(rand_r(&seed) & 1)
+        {
+            if(queue.put(next)) next++;
+            else this_thread::yield(); //Queue full
+        } else {
+            unsigned int *span;
+            unsigned int n=queue.reserve(span);
+            if(n>total-next) n=total-next;
+            if(n>0) n=1+rand_r(&seed) % n;
+            else this_thread::yield(); //Queue full
+            for(unsigned int i=0;i<n;i++) span[i]=next++;
+            queue.commit(n);
+        }
+    }
+}
+
+static void consumer()
+{
+    unsigned int expected=0;
+    unsigned int seed=2;
+    while(expected<total)
+    {
+        if(rand_r(&seed) & 1)
+        {
+            unsigned int x;
+            if(queue.get(x)) check(x==expected++);
+            else this_thread::yield(); //Queue empty
+        } else {
+            const unsigned int *span;
+            unsigned int n=queue.peek(span);
+            if(n>0) n=1+rand_r(&seed) % n;
+            else this_thread::yield(); //Queue empty
+            for(unsigned int i=0;i<n;i++) check(span[i]==expected++);
+            queue.consume(n);
+        }
+    }
+}
+
+int main()
+{
+    //Single threaded checks
+    check(queue.isEmpty() && queue.capacity()==256);
+    for(unsigned int i=0;i<256;i++) check(queue.put(i));
+    check(queue.isFull() && queue.put(0)==false);
+    unsigned int *span;
+    check(queue.reserve(span)==0);
+    const unsigned int *cspan;
+    check(queue.peek(cspan)==256 && cspan[255]==255);
+    queue.consume(200);
+    //Free space wraps around, so the span ends at the end of the buffer
+    check(queue.reserve(span)==200);
+    queue.reset();
+
+    //Two threads
+    auto start=steady_clock::now();
+    thread p(producer);
+    thread c(consumer);
+    p.join();
+    c.join();
+    double s=duration<double>(steady_clock::now()-start).count();
+    check(queue.isEmpty());
+    printf("Test passed, %.1f Melements/s\n",total/s/1e6);
+}
@@ -0,0 +1,147 @@
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+
+#define error(x)	(x)
+
+//Syscall numbers, as in kernel/process.h
+#define SYS_EXIT	2
+#define SYS_WRITE	3
+#define SYS_READ	4
+#define SYS_LSEEK	8
+#define SYS_BATCH	27
+
+//Layout of the SYS_BATCH array entries, as in kernel/process.h
+struct SyscallBatchEntry
+{
+	int id;
+	unsigned int params[3];
+	int result;
+};
+
+int batch(struct SyscallBatchEntry *ops, int count);
+int seek(int fd, int pos, int whence);
+
+int mystrlen(const char *s){
+	int result=0;
+	while(*s++) result++;
+	return result;
+}
+
+void print(const char *s){
+	write(1, s, mystrlen(s));
+}
+
+void setEntry(struct SyscallBatchEntry *op, int id, unsigned int a,
+		unsigned int b, unsigned int c){
+	op->id = id;
+	op->params[0] = a;
+	op->params[1] = b;
+	op->params[2] = c;
+	op->result = 12345; //Not a possible result, to detect unexecuted entries
+}
+
+#define FILE_PATH	"/batch.bin"
+
+int main(){
+	struct SyscallBatchEntry ops[17];
+	char buffer[16];
+	int fd = 0;
+	int i = 0;
+
+	fd = open(FILE_PATH, O_RDWR|O_CREAT|O_TRUNC, 0);
+
+	if(fd < 3)
+		return error(1);
+
+	//Valid batch, writes and reads back through the same file descriptor
+	setEntry(&ops[0], SYS_WRITE, fd, (unsigned int)"abc", 3);
+	setEntry(&ops[1], SYS_WRITE, fd, (unsigned int)"defg", 4);
+	setEntry(&ops[2], SYS_LSEEK, fd, 1, SEEK_SET);
+	setEntry(&ops[3], SYS_READ, fd, (unsigned int)buffer, sizeof(buffer));
+
+	if(batch(ops, 4) != 4)
+		return error(2);
+
+	if(ops[0].result != 3 || ops[1].result != 4 || ops[2].result != 1 ||
+	   ops[3].result != 6 || memcmp(buffer, "bcdefg", 6) != 0)
+		return error(3);
+
+	print("Valid batch: Passed\n");
+
+	//A failing syscall does not stop the batch, its error is in the entry
+	setEntry(&ops[0], SYS_WRITE, 100, (unsigned int)"x", 1);
+	setEntry(&ops[1], SYS_WRITE, fd, 0, 1);
+	setEntry(&ops[2], SYS_WRITE, fd, (unsigned int)"h", 1);
+
+	if(batch(ops, 3) != 3)
+		return error(4);
+
+	if(ops[0].result != -EBADF || ops[1].result != -EFAULT ||
+	   ops[2].result != 1)
+		return error(4);
+
+	print("Batch with failing entries: Passed\n");
+
+	//Entries that are not allowed stop the batch, and following ones are
+	//not executed
+	setEntry(&ops[0], SYS_WRITE, fd, (unsigned int)"i", 1);
+	setEntry(&ops[1], SYS_EXIT, 0, 0, 0);
+	setEntry(&ops[2], SYS_WRITE, fd, (unsigned int)"X", 1);
+
+	if(batch(ops, 3) != 1)
+		return error(5);
+
+	if(ops[0].result != 1 || ops[1].result != -ENOSYS || ops[2].result != 12345)
+		return error(5);
+
+	setEntry(&ops[0], SYS_BATCH, (unsigned int)ops, 1, 0);
+	setEntry(&ops[1], SYS_WRITE, fd, (unsigned int)"X", 1);
+
+	if(batch(ops, 2) != 0 || ops[0].result != -ENOSYS || ops[1].result != 12345)
+		return error(6);
+
+	setEntry(&ops[0], 1000, 0, 0, 0);
+	setEntry(&ops[1], -1, 0, 0, 0);
+
+	if(batch(ops, 1) != 0 || ops[0].result != -ENOSYS)
+		return error(7);
+
+	if(batch(&ops[1], 1) != 0 || ops[1].result != -ENOSYS)
+		return error(7);
+
+	//Skipped entries must not have written anything
+	if(seek(fd, 0, SEEK_END) != 9)
+		return error(8);
+
+	print("Batch stopping at the first invalid entry: Passed\n");
+
+	//Invalid arrays
+	for(i = 0; i < 17; i++)
+		setEntry(&ops[i], SYS_WRITE, fd, (unsigned int)"X", 1);
+
+	if(batch(ops, 17) != -EINVAL || batch(ops, -1) != -EINVAL)
+		return error(9);
+
+	if(batch((struct SyscallBatchEntry*)((char*)ops + 2), 1) != -EFAULT)
+		return error(10);
+
+	//Results are written back, so the array can't be in the read-only code
+	if(batch(0, 1) != -EFAULT ||
+	   batch((struct SyscallBatchEntry*)((unsigned int)main & ~3), 1) != -EFAULT)
+		return error(11);
+
+	if(batch(ops, 0) != 0 || seek(fd, 0, SEEK_END) != 9)
+		return error(12);
+
+	print("Invalid batch arrays: Passed\n");
+
+	if(close(fd) != 0)
+		return error(13);
+
+	return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * Startup script for writing PROGRAMS for the Miosix embedded OS
+ * TFT:Terraneo Federico Technlogies
+ */
+
+.syntax unified
+.cpu cortex-m3
+.thumb
+
+.section .text
+
+/**
+ * _start, program entry point
+ */
+.global _start
+.type _start, %function
+_start:
+	/* TODO: .ctor */
+	bl   main
+	/* TODO: .dtor */
+	bl   _exit
+
+/**
+ * _exit, terminate process
+ * \param v exit value 
+ */
+.section .text._exit
+.global _exit
+.type _exit, %function
+_exit:
+	movs r3, #2
+	svc  0
+
+/**
+ * open, open a file
+ * \param fd file descriptor
+ * \param file access mode
+ * \param xxx access permisions
+ * \return file descriptor or -1 if errors
+ */
+.section .text.open
+.global open
+.type open, %function
+open:
+	movs r3, #6
+	svc 0
+	bx lr
+
+/**
+ * close, close a file
+ * \param fd file descriptor
+ */
+.section .text.close
+.global close
+.type close, %function
+close:
+	movs r3, #7
+	svc 0
+	bx lr
+
+/**
+ * seek
+ * \param fd file descriptor
+ * \param pos moving offset
+ * \param start position, SEEK_SET, SEEK_CUR or SEEK_END
+*/
+.section .text.seek
+.global seek
+.type seek, %function
+seek:
+	movs r3, #8
+	svc 0
+	bx lr
+	
+
+/**
+ * system, fork and execture a program, blocking
+ * \param program to execute
+ */
+.section .text.system
+.global system
+.type system, %function
+system:
+	movs r3, #9
+	svc 0
+	bx lr
+	
+/**
+ * write, write to file
+ * \param fd file descriptor
+ * \param buf data to be written
+ * \param len buffer length
+ * \return number of written bytes or -1 if errors
+ */
+.section .text.write
+.global	write
+.type	write, %function
+write:
+    movs r3, #3
+    svc  0
+    bx   lr
+
+/**
+ * read, read from file
+ * \param fd file descriptor
+ * \param buf data to be read
+ * \param len buffer length
+ * \return number of read bytes or -1 if errors
+ */
+.section .text.read
+.global	read
+.type	read, %function
+read:
+    movs r3, #4
+    svc  0
+    bx   lr
+
+/**
+ * usleep, sleep a specified number of microseconds
+ * \param us number of microseconds to sleep
+ * \return 0 on success or -1 if errors
+ */
+.section .text.usleep
+.global	usleep
+.type	usleep, %function
+usleep:
+    movs r3, #5
+    svc  0
+    bx   lr
+
+/**
+ * readv, read from file into multiple buffers
+ * \param fd file descriptor
+ * \param iov array of buffers
+ * \param iovcnt number of buffers
+ * \return number of read bytes or a negative error code
+ */
+.section .text.readv
+.global	readv
+.type	readv, %function
+readv:
+    movs r3, #23
+    svc  0
+    bx   lr
+
+/**
+ * writev, write to file from multiple buffers
+ * \param fd file descriptor
+ * \param iov array of buffers
+ * \param iovcnt number of buffers
+ * \return number of written bytes or a negative error code
+ */
+.section .text.writev
+.global	writev
+.type	writev, %function
+writev:
+    movs r3, #24
+    svc  0
+    bx   lr
+
+/**
+ * pread, read from file at a given offset without moving the file pointer.
+ * The syscall takes a pointer to a struct iovec with the buffer, which is
+ * built on the stack, and the low 32 bit of the offset
+ * \param fd file descriptor
+ * \param buf data to be read
+ * \param len buffer length
+ * \param pos offset, 64 bit, passed on the stack
+ * \return number of read bytes or a negative error code
+ */
+.section .text.pread
+.global	pread
+.type	pread, %function
+pread:
+    push {r1, r2}
+    mov  r1, sp
+    ldr  r2, [sp, #8]
+    movs r3, #25
+    svc  0
+    add  sp, sp, #8
+    bx   lr
+
+/**
+ * pwrite, write to file at a given offset without moving the file pointer.
+ * The syscall takes a pointer to a struct iovec with the buffer, which is
+ * built on the stack, and the low 32 bit of the offset
+ * \param fd file descriptor
+ * \param buf data to be written
+ * \param len buffer length
+ * \param pos offset, 64 bit, passed on the stack
+ * \return number of written bytes or a negative error code
+ */
+.section .text.pwrite
+.global	pwrite
+.type	pwrite, %function
+pwrite:
+    push {r1, r2}
+    mov  r1, sp
+    ldr  r2, [sp, #8]
+    movs r3, #26
+    svc  0
+    add  sp, sp, #8
+    bx   lr
+
+.end
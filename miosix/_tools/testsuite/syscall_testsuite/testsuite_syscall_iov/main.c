@@ -0,0 +1,118 @@
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+
+#define error(x)	(x)
+
+#define SIZE 256
+
+//Layout of struct iovec for the SYS_READV/SYS_WRITEV/SYS_PREAD/SYS_PWRITE ABI
+struct iovec
+{
+	void *iov_base;
+	size_t iov_len;
+};
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt);
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt);
+ssize_t pread(int fd, void *buf, size_t len, off_t pos);
+ssize_t pwrite(int fd, const void *buf, size_t len, off_t pos);
+int seek(int fd, int pos, int whence);
+
+int mystrlen(const char *s){
+	int result=0;
+	while(*s++) result++;
+	return result;
+}
+
+void print(const char *s){
+	write(1, s, mystrlen(s));
+}
+
+#define FILE_PATH	"/iov.bin"
+
+int main(){
+	char hdr[4] = {'h','d','r','\n'};
+	char tmp[4];
+	unsigned char buffer[SIZE];
+	struct iovec iov[2];
+	int i = 0;
+	int fd = 0;
+
+	for(i = 0; i < SIZE; i++)
+		buffer[i] = i;
+
+	fd = open(FILE_PATH, O_RDWR|O_CREAT|O_TRUNC, 0);
+
+	if(fd < 3)
+		return error(1);
+
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = buffer;
+	iov[1].iov_len = SIZE;
+
+	if(writev(fd, iov, 2) != sizeof(hdr) + SIZE)
+		return error(2);
+
+	print("writev: Passed\n");
+
+	if(pwrite(fd, "HDR", 3, 0) != 3)
+		return error(3);
+
+	if(pread(fd, tmp, 4, 0) != 4 || memcmp(tmp, "HDR\n", 4) != 0)
+		return error(4);
+
+	if(seek(fd, 0, SEEK_CUR) != sizeof(hdr) + SIZE)
+		return error(5);
+
+	print("pread/pwrite: Passed\n");
+
+	seek(fd, 0, SEEK_SET);
+	memset(buffer, 0, SIZE);
+	iov[0].iov_base = tmp;
+
+	if(readv(fd, iov, 2) != sizeof(hdr) + SIZE || memcmp(tmp, "HDR\n", 4) != 0)
+		return error(6);
+
+	for(i = 0; i < SIZE; i++){
+		if(buffer[i] != (unsigned char)i)
+			return error(6);
+	}
+
+	if(readv(fd, iov, 2) != 0 || pread(fd, tmp, 4, sizeof(hdr) + SIZE) != 0)
+		return error(7);
+
+	print("readv: Passed\n");
+
+	//Misaligned iovec array or struct, the kernel can't access them
+	if(readv(fd, (const struct iovec*)((char*)iov + 1), 1) != -EFAULT ||
+	   writev(fd, (const struct iovec*)((char*)iov + 2), 1) != -EFAULT)
+		return error(8);
+
+	if(writev(fd, iov, -1) != -EINVAL || writev(fd, iov, 100000) != -EINVAL)
+		return error(9);
+
+	//Buffers outside the process memory
+	iov[1].iov_base = 0;
+
+	if(readv(fd, iov, 2) != -EFAULT || writev(fd, iov, 2) != -EFAULT)
+		return error(10);
+
+	if(pread(fd, 0, 4, 0) != -EFAULT || pwrite(fd, 0, 4, 0) != -EFAULT)
+		return error(10);
+
+	if(pread(100, tmp, 4, 0) != -EBADF || readv(100, iov, 1) != -EBADF)
+		return error(11);
+
+	print("Invalid arguments: Passed\n");
+
+	if(close(fd) != 0)
+		return error(12);
+
+	return 0;
+}
@@ -43,6 +43,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/ioctl.h>
 #include <signal.h>
 #include <pthread.h>
 #include <errno.h>
@@ -57,6 +58,9 @@
 #include "e20/e20.h"
 #include "kernel/intrusive.h"
 #include "util/crc16.h"
+#include "filesystem/ioctl.h"
+#include "filesystem/uio.h"
+#include "filesystem/aio.h"
 
 #ifdef WITH_PROCESSES
 #include "kernel/elf_program.h"
@@ -114,6 +118,8 @@ static void test_21();
 static void test_22();
 static void test_23();
 static void test_24();
+static void test_25();
+static void test_26();
 #if defined(_ARCH_CORTEXM7_STM32F7) || defined(_ARCH_CORTEXM7_STM32H7)
 void testCacheAndDMA();
 #endif //_ARCH_CORTEXM7_STM32F7/H7
@@ -149,6 +155,7 @@ void syscall_test_mpu_write();
 unsigned int* memAllocation(unsigned int size);
 bool memCheck(unsigned int *base, unsigned int size);
 void runElfTest(const char *name, const unsigned char *filename, unsigned int file_length);
+void runElfBenchmark();
 
 int runProgram(const unsigned char *filename, unsigned int file_length);
 bool isSignaled(int exit_code);
@@ -221,6 +228,8 @@ int main()
                 test_22();
                 test_23();
                 test_24();
+                test_25();
+                test_26();
                 #if defined(_ARCH_CORTEXM7_STM32F7) || defined(_ARCH_CORTEXM7_STM32H7)
                 testCacheAndDMA();
                 #endif //_ARCH_CORTEXM7_STM32F7/H7
@@ -322,6 +331,7 @@ int main()
                 runElfTest("Elf Test5", aelf5, aelf5_len);
                 runElfTest("Elf Test6", aelf6, aelf6_len);
                 runElfTest("Elf Test7", aelf7, aelf7_len);
+                runElfBenchmark();
 
                 //Mpu tests
                 iprintf("\n\nExecuting MPU tests.\n");
@@ -1733,6 +1743,7 @@ Queue::IRQput()
 Queue::waitUntilNotFull()
 Queue::IRQget()
 Queue::waitUntilNotEmpty()
+Queue::get() with timeout
 FIXME: The overloaded versions of IRQput and IRQget are not tested
 */
 
@@ -1867,6 +1878,13 @@ static void test_8()
     Thread::sleep(5);
     t8_q1.reset();
     t8_q2.reset();
+    //Timed get
+    long long timeout=getTick()+TICK_FREQ/10;
+    if(t8_q1.get(c,timeout)) fail("get with timeout (1)");
+    if(getTick()<timeout) fail("get with timeout returned early");
+    t8_q1.put('1');
+    if(t8_q1.get(c,getTick()+TICK_FREQ/10)==false || c!='1')
+        fail("get with timeout (2)");
     pass();
 }
 
@@ -2255,6 +2273,7 @@ void test_14()
 /*
 Tests:
 - Condition variables
+- ConditionVariable::timedWait()
 */
 
 static volatile bool t15_v1;
@@ -2285,6 +2304,12 @@ void t15_p2(void *argv)
     }
 }
 
+void t15_p3(void *argv)
+{
+    Thread::sleep(10);
+    t15_c1.signal();
+}
+
 static void test_15()
 {
     test_name("Condition variables");
@@ -2334,6 +2359,19 @@ static void test_15()
     Thread::sleep(10);
     if(Thread::exists(p1) || Thread::exists(p2))
         fail("Threads not deleted (2)");
+    //Test timed wait
+    {
+        Lock<Mutex> l(t15_m1);
+        long long timeout=getTick()+TICK_FREQ/10;
+        if(t15_c1.timedWait(l,timeout)!=TimedWaitResult::Timeout)
+            fail("timedWait (1)");
+        if(getTick()<timeout) fail("timedWait returned early");
+        p1=Thread::create(t15_p3,STACK_SMALL,0);
+        if(t15_c1.timedWait(l,getTick()+TICK_FREQ)!=TimedWaitResult::NoTimeout)
+            fail("timedWait (2)");
+    }
+    Thread::sleep(10);
+    if(Thread::exists(p1)) fail("Threads not deleted (3)");
     pass();
 }
 
@@ -3765,6 +3803,158 @@ static void test_24()
     pass();
 }
 
+//
+// Test 25
+//
+/*
+tests:
+Semaphore
+EventFlags
+*/
+
+static Semaphore t25_s1;
+static EventFlags t25_e1;
+static volatile int t25_v1;
+
+static void t25_p1(void *argv)
+{
+    for(int i=0;i<3;i++)
+    {
+        t25_s1.wait();
+        t25_v1++;
+    }
+}
+
+static void t25_p2(void *argv)
+{
+    unsigned int result=t25_e1.wait(0x3,EventFlags::ALL);
+    if(result!=0x3) fail("EventFlags wait all result");
+    t25_v1++;
+}
+
+static void test_25()
+{
+    test_name("Semaphore and EventFlags");
+    //Semaphore count
+    if(t25_s1.tryWait()) fail("tryWait (1)");
+    t25_s1.signal();
+    t25_s1.signal();
+    if(t25_s1.getCount()!=2) fail("getCount");
+    if(t25_s1.tryWait()==false) fail("tryWait (2)");
+    t25_s1.wait(); //Must not block
+    if(t25_s1.timedWait(getTick()+TICK_FREQ/10)!=TimedWaitResult::Timeout)
+        fail("Semaphore timedWait (1)");
+    //Semaphore signaled by another thread and with interrupts disabled
+    t25_v1=0;
+    Thread *p=Thread::create(t25_p1,STACK_SMALL,0);
+    Thread::sleep(10);
+    if(t25_v1!=0) fail("Semaphore spurious wakeup");
+    t25_s1.signal();
+    Thread::sleep(10);
+    if(t25_v1!=1) fail("Semaphore signal");
+    {
+        FastInterruptDisableLock dLock;
+        bool hppw=false;
+        t25_s1.IRQsignal(hppw);
+        if(hppw) fail("Semaphore hppw");
+    }
+    Thread::sleep(10);
+    if(t25_v1!=2) fail("Semaphore IRQsignal");
+    t25_s1.signal();
+    Thread::sleep(10);
+    if(t25_v1!=3 || t25_s1.getCount()!=0) fail("Semaphore (3)");
+    if(Thread::exists(p)) fail("Thread not deleted (1)");
+    //EventFlags
+    t25_e1.signal(0x5);
+    if(t25_e1.get()!=0x5) fail("EventFlags get");
+    if(t25_e1.wait(0x6)!=0x4) fail("EventFlags wait any");
+    if(t25_e1.get()!=0x1) fail("EventFlags clear on exit");
+    t25_e1.clear(0x1);
+    if(t25_e1.timedWait(0x1,getTick()+TICK_FREQ/10)!=0)
+        fail("EventFlags timedWait");
+    t25_v1=0;
+    p=Thread::create(t25_p2,STACK_SMALL,0);
+    Thread::sleep(10);
+    t25_e1.signal(0x1);
+    Thread::sleep(10);
+    if(t25_v1!=0) fail("EventFlags wait all");
+    {
+        FastInterruptDisableLock dLock;
+        t25_e1.IRQsignal(0x2);
+    }
+    Thread::sleep(10);
+    if(t25_v1!=1 || t25_e1.get()!=0) fail("EventFlags IRQsignal");
+    if(Thread::exists(p)) fail("Thread not deleted (2)");
+    pass();
+}
+
+//
+// Test 26
+//
+/*
+tests:
+RWMutex
+*/
+
+static RWMutex t26_m1;
+static volatile int t26_v1;
+
+static void t26_p1(void *argv)
+{
+    SharedLock l(t26_m1);
+    t26_v1++;
+    Thread::sleep(20);
+}
+
+static void t26_p2(void *argv)
+{
+    Lock<RWMutex> l(t26_m1);
+    t26_v1+=10;
+}
+
+static void test_26()
+{
+    test_name("RWMutex");
+    t26_v1=0;
+    //Readers do not exclude each other, but exclude writers
+    {
+        SharedLock l(t26_m1);
+        Thread::create(t26_p1,STACK_SMALL,0);
+        Thread::sleep(10);
+        if(t26_v1!=1) fail("concurrent readers");
+        if(t26_m1.tryLock()) fail("tryLock with readers");
+    }
+    Thread::sleep(30);
+    //Writers exclude both readers and writers
+    {
+        Lock<RWMutex> l(t26_m1);
+        Thread::create(t26_p1,STACK_SMALL,0);
+        Thread::create(t26_p2,STACK_SMALL,0);
+        Thread::sleep(10);
+        if(t26_v1!=1) fail("writer exclusion");
+    }
+    //The reader was queued first, and the writer waits for it to leave
+    Thread::sleep(10);
+    if(t26_v1!=2) fail("reader after writer");
+    Thread::sleep(30);
+    if(t26_v1!=12) fail("writer after reader");
+    //A waiting writer blocks new readers
+    {
+        SharedLock l(t26_m1);
+        Thread::create(t26_p2,STACK_SMALL,0);
+        Thread::sleep(10);
+        if(t26_v1!=12) fail("writer waiting for reader");
+        Thread::create(t26_p1,STACK_SMALL,0);
+        Thread::sleep(10);
+        if(t26_v1!=12) fail("writer preference");
+    }
+    Thread::sleep(40);
+    if(t26_v1!=23) fail("writer then reader");
+    if(t26_m1.tryLock()==false) fail("tryLock");
+    t26_m1.unlock();
+    pass();
+}
+
 #if defined(_ARCH_CORTEXM7_STM32F7) || defined(_ARCH_CORTEXM7_STM32H7)
 static Thread *waiting=nullptr; /// Thread waiting on DMA completion IRQ
 
@@ -4275,6 +4465,8 @@ static void fs_test_2()
 /*
 tests:
 correctness of write/read on large files
+writev/readv/pwrite/pread
+aioSubmit
 */
 
 static void fs_test_3()
@@ -4309,9 +4501,103 @@ static void fs_test_3()
         outChecksum^=crc16(buf,size);
     }
     if(fclose(f)!=0) fail("close 2");
+    if(checksum!=outChecksum) fail("checksum");
+    
+    //Read blocks backwards, exercising fast seek if the filesystem supports it
+    int fd=open(name,O_RDONLY);
+    if(fd<0) fail("open 3");
+    ioctl(fd,IOCTL_FAST_SEEK,0); //Not an error if unsupported
+    outChecksum=0;
+    for(int i=numBlocks-1;i>=0;i--)
+    {
+        if(lseek(fd,i*size,SEEK_SET)!=static_cast<off_t>(i*size)) fail("lseek");
+        memset(buf,0,size);
+        if(read(fd,buf,size)!=static_cast<ssize_t>(size)) fail("read 2");
+        outChecksum^=crc16(buf,size);
+    }
+    if(close(fd)!=0) fail("close 3");
+    if(checksum!=outChecksum) fail("checksum 2");
+    
+    //Preallocation must not change the file size, neither while writing into
+    //the reserved space nor after the unused space is released at close
+    const char name2[]="/sd/testdir/file_6.dat";
+    if((fd=open(name2,O_WRONLY|O_CREAT|O_TRUNC,0644))<0) fail("open 4");
+    off_t reserve=numBlocks*size;
+    if(ioctl(fd,IOCTL_PREALLOCATE,&reserve)!=0) fail("preallocate");
+    struct stat st;
+    if(fstat(fd,&st) || st.st_size!=0) fail("prealloc size");
+    memset(buf,'6',size);
+    for(int i=0;i<3;i++)
+        if(write(fd,buf,size)!=static_cast<ssize_t>(size)) fail("write 2");
+    if(fstat(fd,&st) || st.st_size!=3*size) fail("prealloc size 2");
+    if(close(fd)!=0) fail("close 4");
+    if(stat(name2,&st)) fail("stat");
+    if(st.st_size!=3*size) fail("prealloc size 3");
+    if(unlink(name2)) fail("unlink");
+    
+    //Scatter-gather and positional I/O, that must not move the file pointer
+    const char name3[]="/sd/testdir/file_7.dat";
+    if((fd=open(name3,O_RDWR|O_CREAT|O_TRUNC,0644))<0) fail("open 5");
+    char hdr[4]={'h','d','r','\n'};
+    memset(buf,'7',size);
+    struct iovec iov[2];
+    iov[0].iov_base=hdr;
+    iov[0].iov_len=sizeof(hdr);
+    iov[1].iov_base=buf;
+    iov[1].iov_len=size;
+    if(writev(fd,iov,2)!=static_cast<ssize_t>(sizeof(hdr)+size))
+        fail("writev");
+    if(pwrite(fd,"HDR",3,0)!=3) fail("pwrite");
+    char tmp[4];
+    if(pread(fd,tmp,4,0)!=4 || memcmp(tmp,"HDR\n",4)) fail("pread");
+    if(pread(fd,tmp,4,sizeof(hdr)+size)!=0) fail("pread at EOF");
+    if(pread(fd,tmp,4,sizeof(hdr)+size+1)!=0) fail("pread past EOF");
+    if(lseek(fd,0,SEEK_CUR)!=static_cast<off_t>(sizeof(hdr)+size))
+        fail("pread/pwrite moved file pointer");
+    if(lseek(fd,0,SEEK_SET)!=0) fail("lseek 2");
+    memset(buf,0,size);
+    iov[0].iov_base=tmp;
+    if(readv(fd,iov,2)!=static_cast<ssize_t>(sizeof(hdr)+size))
+        fail("readv");
+    if(memcmp(tmp,"HDR\n",4)) fail("readv 2");
+    for(unsigned int i=0;i<size;i++) if(buf[i]!='7') fail("readv 3");
+    if(readv(fd,iov,2)!=0) fail("readv at EOF");
+    
+    //Asynchronous I/O, requests are served in submission order
+    const off_t end=sizeof(hdr)+size;
+    AioRequest w1, w2, r;
+    w1.op=AioRequest::WRITE;
+    w1.data=const_cast<char*>("aio\n");
+    w1.len=4;
+    w2.op=AioRequest::WRITE;
+    w2.data=const_cast<char*>("A");
+    w2.len=1;
+    w2.pos=0;
+    char atmp[4]={0};
+    r.op=AioRequest::READ;
+    r.data=atmp;
+    r.len=4;
+    r.pos=end;
+    EventQueue eq;
+    bool called=false;
+    r.callback=[&called](AioRequest *req){ called=req->result()==4; };
+    r.queue=&eq;
+    if(aioSubmit(fd,&w1) || aioSubmit(fd,&w2) || aioSubmit(fd,&r))
+        fail("aioSubmit");
+    if(w2.wait()!=1 || w1.done()==false) fail("aio order");
+    if(w1.result()!=4) fail("aio write");
+    //The request completes only once the callback posted to eq has been called
+    for(int i=0;i<100 && eq.empty();i++) Thread::sleep(5);
+    if(r.done()) fail("aio done before callback");
+    eq.runOne();
+    if(called==false || r.done()==false || r.result()!=4) fail("aio callback");
+    if(memcmp(atmp,"aio\n",4)) fail("aio read");
+    if(lseek(fd,0,SEEK_CUR)!=end+4) fail("aio file pointer");
+    if(pread(fd,tmp,1,0)!=1 || tmp[0]!='A') fail("aio pwrite");
+    if(close(fd)!=0) fail("close 5");
+    if(unlink(name3)) fail("unlink 2");
     delete[] buf;
     
-    if(checksum!=outChecksum) fail("checksum");
     pass();
 }
 
@@ -4829,6 +5115,53 @@ void runElfTest(const char *name, const unsigned char *filename, unsigned int fi
 	}
 }
 
+//Prints the average time of an operation, in microseconds
+static void printElfBenchmark(const char *name, long long ticks, int iterations)
+{
+	int us = static_cast<int>(ticks * 1000000 / (TICK_FREQ * iterations));
+	iprintf("%s: %dus\n", name, us);
+}
+
+//Measures the cost of starting a process: elf validation time, latency from
+//spawn to the end of a program whose main() returns immediately, and the RAM
+//each process uses. Print the results to track them across releases
+void runElfBenchmark()
+{
+	const int iterations = 100;
+	const unsigned int *elf = reinterpret_cast<const unsigned int*>(testsuite_simple_elf);
+	iprintf("\nExecuting ELF benchmark.\n");
+	iprintf("------------------------\n");
+
+	long long start = getTick();
+	for(int i = 0; i < iterations; i++)
+		ElfProgram prog(elf, testsuite_simple_elf_len);
+	printElfBenchmark("Elf validation", getTick() - start, iterations);
+
+	int ec;
+	start = getTick();
+	for(int i = 0; i < iterations; i++)
+	{
+		ElfProgram prog(elf, testsuite_simple_elf_len);
+		Process::waitpid(Process::create(prog), &ec, 0);
+	}
+	printElfBenchmark("Spawn to exit, validating the elf", getTick() - start, iterations);
+
+	SystemMap::instance().addElfProgram("bench", elf, testsuite_simple_elf_len);
+	const ElfProgram *cached = SystemMap::instance().getProgram("bench");
+	start = getTick();
+	for(int i = 0; i < iterations; i++)
+		Process::waitpid(Process::create(*cached), &ec, 0);
+	printElfBenchmark("Spawn to exit, cached elf", getTick() - start, iterations);
+
+	unsigned int heapBefore = MemoryProfiling::getCurrentFreeHeap();
+	pid_t child = Process::create(*cached);
+	unsigned int heapAfter = MemoryProfiling::getCurrentFreeHeap();
+	Process::waitpid(child, &ec, 0);
+	iprintf("Per-process RAM: %d bytes image, %d bytes kernel heap\n",
+		cached->getProcessImageSize(), heapBefore - heapAfter);
+	SystemMap::instance().removeElfProgram("bench");
+}
+
 //It runs the program, waits for its exit, and returns the exit code
 int runProgram(const unsigned char *filename, unsigned int file_length)
 {
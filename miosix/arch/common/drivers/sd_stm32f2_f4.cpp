@@ -32,9 +32,11 @@
 #include "kernel/scheduler/scheduler.h"
 #include "interfaces/delays.h"
 #include "kernel/kernel.h"
+#include "kernel/sync.h"
 #include "board_settings.h" //For sdVoltage and SD_ONE_BIT_DATABUS definitions
 #include <cstdio>
 #include <cstring>
+#include <algorithm>
 #include <errno.h>
 
 //Note: enabling debugging might cause deadlock when using sleep() or reboot()
@@ -122,7 +124,7 @@ void __attribute__((naked)) SDIO_IRQHandler()
 namespace miosix {
 
 static volatile bool transferError; ///< \internal DMA or SDIO transfer error
-static Thread *waiting;             ///< \internal Thread waiting for transfer
+static Semaphore xferDone;          ///< \internal Signaled at transfer end
 static unsigned int dmaFlags;       ///< \internal DMA status flags
 static unsigned int sdioFlags;      ///< \internal SDIO status flags
 
@@ -141,11 +143,9 @@ void __attribute__((used)) DMA2stream3irqImpl()
                 DMA_LIFCR_CDMEIF3 |
                 DMA_LIFCR_CFEIF3;
     
-    if(!waiting) return;
-    waiting->IRQwakeup();
-	if(waiting->IRQgetPriority()>Thread::IRQgetCurrentThread()->IRQgetPriority())
-		Scheduler::IRQfindNextThread();
-    waiting=0;
+    bool hppw=false;
+    xferDone.IRQsignal(hppw);
+    if(hppw) Scheduler::IRQfindNextThread();
 }
 
 /**
@@ -161,11 +161,9 @@ void __attribute__((used)) SDIOirqImpl()
     
     SDIO->ICR=0x7ff;//Clear flags
     
-    if(!waiting) return;
-    waiting->IRQwakeup();
-	if(waiting->IRQgetPriority()>Thread::IRQgetCurrentThread()->IRQgetPriority())
-		Scheduler::IRQfindNextThread();
-    waiting=0;
+    bool hppw=false;
+    xferDone.IRQsignal(hppw);
+    if(hppw) Scheduler::IRQfindNextThread();
 }
 
 /*
@@ -192,6 +190,29 @@ enum CardType
 ///\internal Type of card.
 static CardType cardType=Invalid;
 
+///\internal Size of the card in 512 byte blocks, zero if unknown
+static unsigned int cardBlocks=0;
+
+#if SD_READ_AHEAD_BLOCKS>1
+///\internal Prefetched blocks, see SD_READ_AHEAD_BLOCKS
+static unsigned char readAheadBuffer[SD_READ_AHEAD_BLOCKS*512]
+        __attribute__((aligned(32)));
+static unsigned int readAheadLba;   ///<\internal First prefetched block
+static unsigned int readAheadCount=0;///<\internal Number of prefetched blocks
+///\internal Block after the last read. Initialized to an invalid value, so
+///that the repeated reads of block 0 done by clock calibration don't prefetch
+static unsigned int nextReadLba=0xffffffff;
+#endif //SD_READ_AHEAD_BLOCKS>1
+
+#if SD_WRITE_COALESCE_BLOCKS>1
+///\internal Written blocks not yet sent to the card, see
+///SD_WRITE_COALESCE_BLOCKS
+static unsigned char writeBuffer[SD_WRITE_COALESCE_BLOCKS*512]
+        __attribute__((aligned(32)));
+static unsigned int writeLba;       ///<\internal First held block
+static unsigned int writeCount=0;   ///<\internal Number of held blocks
+#endif //SD_WRITE_COALESCE_BLOCKS>1
+
 //SD card GPIOs
 typedef Gpio<GPIOC_BASE,8>  sdD0;
 typedef Gpio<GPIOC_BASE,9>  sdD1;
@@ -877,8 +898,8 @@ static void displayBlockTransferError()
 /**
  * \internal
  * Contains initial common code between multipleBlockRead and multipleBlockWrite
- * to clear interrupt and error flags, set the waiting thread and compute the
- * memory transfer size based on buffer alignment
+ * to clear interrupt and error flags, reset the transfer semaphore and compute
+ * the memory transfer size based on buffer alignment
  * \return the best DMA transfer size for a given buffer alignment 
  */
 static unsigned int dmaTransferCommonSetup(const unsigned char *buffer)
@@ -892,7 +913,7 @@ static unsigned int dmaTransferCommonSetup(const unsigned char *buffer)
     
     transferError=false;
     dmaFlags=sdioFlags=0;
-    waiting=Thread::getCurrentThread();
+    xferDone.reset();
     
     //Select DMA transfer size based on buffer alignment. Best performance
     //is achieved when the buffer is aligned on a 4 byte boundary
@@ -957,7 +978,7 @@ static bool multipleBlockRead(unsigned char *buffer, unsigned int nblk,
 			  	     DMA_SxCR_EN;         //Start the DMA
     
     SDIO->DLEN=nblk*512;
-    if(waiting==0)
+    if(xferDone.getCount()!=0)
     {
         DBGERR("Premature wakeup\n");
         transferError=true;
@@ -967,15 +988,7 @@ static bool multipleBlockRead(unsigned char *buffer, unsigned int nblk,
     {
         //Block size 512 bytes, block data xfer, from card to controller
         SDIO->DCTRL=(9<<4) | SDIO_DCTRL_DMAEN | SDIO_DCTRL_DTDIR | SDIO_DCTRL_DTEN;
-        FastInterruptDisableLock dLock;
-        while(waiting)
-        {
-            Thread::IRQwait();
-            {
-                FastInterruptEnableLock eLock(dLock);
-                Thread::yield();
-            }
-        }
+        xferDone.wait();
     } else transferError=true;
     DMA2_Stream3->CR=0;
     while(DMA2_Stream3->CR & DMA_SxCR_EN) ; //DMA may take time to stop
@@ -1062,7 +1075,7 @@ static bool multipleBlockWrite(const unsigned char *buffer, unsigned int nblk,
 			  	     DMA_SxCR_EN;         //Start the DMA
     
     SDIO->DLEN=nblk*512;
-    if(waiting==0)
+    if(xferDone.getCount()!=0)
     {
         DBGERR("Premature wakeup\n");
         transferError=true;
@@ -1072,15 +1085,7 @@ static bool multipleBlockWrite(const unsigned char *buffer, unsigned int nblk,
     {
         //Block size 512 bytes, block data xfer, from card to controller
         SDIO->DCTRL=(9<<4) | SDIO_DCTRL_DMAEN | SDIO_DCTRL_DTEN;
-        FastInterruptDisableLock dLock;
-        while(waiting)
-        {
-            Thread::IRQwait();
-            {
-                FastInterruptEnableLock eLock(dLock);
-                Thread::yield();
-            }
-        }
+        xferDone.wait();
     } else transferError=true;
     DMA2_Stream3->CR=0;
     while(DMA2_Stream3->CR & DMA_SxCR_EN) ; //DMA may take time to stop
@@ -1142,10 +1147,172 @@ private:
     bool success;
 };
 
+//
+// Block transfer functions
+//
+
+/**
+ * \internal
+ * Read blocks from the card, retrying on errors
+ * \param buffer, a buffer whose size is 512*nSectors bytes
+ * \param nSectors number of blocks to read
+ * \param lba logical block address of the first block to read
+ * \return true on success
+ */
+static bool readBlocks(unsigned char *buffer, unsigned int nSectors,
+        unsigned int lba)
+{
+    bool goodBuffer=BufferConverter::isGoodBuffer(buffer);
+    if(goodBuffer==false) DBG("Buffer inside CCM\n");
+    
+    for(int i=0;i<ClockController::getRetryCount();i++)
+    {
+        CardSelector selector;
+        if(selector.succeded()==false) continue;
+        bool error=false;
+        
+        if(goodBuffer)
+        {
+            if(multipleBlockRead(buffer,nSectors,lba)==false) error=true;
+        } else {
+            //Fallback code to work around CCM
+            unsigned char *tempBuffer=buffer;
+            unsigned int tempLba=lba;
+            for(unsigned int j=0;j<nSectors;j++)
+            {
+                unsigned char* b=BufferConverter::toWordAlignedWithoutCopy(tempBuffer);
+                if(multipleBlockRead(b,1,tempLba)==false)
+                {
+                    error=true;
+                    break;
+                }
+                BufferConverter::toOriginalBuffer();
+                tempBuffer+=512;
+                tempLba++;
+            }
+        }
+        
+        if(error==false)
+        {
+            if(i>0) DBGERR("Read: required %d retries\n",i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * \internal
+ * Write blocks to the card, retrying on errors
+ * \param buffer, a buffer whose size is 512*nSectors bytes
+ * \param nSectors number of blocks to write
+ * \param lba logical block address of the first block to write
+ * \return true on success
+ */
+static bool writeBlocks(const unsigned char *buffer, unsigned int nSectors,
+        unsigned int lba)
+{
+    bool goodBuffer=BufferConverter::isGoodBuffer(buffer);
+    if(goodBuffer==false) DBG("Buffer inside CCM\n");
+    
+    for(int i=0;i<ClockController::getRetryCount();i++)
+    {
+        CardSelector selector;
+        if(selector.succeded()==false) continue;
+        bool error=false;
+        
+        if(goodBuffer)
+        {
+            if(multipleBlockWrite(buffer,nSectors,lba)==false) error=true;
+        } else {
+            //Fallback code to work around CCM
+            const unsigned char *tempBuffer=buffer;
+            unsigned int tempLba=lba;
+            for(unsigned int j=0;j<nSectors;j++)
+            {
+                const unsigned char* b=BufferConverter::toWordAligned(tempBuffer);
+                if(multipleBlockWrite(b,1,tempLba)==false)
+                {
+                    error=true;
+                    break;
+                }
+                tempBuffer+=512;
+                tempLba++;
+            }
+        }
+        
+        if(error==false)
+        {
+            if(i>0) DBGERR("Write: required %d retries\n",i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * \internal
+ * \return true if two ranges of blocks overlap
+ */
+static inline bool overlaps(unsigned int lba1, unsigned int count1,
+        unsigned int lba2, unsigned int count2)
+{
+    return lba1<lba2+count2 && lba2<lba1+count1;
+}
+
+#if SD_WRITE_COALESCE_BLOCKS>1
+/**
+ * \internal
+ * Write to the card the blocks held by write coalescing, if any
+ * \return true on success. On failure, the blocks remain held and are written
+ * again by the next flush, as the writes that filled them already succeeded
+ */
+static bool flushHeldWrites()
+{
+    if(writeCount==0) return true;
+    #if SD_READ_AHEAD_BLOCKS>1
+    //Prefetched blocks the write overlaps with become stale
+    if(overlaps(writeLba,writeCount,readAheadLba,readAheadCount))
+        readAheadCount=0;
+    #endif //SD_READ_AHEAD_BLOCKS>1
+    if(writeBlocks(writeBuffer,writeCount,writeLba)==false) return false;
+    writeCount=0;
+    return true;
+}
+#endif //SD_WRITE_COALESCE_BLOCKS>1
+
 //
 // Initialization helper functions
 //
 
+/**
+ * \internal
+ * Compute the card size from the CSD register
+ * \param resp1 CSD bits 127:96
+ * \param resp2 CSD bits 95:64
+ * \param resp3 CSD bits 63:32
+ * \return the card size in 512 byte blocks, or zero if unknown
+ */
+static unsigned int decodeCardBlocks(unsigned int resp1, unsigned int resp2,
+        unsigned int resp3)
+{
+    switch(resp1>>30) //CSD_STRUCTURE
+    {
+        case 0: //CSD version 1.0, SDv1 and SDv2 standard capacity
+        {
+            unsigned int readBlLen=(resp2>>16) & 0xf;
+            unsigned int cSize=((resp2 & 0x3ff)<<2) | (resp3>>30);
+            unsigned int cSizeMult=(resp3>>15) & 0x7;
+            if(readBlLen<9) return 0;
+            return (cSize+1)<<(cSizeMult+2+readBlLen-9);
+        }
+        case 1: //CSD version 2.0, SDHC and SDXC
+            return ((((resp2 & 0x3f)<<16) | (resp3>>16))+1)*1024;
+        default:
+            return 0;
+    }
+}
+
 /**
  * \internal
  * Initialzes the SDIO peripheral in the STM32
@@ -1307,46 +1474,51 @@ ssize_t SDIODriver::readBlock(void* buffer, size_t size, off_t where)
     if(where % 512 || size % 512) return -EFAULT;
     unsigned int lba=where/512;
     unsigned int nSectors=size/512;
+    unsigned char *dest=reinterpret_cast<unsigned char*>(buffer);
     Lock<FastMutex> l(mutex);
     DBG("SDIODriver::readBlock(): nSectors=%d\n",nSectors);
-    bool goodBuffer=BufferConverter::isGoodBuffer(buffer);
-    if(goodBuffer==false) DBG("Buffer inside CCM\n");
     
-    for(int i=0;i<ClockController::getRetryCount();i++)
+    #if SD_WRITE_COALESCE_BLOCKS>1
+    //Held writes overlapping the read have to reach the card first
+    if(overlaps(lba,nSectors,writeLba,writeCount) && flushHeldWrites()==false)
+        return -EBADF;
+    #endif //SD_WRITE_COALESCE_BLOCKS>1
+    
+    #if SD_READ_AHEAD_BLOCKS>1
+    bool sequential= lba==nextReadLba;
+    nextReadLba=lba+nSectors;
+    if(readAheadCount>0 && lba>=readAheadLba &&
+       lba+nSectors<=readAheadLba+readAheadCount)
     {
-        CardSelector selector;
-        if(selector.succeded()==false) continue;
-        bool error=false;
-        
-        if(goodBuffer)
-        {
-            if(multipleBlockRead(reinterpret_cast<unsigned char*>(buffer),
-                nSectors,lba)==false) error=true;
-        } else {
-            //Fallback code to work around CCM
-            unsigned char *tempBuffer=reinterpret_cast<unsigned char*>(buffer);
-            unsigned int tempLba=lba;
-            for(unsigned int j=0;j<nSectors;j++)
-            {
-                unsigned char* b=BufferConverter::toWordAlignedWithoutCopy(tempBuffer);
-                if(multipleBlockRead(b,1,tempLba)==false)
-                {
-                    error=true;
-                    break;
-                }
-                BufferConverter::toOriginalBuffer();
-                tempBuffer+=512;
-                tempLba++;
-            }
-        }
-        
-        if(error==false)
+        memcpy(dest,readAheadBuffer+(lba-readAheadLba)*512,size);
+        return size;
+    }
+    
+    //If the read continues the previous one, prefetch the following blocks
+    //as well. Only done if the card size is known, as reading past the end of
+    //the card causes an error, and such an error reduces the clock speed
+    if(sequential && nSectors<SD_READ_AHEAD_BLOCKS && lba<cardBlocks)
+    {
+        unsigned int n=std::min<unsigned int>(SD_READ_AHEAD_BLOCKS,
+                                              cardBlocks-lba);
+        readAheadCount=0;
+        //Held writes overlapping the prefetched blocks have to reach the card
+        //first, or the prefetch would read stale data. If they can't, just
+        //don't prefetch, as the requested blocks don't overlap them
+        #if SD_WRITE_COALESCE_BLOCKS>1
+        if(overlaps(lba,n,writeLba,writeCount) && flushHeldWrites()==false)
+            n=0;
+        #endif //SD_WRITE_COALESCE_BLOCKS>1
+        if(n>=nSectors && readBlocks(readAheadBuffer,n,lba))
         {
-            if(i>0) DBGERR("Read: required %d retries\n",i);
+            readAheadLba=lba;
+            readAheadCount=n;
+            memcpy(dest,readAheadBuffer,size);
             return size;
         }
     }
-    return -EBADF;
+    #endif //SD_READ_AHEAD_BLOCKS>1
+    return readBlocks(dest,nSectors,lba) ? size : -EBADF;
 }
 
 ssize_t SDIODriver::writeBlock(const void* buffer, size_t size, off_t where)
@@ -1354,46 +1526,43 @@ ssize_t SDIODriver::writeBlock(const void* buffer, size_t size, off_t where)
     if(where % 512 || size % 512) return -EFAULT;
     unsigned int lba=where/512;
     unsigned int nSectors=size/512;
+    const unsigned char *src=reinterpret_cast<const unsigned char*>(buffer);
     Lock<FastMutex> l(mutex);
     DBG("SDIODriver::writeBlock(): nSectors=%d\n",nSectors);
-    bool goodBuffer=BufferConverter::isGoodBuffer(buffer);
-    if(goodBuffer==false) DBG("Buffer inside CCM\n");
     
-    for(int i=0;i<ClockController::getRetryCount();i++)
+    #if SD_READ_AHEAD_BLOCKS>1
+    //Prefetched blocks the write overlaps with become stale
+    if(overlaps(lba,nSectors,readAheadLba,readAheadCount)) readAheadCount=0;
+    #endif //SD_READ_AHEAD_BLOCKS>1
+    
+    #if SD_WRITE_COALESCE_BLOCKS>1
+    //Hold small writes in RAM as long as they are contiguous, to send them
+    //to the card with a single multiple block write
+    if(nSectors>=SD_WRITE_COALESCE_BLOCKS || (writeCount>0 &&
+       (lba!=writeLba+writeCount ||
+        writeCount+nSectors>SD_WRITE_COALESCE_BLOCKS)))
     {
-        CardSelector selector;
-        if(selector.succeded()==false) continue;
-        bool error=false;
-        
-        if(goodBuffer)
+        if(flushHeldWrites()==false)
         {
-            if(multipleBlockWrite(reinterpret_cast<const unsigned char*>(buffer),
-                nSectors,lba)==false) error=true;
-        } else {
-            //Fallback code to work around CCM
-            const unsigned char *tempBuffer=
-                reinterpret_cast<const unsigned char*>(buffer);
-            unsigned int tempLba=lba;
-            for(unsigned int j=0;j<nSectors;j++)
-            {
-                const unsigned char* b=BufferConverter::toWordAligned(tempBuffer);
-                if(multipleBlockWrite(b,1,tempLba)==false)
-                {
-                    error=true;
-                    break;
-                }
-                tempBuffer+=512;
-                tempLba++;
-            }
-        }
-        
-        if(error==false)
-        {
-            if(i>0) DBGERR("Write: required %d retries\n",i);
-            return size;
+            //The held blocks stay in RAM to be retried, so this write can
+            //only go to the card directly, unless it overlaps them, as they
+            //would later overwrite it with older data
+            if(overlaps(lba,nSectors,writeLba,writeCount)) return -EBADF;
+            return writeBlocks(src,nSectors,lba) ? size : -EBADF;
         }
     }
-    return -EBADF;
+    if(nSectors<SD_WRITE_COALESCE_BLOCKS)
+    {
+        if(writeCount==0) writeLba=lba;
+        memcpy(writeBuffer+writeCount*512,src,size);
+        writeCount+=nSectors;
+        //If the flush fails the blocks stay held, and the error is reported
+        //by a later write needing the buffer, or by the next IOCTL_SYNC
+        if(writeCount==SD_WRITE_COALESCE_BLOCKS) flushHeldWrites();
+        return size;
+    }
+    #endif //SD_WRITE_COALESCE_BLOCKS>1
+    return writeBlocks(src,nSectors,lba) ? size : -EBADF;
 }
 
 int SDIODriver::ioctl(int cmd, void* arg)
@@ -1401,6 +1570,11 @@ int SDIODriver::ioctl(int cmd, void* arg)
     DBG("SDIODriver::ioctl()\n");
     if(cmd!=IOCTL_SYNC) return -ENOTTY;
     Lock<FastMutex> l(mutex);
+    #if SD_WRITE_COALESCE_BLOCKS>1
+    //Held writes were reported as successful, so this is where an error
+    //writing them to the card is reported. They remain held for a retry
+    if(flushHeldWrites()==false) return -EFAULT;
+    #endif //SD_WRITE_COALESCE_BLOCKS>1
     //Note: no need to select card, since status can be queried even with card
     //not selected.
     return waitForCardReady() ? 0 : -EFAULT;
@@ -1443,6 +1617,13 @@ SDIODriver::SDIODriver() : Device(Device::BLOCK)
         return;
     }
 
+    //Read the CSD to get the card size, used to keep read-ahead within the
+    //card. CMD9 sends R2 response, whose CMDINDEX field is wrong
+    r=Command::send(Command::CMD9,Command::getRca()<<16);
+    if(r.getError()==CmdResult::Ok || r.getError()==CmdResult::RespNotMatch)
+        cardBlocks=decodeCardBlocks(SDIO->RESP1,SDIO->RESP2,SDIO->RESP3);
+    DBG("Card size=%u blocks\n",cardBlocks);
+
     //Lastly, try selecting the card and configure the latest bits
     {
         CardSelector selector;
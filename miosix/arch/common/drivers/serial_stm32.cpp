@@ -62,6 +62,28 @@ typedef Gpio<GPIOB_BASE,14> u3rts;
 /// Pointer to serial port classes to let interrupts access the classes
 static STM32Serial *ports[numPorts]={0};
 
+#ifdef SERIAL_DMA
+/// Which serial ports use DMA
+static const bool portHasDma[numPorts]=
+{
+    #ifdef SERIAL_1_DMA
+    true,
+    #else //SERIAL_1_DMA
+    false,
+    #endif //SERIAL_1_DMA
+    #ifdef SERIAL_2_DMA
+    true,
+    #else //SERIAL_2_DMA
+    false,
+    #endif //SERIAL_2_DMA
+    #ifdef SERIAL_3_DMA
+    true
+    #else //SERIAL_3_DMA
+    false
+    #endif //SERIAL_3_DMA
+};
+#endif //SERIAL_DMA
+
 /**
  * \internal interrupt routine for usart1 actual implementation
  */
@@ -145,7 +167,20 @@ void __attribute__((noinline)) usart1txDmaImpl()
  */
 void __attribute__((noinline)) usart1rxDmaImpl()
 {
-    if(ports[0]) ports[0]->IRQhandleDMArx();
+    //The DMA is in circular mode, so it is not disabled, just clear flags.
+    //Errors however disable it, so check them before clearing the flags
+    #ifdef _ARCH_CORTEXM3_STM32
+    bool error=DMA1->ISR & DMA_ISR_TEIF5;
+    DMA1->IFCR=DMA_IFCR_CGIF5;
+    #else //stm32f2 and f4
+    bool error=DMA2->HISR & (DMA_HISR_TEIF5 | DMA_HISR_DMEIF5);
+    DMA2->HIFCR=DMA_HIFCR_CTCIF5
+              | DMA_HIFCR_CHTIF5
+              | DMA_HIFCR_CTEIF5
+              | DMA_HIFCR_CDMEIF5
+              | DMA_HIFCR_CFEIF5;
+    #endif
+    if(ports[0]) ports[0]->IRQhandleDMArx(error);
 }
 
 #ifdef _ARCH_CORTEXM3_STM32
@@ -217,7 +252,20 @@ void __attribute__((noinline)) usart2txDmaImpl()
  */
 void __attribute__((noinline)) usart2rxDmaImpl()
 {
-    if(ports[1]) ports[1]->IRQhandleDMArx();
+    //The DMA is in circular mode, so it is not disabled, just clear flags.
+    //Errors however disable it, so check them before clearing the flags
+    #ifdef _ARCH_CORTEXM3_STM32
+    bool error=DMA1->ISR & DMA_ISR_TEIF6;
+    DMA1->IFCR=DMA_IFCR_CGIF6;
+    #else //stm32f2 and f4
+    bool error=DMA1->HISR & (DMA_HISR_TEIF5 | DMA_HISR_DMEIF5);
+    DMA1->HIFCR=DMA_HIFCR_CTCIF5
+              | DMA_HIFCR_CHTIF5
+              | DMA_HIFCR_CTEIF5
+              | DMA_HIFCR_CDMEIF5
+              | DMA_HIFCR_CFEIF5;
+    #endif
+    if(ports[1]) ports[1]->IRQhandleDMArx(error);
 }
 
 #ifdef _ARCH_CORTEXM3_STM32
@@ -289,7 +337,20 @@ void __attribute__((noinline)) usart3txDmaImpl()
  */
 void __attribute__((noinline)) usart3rxDmaImpl()
 {
-    if(ports[2]) ports[2]->IRQhandleDMArx();
+    //The DMA is in circular mode, so it is not disabled, just clear flags.
+    //Errors however disable it, so check them before clearing the flags
+    #ifdef _ARCH_CORTEXM3_STM32
+    bool error=DMA1->ISR & DMA_ISR_TEIF3;
+    DMA1->IFCR=DMA_IFCR_CGIF3;
+    #else //stm32f2 and f4
+    bool error=DMA1->LISR & (DMA_LISR_TEIF1 | DMA_LISR_DMEIF1);
+    DMA1->LIFCR=DMA_LIFCR_CTCIF1
+              | DMA_LIFCR_CHTIF1
+              | DMA_LIFCR_CTEIF1
+              | DMA_LIFCR_CDMEIF1
+              | DMA_LIFCR_CFEIF1;
+    #endif
+    if(ports[2]) ports[2]->IRQhandleDMArx(error);
 }
 
 #ifdef _ARCH_CORTEXM3_STM32
@@ -442,7 +503,26 @@ void STM32Serial::commonInit(int id, int baudrate, GpioPin tx, GpioPin rx,
     dmaTx=0;
     dmaRx=0;
     txWaiting=0;
+    rxBuffer=0;
+    rxBufferSize=0;
+    rxBufferPos=0;
     dmaTxInProgress=false;
+    //Allocate the DMA rx buffer here, as the heap can't be accessed with
+    //interrupts disabled
+    if(id>=1 && id<=numPorts && portHasDma[id-1])
+    {
+        #ifdef SERIAL_DMA_RX_BUFFER_SIZE
+        rxBufferSize=SERIAL_DMA_RX_BUFFER_SIZE;
+        #else //SERIAL_DMA_RX_BUFFER_SIZE
+        //10ms of data, see the note on baudrate/500 for the rx queue size
+        rxBufferSize=baudrate/1000;
+        #endif //SERIAL_DMA_RX_BUFFER_SIZE
+        //Half transfer interrupt requires at least two bytes, and the DMA
+        //transfer size is limited to 64K
+        if(rxBufferSize<2*rxQueueMin) rxBufferSize=2*rxQueueMin;
+        if(rxBufferSize>65535) rxBufferSize=65535;
+        rxBuffer=new char[rxBufferSize];
+    }
     #endif //SERIAL_DMA
     InterruptDisableLock dLock;
     if(id<1|| id>numPorts || ports[id-1]!=0) errorHandler(UNEXPECTED);
@@ -822,7 +902,15 @@ void STM32Serial::IRQhandleInterrupt()
         port->ICR=USART_ICR_IDLECF; //clears interrupt flags
         #endif //_ARCH_CORTEXM7_STM32F7/H7
         #ifdef SERIAL_DMA
-        if(dmaRx) IRQreadDma();
+        if(dmaRx)
+        {
+            //Flush the partially filled rxBuffer. The DMA rx interrupt has
+            //higher priority and also reads rxBuffer, so prevent it from
+            //running in the middle
+            fastDisableInterrupts();
+            IRQreadDma();
+            fastEnableInterrupts();
+        }
         #endif //SERIAL_DMA
         idle=true;
     }
@@ -851,9 +939,16 @@ void STM32Serial::IRQhandleDMAtx()
     txWaiting=0;
 }
 
-void STM32Serial::IRQhandleDMArx()
+void STM32Serial::IRQhandleDMArx(bool error)
 {
     IRQreadDma();
+    if(error)
+    {
+        //A transfer error disabled the DMA, restart it or reception would
+        //stop. Data received before the error has just been read
+        IRQdmaReadStop();
+        IRQdmaReadStart();
+    }
     idle=false;
     if(rxWaiting==0) return;
     rxWaiting->IRQwakeup();
@@ -945,6 +1040,9 @@ STM32Serial::~STM32Serial()
             #endif //!defined(STM32_NO_SERIAL_2_3)
         }
     }
+    #ifdef SERIAL_DMA
+    delete[] rxBuffer;
+    #endif //SERIAL_DMA
 }
 
 #ifdef SERIAL_DMA
@@ -1020,22 +1118,37 @@ void STM32Serial::writeDma(const char *buffer, size_t size)
 
 void STM32Serial::IRQreadDma()
 {
-    int elem=IRQdmaReadStop();
-    markBufferAfterDmaRead(rxBuffer,rxQueueMin);
-    for(int i=0;i<elem;i++)
-        if(rxQueue.tryPut(rxBuffer[i])==false) /*fifo overflow*/;
-    IRQdmaReadStart();
+    //The DMA never stops, the number of bytes it still has to transfer before
+    //wrapping around tells where it is writing
+    #ifdef _ARCH_CORTEXM3_STM32
+    unsigned int writePos=rxBufferSize-dmaRx->CNDTR;
+    #else //_ARCH_CORTEXM3_STM32
+    unsigned int writePos=rxBufferSize-dmaRx->NDTR;
+    #endif //_ARCH_CORTEXM3_STM32
+    if(writePos>=rxBufferSize) writePos=0;
+    while(rxBufferPos!=writePos)
+    {
+        //Data may wrap around the end of the buffer, copy up to there first
+        unsigned int end=writePos>rxBufferPos ? writePos : rxBufferSize;
+        markBufferAfterDmaRead(rxBuffer+rxBufferPos,end-rxBufferPos);
+        for(unsigned int i=rxBufferPos;i<end;i++)
+            if(rxQueue.tryPut(rxBuffer[i])==false) /*fifo overflow*/;
+        rxBufferPos=end==rxBufferSize ? 0 : end;
+    }
 }
 
 void STM32Serial::IRQdmaReadStart()
 {
+    rxBufferPos=0;
     #ifdef _ARCH_CORTEXM3_STM32
     dmaRx->CPAR=reinterpret_cast<unsigned int>(&port->DR);
     dmaRx->CMAR=reinterpret_cast<unsigned int>(rxBuffer);
-    dmaRx->CNDTR=rxQueueMin;
+    dmaRx->CNDTR=rxBufferSize;
     dmaRx->CCR=DMA_CCR4_MINC  //Increment RAM pointer
+             | DMA_CCR4_CIRC  //Circular mode
              | 0              //Peripheral to memory
              | DMA_CCR4_TEIE  //Interrupt on transfer error
+             | DMA_CCR4_HTIE  //Interrupt on half transfer
              | DMA_CCR4_TCIE  //Interrupt on transfer complete
              | DMA_CCR4_EN;   //Start DMA
     #else //_ARCH_CORTEXM3_STM32
@@ -1045,18 +1158,20 @@ void STM32Serial::IRQdmaReadStart()
     dmaRx->PAR=reinterpret_cast<unsigned int>(&port->RDR);
     #endif //_ARCH_CORTEXM7_STM32F7/H7
     dmaRx->M0AR=reinterpret_cast<unsigned int>(rxBuffer);
-    dmaRx->NDTR=rxQueueMin;
+    dmaRx->NDTR=rxBufferSize;
     dmaRx->CR=DMA_SxCR_CHSEL_2 //Select channel 4 (USART_RX)
                    | DMA_SxCR_MINC    //Increment RAM pointer
+                   | DMA_SxCR_CIRC    //Circular mode
                    | 0                //Peripheral to memory
                    | DMA_SxCR_HTIE    //Interrupt on half transfer
+                   | DMA_SxCR_TCIE    //Interrupt on transfer complete
                    | DMA_SxCR_TEIE    //Interrupt on transfer error
                    | DMA_SxCR_DMEIE   //Interrupt on direct mode error
                    | DMA_SxCR_EN;     //Start the DMA
     #endif //_ARCH_CORTEXM3_STM32
 }
 
-int STM32Serial::IRQdmaReadStop()
+void STM32Serial::IRQdmaReadStop()
 {
     #ifdef _ARCH_CORTEXM3_STM32
     dmaRx->CCR=0;
@@ -1067,7 +1182,6 @@ int STM32Serial::IRQdmaReadStop()
         DMA_IFCR_CGIF3   
     };
     DMA1->IFCR=irqMask[getId()-1];
-    return rxQueueMin-dmaRx->CNDTR;
     #else //_ARCH_CORTEXM3_STM32
     //Stop DMA and wait for it to actually stop
     dmaRx->CR &= ~DMA_SxCR_EN;
@@ -1085,7 +1199,6 @@ int STM32Serial::IRQdmaReadStop()
         &DMA1->LIFCR
     };
     *irqRegs[getId()-1]=irqMask[getId()-1];
-    return rxQueueMin-dmaRx->NDTR;
     #endif //_ARCH_CORTEXM3_STM32
 }
 #endif //SERIAL_DMA
@@ -54,6 +54,10 @@ namespace miosix {
  * Additionally, USARTx can use DMA if SERIAL_x_DMA is defined in
  * board_settings.h, while the other serial use polling for transmission,
  * and interrupt for reception.
+ * When using DMA, reception is done in a circular buffer that the DMA fills
+ * continuously, and that is emptied when half full, full, or when the line
+ * becomes idle. Its size defaults to 10ms of data at the selected baudrate,
+ * and can be set by defining SERIAL_DMA_RX_BUFFER_SIZE in board_settings.h
  * 
  * Classes of this type are reference counted, must be allocated on the heap
  * and managed through intrusive_ref_ptr<FileBase>
@@ -181,8 +185,9 @@ public:
     /**
      * \internal the serial port DMA rx interrupts call this member function.
      * Never call this from user code.
+     * \param error true if the DMA stopped because of a transfer error
      */
-    void IRQhandleDMArx();
+    void IRQhandleDMArx(bool error);
     #endif //SERIAL_DMA
     
     /**
@@ -217,20 +222,19 @@ private:
     void writeDma(const char *buffer, size_t size);
     
     /**
-     * Read from DMA buffer and write data to queue
+     * Move the data the DMA wrote in rxBuffer since the last call to the queue
      */
     void IRQreadDma();
     
     /**
-     * Start DMA read
+     * Start DMA read, in circular mode
      */
     void IRQdmaReadStart();
     
     /**
      * Stop DMA read
-     * \return the number of characters in rxBuffer
      */
-    int IRQdmaReadStop();
+    void IRQdmaReadStop();
     #endif //SERIAL_DMA
     
     /**
@@ -269,9 +273,12 @@ private:
     /// the fact that this class must be allocated on the heap as it derives
     /// from Device, and the Miosix linker scripts never put the heap in CCM
     char txBuffer[txBufferSize];
-    /// This buffer emulates the behaviour of a 16550. It is filled using DMA
-    /// and an interrupt is fired as soon as it is half full
-    char rxBuffer[rxQueueMin];
+    /// Circular buffer continuously filled by the DMA, an interrupt is fired
+    /// when it is half full and full. Allocated on the heap, so it is never in
+    /// the CCM of the STM32F4
+    char *rxBuffer;
+    unsigned int rxBufferSize;        ///< Size of rxBuffer
+    unsigned int rxBufferPos;         ///< First position not yet read
     bool dmaTxInProgress;             ///< True if a DMA tx is in progress
     #endif //SERIAL_DMA
     bool idle=true;                   ///< Receiver idle
@@ -0,0 +1,243 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "stm32_hrtimer.h"
+
+#ifdef WITH_HIGH_RESOLUTION_TIMER
+
+#include "interfaces/arch_registers.h"
+#include "interfaces/portability.h"
+#include "kernel/kernel.h"
+#include "kernel/scheduler/scheduler.h"
+
+using namespace miosix;
+
+namespace {
+
+/**
+ * This struct is used to make a list of threads sleeping on the timer.
+ * Instances are allocated on the stack of the sleeping thread.
+ */
+struct HrSleepData
+{
+    Thread *thread;      ///< Sleeping thread, set to null when woken
+    long long wakeup;    ///< Wakeup time in timer ticks
+    HrSleepData *next;   ///< Next thread in the list
+};
+
+long long swTime=0;               //64bit software extension of the counter
+HrSleepData *sleepingList=nullptr; //List of sleeping threads, sorted by wakeup
+
+/**
+ * \return the time in ticks (hardware part + software extension to 64bits)
+ */
+inline long long IRQgetTick()
+{
+    //Pending bit trick
+    unsigned int hwTime=TIM2->CNT;
+    if((TIM2->SR & TIM_SR_UIF) && TIM2->CNT>=hwTime)
+        return (swTime + static_cast<long long>(hwTime)) + (1LL<<32);
+    return swTime + static_cast<long long>(hwTime);
+}
+
+/**
+ * Wake all threads whose wakeup time has been reached, and set the compare
+ * register to the wakeup time of the first thread still sleeping
+ * \return true if a thread with a higher priority than the current one was
+ * woken
+ */
+bool IRQwakeThreads()
+{
+    bool hppw=false;
+    for(;;)
+    {
+        long long now=IRQgetTick();
+        while(sleepingList && sleepingList->wakeup<=now)
+        {
+            Thread *t=sleepingList->thread;
+            sleepingList->thread=nullptr;
+            sleepingList=sleepingList->next;
+            t->IRQwakeup();
+            if(t->IRQgetPriority()>Thread::IRQgetCurrentThread()->IRQgetPriority())
+                hppw=true;
+        }
+        if(sleepingList==nullptr)
+        {
+            TIM2->DIER &= ~TIM_DIER_CC1IE;
+            return hppw;
+        }
+        //The compare only matches the lower 32 bits, if the wakeup time is
+        //further than one timer overflow the interrupt is spurious and the
+        //compare is simply set again. Also, the counter may have already
+        //passed the compare value by the time it is set, so check again
+        TIM2->CCR1=static_cast<unsigned int>(sleepingList->wakeup);
+        TIM2->DIER |= TIM_DIER_CC1IE;
+        if(IRQgetTick()<sleepingList->wakeup) return hppw;
+    }
+}
+
+/**
+ * Sleep the current thread till the specified time
+ * \param tick absolute time in ticks
+ * \param dLock used to reenable interrupts while sleeping
+ * \return true if the wait time was in the past
+ */
+bool IRQabsoluteSleepTick(long long tick, FastInterruptDisableLock& dLock)
+{
+    if(IRQgetTick()>=tick) return true;
+    HrSleepData d;
+    d.thread=Thread::IRQgetCurrentThread();
+    d.wakeup=tick;
+    if(sleepingList==nullptr || tick<sleepingList->wakeup)
+    {
+        d.next=sleepingList;
+        sleepingList=&d;
+        IRQwakeThreads(); //Set the compare register
+    } else {
+        HrSleepData *walk=sleepingList;
+        while(walk->next && walk->next->wakeup<=tick) walk=walk->next;
+        d.next=walk->next;
+        walk->next=&d;
+    }
+    //The thread might have already been woken while setting the compare
+    while(d.thread)
+    {
+        Thread::IRQwait();
+        {
+            FastInterruptEnableLock eLock(dLock);
+            Thread::yield();
+        }
+    }
+    return false;
+}
+
+} //anon namespace
+
+/**
+ * TIM2 interrupt
+ */
+void __attribute__((naked)) TIM2_IRQHandler()
+{
+    saveContext();
+    asm volatile("bl _Z14hrTimerIrqImplv");
+    restoreContext();
+}
+
+/**
+ * TIM2 interrupt actual implementation
+ */
+void __attribute__((used)) hrTimerIrqImpl()
+{
+    if(TIM2->SR & TIM_SR_UIF)
+    {
+        TIM2->SR=~TIM_SR_UIF; //Flags are cleared by writing zero
+        swTime+=1LL<<32;
+    }
+    if(TIM2->SR & TIM_SR_CC1IF)
+    {
+        TIM2->SR=~TIM_SR_CC1IF;
+        if(IRQwakeThreads()) Scheduler::IRQfindNextThread();
+    }
+}
+
+namespace miosix {
+
+//
+// class HighResolutionTimer
+//
+
+HighResolutionTimer& HighResolutionTimer::instance()
+{
+    static HighResolutionTimer singleton;
+    return singleton;
+}
+
+long long HighResolutionTimer::getValue() const
+{
+    long long tick;
+    {
+        FastInterruptDisableLock dLock;
+        tick=IRQgetTick();
+    }
+    //tick2ns is reentrant, so can be called with interrupt enabled
+    return tc.tick2ns(tick);
+}
+
+long long HighResolutionTimer::IRQgetValue() const
+{
+    return tc.tick2ns(IRQgetTick());
+}
+
+void HighResolutionTimer::sleep(long long value)
+{
+    if(value<=0) return;
+    FastInterruptDisableLock dLock;
+    //ns2tick is not reentrant, so is called with interrupts disabled
+    IRQabsoluteSleepTick(IRQgetTick()+tc.ns2tick(value),dLock);
+}
+
+bool HighResolutionTimer::absoluteSleep(long long value)
+{
+    FastInterruptDisableLock dLock;
+    return IRQabsoluteSleepTick(tc.ns2tick(value),dLock);
+}
+
+unsigned int HighResolutionTimer::timerClock()
+{
+    //Timer clock is twice the APB1 clock when the APB1 prescaler has a
+    //division factor greater than 1
+    unsigned int result=SystemCoreClock;
+    unsigned int apb1prescaler=(RCC->CFGR>>10) & 7;
+    if(apb1prescaler>4) result>>=(apb1prescaler-4);
+    return result;
+}
+
+HighResolutionTimer::HighResolutionTimer()
+    : frequency(timerClock()), tc(frequency)
+{
+    FastInterruptDisableLock dLock;
+    RCC->APB1ENR |= RCC_APB1ENR_TIM2EN;
+    RCC_SYNC();
+    TIM2->CR1=0;         //Upcounter, not started, no special options
+    TIM2->CR2=0;         //No special options
+    TIM2->SMCR=0;        //No external trigger
+    TIM2->CNT=0;
+    TIM2->PSC=0;         //Count at the timer input clock
+    TIM2->ARR=0xffffffff;
+    TIM2->CCMR1=0;       //Channel 1 as output compare, frozen mode
+    TIM2->EGR=TIM_EGR_UG; //Load the prescaler shadow register
+    TIM2->SR=0;          //UG also sets the update flag, clear it
+    TIM2->DIER=TIM_DIER_UIE;
+    NVIC_SetPriority(TIM2_IRQn,5);
+    NVIC_ClearPendingIRQ(TIM2_IRQn);
+    NVIC_EnableIRQ(TIM2_IRQn);
+    TIM2->CR1=TIM_CR1_CEN;
+}
+
+} //namespace miosix
+
+#endif //WITH_HIGH_RESOLUTION_TIMER
@@ -0,0 +1,112 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef STM32_HRTIMER_H
+#define STM32_HRTIMER_H
+
+#include "config/miosix_settings.h"
+#include "kernel/timeconversion.h"
+
+#ifdef WITH_HIGH_RESOLUTION_TIMER
+
+namespace miosix {
+
+/**
+ * High resolution timer, using the 32 bit TIM2 of the stm32f2 and stm32f4
+ * as a free running counter clocked at the timer input clock, extended to
+ * 64 bits in software. Allows threads to block for time intervals shorter
+ * than the kernel tick without busy waiting.
+ * Multiple threads can sleep concurrently, they are kept in a list sorted by
+ * wakeup time, and the timer compare interrupt is set to the first one.
+ */
+class HighResolutionTimer
+{
+public:
+    /**
+     * \return an instance of this class (singleton)
+     */
+    static HighResolutionTimer& instance();
+
+    /**
+     * \return the time since the timer was started in nanoseconds
+     */
+    long long getValue() const;
+
+    /**
+     * \return the time since the timer was started in nanoseconds
+     *
+     * Can be called with interrupt disabled, or inside an interrupt
+     */
+    long long IRQgetValue() const;
+
+    /**
+     * Put the current thread to sleep for the specified relative time.
+     * \param value relative time to sleep, expressed in nanoseconds
+     *
+     * CANNOT be called when the kernel is paused.
+     */
+    void sleep(long long value);
+
+    /**
+     * Put the current thread to sleep until the specified absolute time.
+     * \param value absolute wakeup time in nanoseconds, in the same timescale
+     * as getValue()
+     * \return true if the wakeup time was in the past, in this case the
+     * function returns immediately
+     *
+     * CANNOT be called when the kernel is paused.
+     */
+    bool absoluteSleep(long long value);
+
+    /**
+     * \return the timer frequency in Hz
+     */
+    unsigned int getTickFrequency() const { return frequency; }
+
+private:
+    HighResolutionTimer(const HighResolutionTimer&);
+    HighResolutionTimer& operator=(const HighResolutionTimer&);
+
+    /**
+     * Constructor, starts the timer
+     */
+    HighResolutionTimer();
+
+    /**
+     * \return the timer input clock in Hz
+     */
+    static unsigned int timerClock();
+
+    unsigned int frequency; ///< Timer frequency
+    TimeConversion tc;      ///< Converts between timer ticks and nanoseconds
+};
+
+} //namespace miosix
+
+#endif //WITH_HIGH_RESOLUTION_TIMER
+
+#endif //STM32_HRTIMER_H
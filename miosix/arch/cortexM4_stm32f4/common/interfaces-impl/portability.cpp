@@ -291,6 +291,67 @@ void initCtxsave(unsigned int *ctxsave, void *(*pc)(void *), unsigned int *sp,
 
 #endif //WITH_PROCESSES
 
+#ifdef WITH_TICKLESS_IDLE
+
+static unsigned int tickPeriod;   ///< SysTick cycles in one kernel tick
+static unsigned int stretchFirst; ///< Cycles to first tick boundary in stretch
+static unsigned int stretchLoad;  ///< Cycles in the whole stretched period
+static unsigned int stretchTicks; ///< Kernel ticks in the stretched period
+
+/**
+ * \internal
+ * Start a one-shot SysTick period, after which SysTick goes back to periodic
+ * \param cycles length of the one-shot period
+ */
+static void IRQoneShotSysTick(unsigned int cycles)
+{
+    //A LOAD of zero disables SysTick, and too short periods could make the
+    //reload below go unnoticed
+    cycles=std::max(cycles,64u);
+    SysTick->LOAD=cycles-1;
+    SysTick->VAL=0; //Counter is reloaded with LOAD at the next clock cycle
+    while(SysTick->VAL==0) ;
+    //Takes effect only at the next reload, that is, when the period expires
+    SysTick->LOAD=tickPeriod-1;
+}
+
+unsigned int IRQstretchTick(unsigned int ticks)
+{
+    //If a tick interrupt is already pending, it must be served first
+    if(SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) return 0;
+    //SysTick counts down to the next tick boundary, which must be preserved
+    //to avoid drifting the kernel tick
+    unsigned int first=SysTick->VAL;
+    if(first==0) return 0;
+    //SysTick is a 24 bit counter
+    unsigned int maxTicks=(0xffffff-first)/tickPeriod+1;
+    ticks=std::min(ticks,maxTicks);
+    if(ticks<2) return 0;
+    stretchFirst=first;
+    stretchLoad=first+(ticks-1)*tickPeriod;
+    stretchTicks=ticks;
+    IRQoneShotSysTick(stretchLoad);
+    return ticks;
+}
+
+unsigned int IRQrestoreTick()
+{
+    unsigned int elapsed=stretchLoad-1-SysTick->VAL;
+    //The stretched period already expired, and SysTick is periodic again.
+    //The pending interrupt will account for the last tick
+    if(SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) return stretchTicks-1;
+    if(elapsed<stretchFirst)
+    {
+        IRQoneShotSysTick(stretchFirst-elapsed);
+        return 0;
+    }
+    elapsed-=stretchFirst;
+    IRQoneShotSysTick(tickPeriod-elapsed%tickPeriod);
+    return 1+elapsed/tickPeriod;
+}
+
+#endif //WITH_TICKLESS_IDLE
+
 void IRQportableStartKernel()
 {
     //Enable fault handlers
@@ -305,6 +366,9 @@ void IRQportableStartKernel()
     NVIC_SetPriority(SysTick_IRQn,3);//High priority for SysTick (Max=0, min=15)
     NVIC_SetPriority(MemoryManagement_IRQn,2);//Higher priority for MemoryManagement (Max=0, min=15)
     SysTick->LOAD=SystemCoreClock/miosix::TICK_FREQ;
+    #ifdef WITH_TICKLESS_IDLE
+    tickPeriod=SysTick->LOAD+1;
+    #endif //WITH_TICKLESS_IDLE
     //Start SysTick, set to generate interrupts
     SysTick->CTRL=SysTick_CTRL_ENABLE_Msk | SysTick_CTRL_TICKINT_Msk |
             SysTick_CTRL_CLKSOURCE_Msk;
@@ -104,6 +104,72 @@ namespace miosix {
 /// Cannot be lower than 3, as the first three are stdin, stdout, stderr
 const unsigned char MAX_OPEN_FILES=8;
 
+/// \def FAT32_MAX_SECTOR_SIZE
+/// Largest sector size of the FAT volumes that can be mounted, one of 512,
+/// 1024, 2048 or 4096. Set it to 4096 to also mount volumes formatted with
+/// 4KiB logical sectors, which have fewer, larger FAT sectors and allow larger
+/// clusters. Values above 512 increase the RAM used by each mounted volume and
+/// each open file, as both have a sector buffer. With WITH_BLOCK_CACHE, also
+/// set BLOCK_CACHE_BLOCK_SIZE to the sector size of the volume.
+/// By default it is 512
+#define FAT32_MAX_SECTOR_SIZE 512
+
+/// \def WITH_BLOCK_CACHE
+/// If uncommented, the block device mounted by basicFilesystemSetup() is
+/// wrapped in a BlockCache, a write-back cache of BLOCK_CACHE_BLOCKS blocks of
+/// BLOCK_CACHE_BLOCK_SIZE bytes with least recently used replacement. This
+/// speeds up accesses to the FAT and directories at the cost of RAM.
+/// By default it is not defined (no block cache)
+//#define WITH_BLOCK_CACHE
+
+/// Number of blocks in the block cache
+const unsigned int BLOCK_CACHE_BLOCKS=16;
+
+/// Size in bytes of the blocks in the block cache. Only single block accesses
+/// are cached, so it has to be equal to the sector size of the mounted volume:
+/// with a volume formatted with 4KiB sectors (see FAT32_MAX_SECTOR_SIZE) and
+/// 512 byte cache blocks every FAT sector access bypasses the cache, while
+/// with cache blocks larger than the volume sectors accesses fail.
+/// By default it is 512
+const unsigned int BLOCK_CACHE_BLOCK_SIZE=512;
+
+/// \def SD_READ_AHEAD_BLOCKS
+/// Number of blocks the STM32 SDIO driver prefetches with a single command
+/// when a read continues the previous one, so that the following reads are
+/// served from RAM. Uses SD_READ_AHEAD_BLOCKS*512 bytes of RAM.
+/// Set it to 1 to disable read-ahead and compile out its buffer.
+/// By default it is 8
+#define SD_READ_AHEAD_BLOCKS 8
+
+/// \def SD_WRITE_COALESCE_BLOCKS
+/// Maximum number of contiguous written blocks the STM32 SDIO driver holds in
+/// RAM and sends to the card with a single command. Uses
+/// SD_WRITE_COALESCE_BLOCKS*512 bytes of RAM. Held blocks reach the card when
+/// the buffer is full, when a non contiguous write or an overlapping read
+/// occurs, and on sync. An error writing them is reported by the next sync.
+/// This is a write-back cache, so with WITH_BLOCK_CACHE there are two of them,
+/// one on top of the other, and data written back by the block cache may still
+/// be held here until the next sync.
+/// Set it to 1 to disable write coalescing and compile out its buffer.
+/// By default it is 8
+#define SD_WRITE_COALESCE_BLOCKS 8
+
+/// \def WITH_PATH_CACHE
+/// If uncommented, FilesystemManager::resolvePath() caches the resolution of
+/// the directory part of the last PATH_CACHE_ENTRIES paths, so that opening or
+/// stat-ing files in the same directories does not walk the path and lock the
+/// global filesystem mutex. The cache is invalidated on mount, umount and
+/// rename, and is bypassed if a filesystem supporting symlinks is mounted.
+/// By default it is not defined (no path cache)
+//#define WITH_PATH_CACHE
+
+/// Number of entries in the path cache
+const unsigned int PATH_CACHE_ENTRIES=8;
+
+/// Stack size of the thread serving the requests submitted with aioSubmit().
+/// The thread is created at the first submit (MUST be divisible by 4)
+const unsigned int ASYNC_IO_STACK_SIZE=2048;
+
 /// \def WITH_PROCESSES
 /// If uncommented enables support for processes as well as threads.
 /// This enables the dynamic loader to load elf programs, the extended system
@@ -151,6 +217,42 @@ const unsigned char MAX_OPEN_FILES=8;
  */
 #define JTAG_DISABLE_SLEEP
 
+/**
+ * \def WITH_TICKLESS_IDLE
+ * If uncommented, when the idle thread runs the tick interrupt is stretched
+ * up to the wakeup time of the first sleeping thread, so that an idle board
+ * does not take TICK_FREQ interrupts per second. As soon as a thread becomes
+ * ready the periodic tick is restored. Note that getTick() called from an
+ * interrupt routine while the idle thread is running may return a stale value.
+ * Currently only supported by the priority scheduler on Cortex-M4 STM32F4.
+ * By default it is not defined (tick is always periodic).
+ */
+//#define WITH_TICKLESS_IDLE
+
+#if defined(WITH_TICKLESS_IDLE) && !defined(SCHED_TYPE_PRIORITY)
+#error Tickless idle is only supported by the priority scheduler
+#endif //defined(WITH_TICKLESS_IDLE) && !defined(SCHED_TYPE_PRIORITY)
+
+#if defined(WITH_TICKLESS_IDLE) && !defined(_ARCH_CORTEXM4_STM32F4)
+#error Tickless idle is only supported on STM32F4
+#endif //WITH_TICKLESS_IDLE on unsupported architecture
+
+/**
+ * \def WITH_HIGH_RESOLUTION_TIMER
+ * If uncommented, a 32 bit hardware timer is used as a free running counter
+ * to provide sleeps with sub-tick resolution through the HighResolutionTimer
+ * class, and nanosleep() no longer busy waits for the fraction of its argument
+ * that is shorter than a tick. Currently only supported on STM32F2/F4, and
+ * uses TIM2, which is then no longer available to the application.
+ * By default it is not defined (sleep resolution is the kernel tick).
+ */
+//#define WITH_HIGH_RESOLUTION_TIMER
+
+#if defined(WITH_HIGH_RESOLUTION_TIMER) \
+    && !defined(_ARCH_CORTEXM3_STM32F2) && !defined(_ARCH_CORTEXM4_STM32F4)
+#error High resolution timer is only supported on STM32F2/F4
+#endif //WITH_HIGH_RESOLUTION_TIMER on unsupported architecture
+
 /// Minimum stack size (MUST be divisible by 4)
 const unsigned int STACK_MIN=256;
 
@@ -177,12 +279,36 @@ const unsigned int MIN_PROCESS_STACK_SIZE=STACK_MIN;
 /// thread is running in kernelspace (MUST be divisible by 4)
 const unsigned int SYSTEM_MODE_PROCESS_STACK_SIZE=2*1024;
 
+/**
+ * \def WITH_THREAD_POOL
+ * If uncommented, the memory of threads (stack, watermark and Thread object)
+ * is allocated from pools of fixed size blocks instead of the heap. The pools
+ * are allocated once at boot, and a thread gets a block of the smallest class
+ * whose stack size is at least the requested one, so creating and deleting
+ * threads takes constant time and does not fragment the heap. If the class is
+ * exhausted or the stack is larger than the largest class, the heap is used.
+ * By default it is not defined (thread memory is allocated from the heap).
+ */
+//#define WITH_THREAD_POOL
+
+#ifdef WITH_THREAD_POOL
+/// Number of thread pool classes
+const unsigned int THREAD_POOL_CLASSES=3;
+
+/// Stack size of each thread pool class, in ascending order. Each value MUST
+/// be divisible by 4 and >=STACK_MIN
+constexpr unsigned int THREAD_POOL_STACK_SIZES[THREAD_POOL_CLASSES]={512,1024,2048};
+
+/// Number of threads of each thread pool class
+constexpr unsigned int THREAD_POOL_BLOCKS[THREAD_POOL_CLASSES]={4,4,2};
+#endif //WITH_THREAD_POOL
+
 /// Number of priorities (MUST be >1)
 /// PRIORITY_MAX-1 is the highest priority, 0 is the lowest. -1 is reserved as
 /// the priority of the idle thread.
 /// The meaning of a thread's priority depends on the chosen scheduler.
 #ifdef SCHED_TYPE_PRIORITY
-//Can be modified, but a high value makes context switches more expensive
+//Can be modified up to 32, context switch time does not depend on it
 const short int PRIORITY_MAX=4;
 #elif defined(SCHED_TYPE_CONTROL_BASED)
 //Don't touch, the limit is due to the fixed point implementation
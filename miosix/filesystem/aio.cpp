@@ -0,0 +1,274 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "aio.h"
+#include <errno.h>
+#include <stdexcept>
+#include "file_access.h"
+#include "kernel/sync.h"
+#include "e20/e20.h"
+#include "config/miosix_settings.h"
+
+using namespace std;
+
+namespace miosix {
+
+#ifdef WITH_FILESYSTEM
+
+/**
+ * \internal
+ * The submission queue of asynchronous I/O requests, and the thread that
+ * serves them
+ */
+class AioQueue
+{
+public:
+    /**
+     * \return the instance of the queue (singleton)
+     */
+    static AioQueue& instance();
+
+    /**
+     * Queue a request, starting the I/O thread if needed
+     * \param file file the request refers to
+     * \param req request
+     * \return 0 on success, or a negative number on failure
+     */
+    int submit(intrusive_ref_ptr<FileBase> file, AioRequest *req);
+
+    /**
+     * Block until a request has completed
+     * \param req request
+     */
+    void wait(AioRequest *req);
+
+private:
+    AioQueue() : head(0), tail(0), thread(0) {}
+    AioQueue(const AioQueue&);
+    AioQueue& operator= (const AioQueue&);
+
+    /**
+     * Entry point of the I/O thread
+     */
+    static void *threadLauncher(void *argv);
+
+    /**
+     * Serve requests, never returns
+     */
+    void run();
+
+    /**
+     * Perform a request
+     * \param req request
+     * \return the number of bytes read or written, or a negative number in
+     * case of errors
+     */
+    static ssize_t perform(AioRequest *req);
+
+    /**
+     * Call the callback of a request, then complete it
+     * \param callback copy of the request callback
+     * \param req request
+     */
+    void deliver(function<void (AioRequest*)> callback, AioRequest *req);
+
+    /**
+     * Complete a request whose callback has been delivered
+     * \param req request
+     */
+    void complete(AioRequest *req);
+
+    FastMutex mutex;
+    ConditionVariable submitted; ///< Signaled when a request is queued
+    ConditionVariable completed; ///< Signaled when a request completes
+    AioRequest *head;            ///< Oldest request in the queue
+    AioRequest *tail;            ///< Newest request in the queue
+    Thread *thread;              ///< I/O thread, created at first submit
+};
+
+AioQueue& AioQueue::instance()
+{
+    static AioQueue singleton;
+    return singleton;
+}
+
+int AioQueue::submit(intrusive_ref_ptr<FileBase> file, AioRequest *req)
+{
+    Lock<FastMutex> l(mutex);
+    if(req->state==AioRequest::PENDING || req->state==AioRequest::CALLBACK)
+        return -EBUSY;
+    if(thread==0)
+    {
+        thread=Thread::create(threadLauncher,ASYNC_IO_STACK_SIZE,Priority(),
+                              this);
+        if(thread==0) return -ENOMEM;
+    }
+    req->file=file;
+    req->next=0;
+    req->res=0;
+    req->state=AioRequest::PENDING;
+    if(tail) tail->next=req; else head=req;
+    tail=req;
+    submitted.signal();
+    return 0;
+}
+
+void AioQueue::wait(AioRequest *req)
+{
+    Lock<FastMutex> l(mutex);
+    while(req->state==AioRequest::PENDING || req->state==AioRequest::CALLBACK)
+        completed.wait(l);
+}
+
+void *AioQueue::threadLauncher(void *argv)
+{
+    reinterpret_cast<AioQueue*>(argv)->run();
+    return 0;
+}
+
+void AioQueue::run()
+{
+    for(;;)
+    {
+        AioRequest *req;
+        {
+            Lock<FastMutex> l(mutex);
+            while(head==0) submitted.wait(l);
+            req=head;
+            head=head->next;
+            if(head==0) tail=0;
+        }
+        ssize_t result=perform(req);
+        req->file.reset(); //Let the file be closed
+        //The request can't complete before the callback has been called, as
+        //the caller may delete it as soon as it is done
+        function<void (AioRequest*)> callback;
+        #ifndef __NO_EXCEPTIONS
+        try {
+        #endif //__NO_EXCEPTIONS
+            callback=req->callback;
+        #ifndef __NO_EXCEPTIONS
+        } catch(exception&) {}
+        #endif //__NO_EXCEPTIONS
+        {
+            Lock<FastMutex> l(mutex);
+            req->res=result;
+            if(callback) req->state=AioRequest::CALLBACK;
+            else {
+                req->state=AioRequest::DONE;
+                completed.broadcast();
+            }
+        }
+        if(!callback) continue;
+        #ifndef __NO_EXCEPTIONS
+        if(req->queue==0)
+        {
+            try {
+                deliver(callback,req);
+            } catch(exception&) {}
+            continue;
+        }
+        try {
+            req->queue->post(bind(&AioQueue::deliver,this,callback,req));
+        } catch(exception&) {
+            complete(req); //Out of memory, the callback is lost
+        }
+        #else //__NO_EXCEPTIONS
+        if(req->queue==0) deliver(callback,req);
+        else req->queue->post(bind(&AioQueue::deliver,this,callback,req));
+        #endif //__NO_EXCEPTIONS
+    }
+}
+
+void AioQueue::deliver(function<void (AioRequest*)> callback, AioRequest *req)
+{
+    //Exceptions thrown by the callback are propagated, as they may be used to
+    //stop the thread running the EventQueue, but the request completes anyway
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        callback(req);
+    #ifndef __NO_EXCEPTIONS
+    } catch(...) {
+        complete(req);
+        throw;
+    }
+    #endif //__NO_EXCEPTIONS
+    complete(req);
+}
+
+void AioQueue::complete(AioRequest *req)
+{
+    Lock<FastMutex> l(mutex);
+    req->state=AioRequest::DONE;
+    completed.broadcast();
+}
+
+ssize_t AioQueue::perform(AioRequest *req)
+{
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        if(req->op==AioRequest::READ)
+        {
+            if(req->pos<0) return req->file->read(req->data,req->len);
+            return req->file->pread(req->data,req->len,req->pos);
+        } else {
+            if(req->pos<0) return req->file->write(req->data,req->len);
+            return req->file->pwrite(req->data,req->len,req->pos);
+        }
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception&) {
+        return -ENOMEM;
+    }
+    #endif //__NO_EXCEPTIONS
+}
+
+//
+// class AioRequest
+//
+
+ssize_t AioRequest::wait()
+{
+    AioQueue::instance().wait(this);
+    return res;
+}
+
+int aioSubmit(int fd, AioRequest *req)
+{
+    if(req==0 || req->data==0) return -EFAULT;
+    //Important, since len is unsigned, but the result has to be signed
+    if(static_cast<ssize_t>(req->len)<0) return -EINVAL;
+    if(req->op!=AioRequest::READ && req->op!=AioRequest::WRITE) return -EINVAL;
+    intrusive_ref_ptr<FileBase> file=getFileDescriptorTable().getFile(fd);
+    if(!file) return -EBADF;
+    return AioQueue::instance().submit(file,req);
+}
+
+#endif //WITH_FILESYSTEM
+
+} //namespace miosix
@@ -0,0 +1,138 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef AIO_H
+#define AIO_H
+
+#include <functional>
+#include <sys/types.h>
+#include "file.h"
+#include "kernel/intrusive.h"
+#include "config/miosix_settings.h"
+
+namespace miosix {
+
+#ifdef WITH_FILESYSTEM
+
+class EventQueue; //Forward decl
+
+/**
+ * An asynchronous read or write request, to be submitted with aioSubmit().
+ * The caller owns the request, which must not be modified, deleted or
+ * submitted again until it completes. If it has a callback, the request
+ * completes only after the callback has returned, so the callback itself can
+ * use it but can't submit it again.
+ */
+class AioRequest
+{
+public:
+    /// Kind of operation
+    enum Operation
+    {
+        READ,  ///< Read len bytes into data
+        WRITE  ///< Write len bytes from data
+    };
+
+    /**
+     * Constructor
+     */
+    AioRequest() : op(READ), data(0), len(0), pos(-1), queue(0), next(0),
+            res(0), state(IDLE) {}
+
+    /**
+     * \return true if the request has completed. Also true for requests that
+     * have never been submitted
+     */
+    bool done() const { return state==IDLE || state==DONE; }
+
+    /**
+     * Block until the request has completed. If the callback is posted to an
+     * EventQueue, must not be called by the thread running it, as the request
+     * completes only after the callback is called
+     * \return the result of the request, see result()
+     */
+    ssize_t wait();
+
+    /**
+     * \return the number of bytes read or written, or a negative number in
+     * case of errors. Only meaningful once the request has completed
+     */
+    ssize_t result() const { return res; }
+
+    Operation op; ///< Operation to perform
+    void *data;   ///< Buffer to read into or write from
+    size_t len;   ///< Number of bytes to read or write
+    /// Offset from the beginning of the file, or -1 to use the file pointer,
+    /// that is then advanced as with read() and write()
+    off_t pos;
+    /// If set, called once the operation is done with a pointer to the
+    /// request, whose result() is already available
+    std::function<void (AioRequest*)> callback;
+    /// If not null, the callback is posted to this queue and called by the
+    /// thread running it, otherwise it is called by the I/O thread, and in
+    /// that case it should be short and must not block
+    EventQueue *queue;
+
+private:
+    AioRequest(const AioRequest&);
+    AioRequest& operator= (const AioRequest&);
+
+    friend class AioQueue;
+
+    enum State
+    {
+        IDLE,
+        PENDING,
+        CALLBACK, ///< Operation done, callback not yet called
+        DONE
+    };
+
+    intrusive_ref_ptr<FileBase> file; ///< File the request refers to
+    AioRequest *next;                 ///< Link in the submission queue
+    ssize_t res;                      ///< Result of the operation
+    volatile State state;             ///< Request state
+};
+
+/**
+ * Submit an asynchronous read or write request. Requests are served in
+ * submission order by a kernel thread, so a thread can keep several requests
+ * in flight, and compute while the I/O thread is blocked on the transfer, for
+ * example while an SD card DMA write is in progress.
+ * The file is kept open until the request completes, even if the descriptor
+ * is closed in the meantime.
+ * \param fd file descriptor
+ * \param req request, must remain valid until completion
+ * \return 0 if the request was queued, or a negative number on failure, in
+ * which case the callback is not called
+ */
+int aioSubmit(int fd, AioRequest *req);
+
+#endif //WITH_FILESYSTEM
+
+} //namespace miosix
+
+#endif //AIO_H
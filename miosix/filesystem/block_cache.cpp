@@ -0,0 +1,194 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "block_cache.h"
+#include "filesystem/ioctl.h"
+#include <cstring>
+#include <errno.h>
+
+using namespace std;
+
+namespace miosix {
+
+//
+// class BlockCache
+//
+
+BlockCache::BlockCache(intrusive_ref_ptr<Device> dev, unsigned int numBlocks,
+        unsigned int blockSize) : Device(Device::BLOCK), dev(dev),
+        entries(new Entry[numBlocks]),
+        blocks(new unsigned char[numBlocks*blockSize]), head(0), tail(0),
+        numBlocks(numBlocks), blockSize(blockSize)
+{
+    for(unsigned int i=0;i<numBlocks;i++)
+    {
+        entries[i].prev= i==0 ? 0 : &entries[i-1];
+        entries[i].next= i==numBlocks-1 ? 0 : &entries[i+1];
+        entries[i].data=blocks+i*blockSize;
+        entries[i].valid=false;
+        entries[i].dirty=false;
+    }
+    head=&entries[0];
+    tail=&entries[numBlocks-1];
+}
+
+ssize_t BlockCache::readBlock(void *buffer, size_t size, off_t where)
+{
+    if(where % blockSize || size % blockSize) return -EFAULT;
+    unsigned int block=where/blockSize;
+    unsigned int count=size/blockSize;
+    Lock<FastMutex> l(mutex);
+    if(count!=1)
+    {
+        //The device has to return the latest data written
+        if(writeBackRange(block,count)==false) return -EIO;
+        return dev->readBlock(buffer,size,where);
+    }
+    Entry *e=lookup(block);
+    if(e==0)
+    {
+        if((e=replace())==0) return -EIO;
+        ssize_t result=dev->readBlock(e->data,blockSize,where);
+        if(result!=static_cast<ssize_t>(blockSize))
+            return result<0 ? result : -EIO;
+        e->block=block;
+        e->valid=true;
+    }
+    memcpy(buffer,e->data,blockSize);
+    return size;
+}
+
+ssize_t BlockCache::writeBlock(const void *buffer, size_t size, off_t where)
+{
+    if(where % blockSize || size % blockSize) return -EFAULT;
+    unsigned int block=where/blockSize;
+    unsigned int count=size/blockSize;
+    Lock<FastMutex> l(mutex);
+    if(count!=1)
+    {
+        //The cached blocks in the range are overwritten, drop them
+        for(unsigned int i=0;i<numBlocks;i++)
+        {
+            Entry *e=&entries[i];
+            if(e->valid && e->block>=block && e->block-block<count)
+                e->valid=e->dirty=false;
+        }
+        return dev->writeBlock(buffer,size,where);
+    }
+    Entry *e=lookup(block);
+    if(e==0)
+    {
+        //No need to read the block, it is fully overwritten
+        if((e=replace())==0) return -EIO;
+        e->block=block;
+        e->valid=true;
+    }
+    memcpy(e->data,buffer,blockSize);
+    e->dirty=true;
+    return size;
+}
+
+int BlockCache::ioctl(int cmd, void *arg)
+{
+    if(cmd==IOCTL_SYNC)
+    {
+        Lock<FastMutex> l(mutex);
+        if(writeBackRange(0,~0u)==false) return -EIO;
+    }
+    return dev->ioctl(cmd,arg);
+}
+
+BlockCache::~BlockCache()
+{
+    writeBackRange(0,~0u);
+    delete[] blocks;
+    delete[] entries;
+}
+
+BlockCache::Entry *BlockCache::lookup(unsigned int block)
+{
+    for(Entry *e=head;e!=0;e=e->next)
+    {
+        if(e->valid==false || e->block!=block) continue;
+        moveToFront(e);
+        return e;
+    }
+    return 0;
+}
+
+BlockCache::Entry *BlockCache::replace()
+{
+    //Prefer an invalid entry, else the least recently used one
+    Entry *e=tail;
+    for(Entry *walk=tail;walk!=0;walk=walk->prev)
+    {
+        if(walk->valid) continue;
+        e=walk;
+        break;
+    }
+    if(writeBack(e)==false) return 0;
+    e->valid=false;
+    moveToFront(e);
+    return e;
+}
+
+bool BlockCache::writeBack(Entry *e)
+{
+    if(e->valid==false || e->dirty==false) return true;
+    ssize_t result=dev->writeBlock(e->data,blockSize,
+            static_cast<off_t>(e->block)*blockSize);
+    if(result!=static_cast<ssize_t>(blockSize)) return false;
+    e->dirty=false;
+    return true;
+}
+
+bool BlockCache::writeBackRange(unsigned int first, unsigned int count)
+{
+    bool result=true;
+    for(unsigned int i=0;i<numBlocks;i++)
+    {
+        Entry *e=&entries[i];
+        if(e->valid && e->block>=first && e->block-first<count)
+            if(writeBack(e)==false) result=false;
+    }
+    return result;
+}
+
+void BlockCache::moveToFront(Entry *e)
+{
+    if(e==head) return;
+    //Unlink, e is not the head so e->prev is not NULL
+    e->prev->next=e->next;
+    if(e->next) e->next->prev=e->prev; else tail=e->prev;
+    //Link at the front
+    e->prev=0;
+    e->next=head;
+    head->prev=e;
+    head=e;
+}
+
+} //namespace miosix
@@ -0,0 +1,137 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include "filesystem/devfs/devfs.h"
+#include "kernel/sync.h"
+
+namespace miosix {
+
+/**
+ * A write-back block cache that can be wrapped around any block Device.
+ * It keeps the most recently used blocks in RAM and replaces the least
+ * recently used one when full. Writes only mark the cached block as dirty,
+ * and dirty blocks are written to the underlying device when they are
+ * replaced, when IOCTL_SYNC is received and when the cache is deleted.
+ * 
+ * The cache is meant to hold the blocks that filesystems access over and over,
+ * such as the FAT and directories, so only single block accesses go through
+ * the cache. Multiple block accesses, which are file data transfers, go
+ * straight to the underlying device after writing back or invalidating the
+ * cached blocks they overlap with, so they don't evict the FAT.
+ */
+class BlockCache : public Device
+{
+public:
+    /**
+     * Constructor
+     * \param dev block device to cache
+     * \param numBlocks number of blocks in the cache
+     * \param blockSize block size in bytes, reads and writes must be aligned
+     * to this size
+     */
+    BlockCache(intrusive_ref_ptr<Device> dev, unsigned int numBlocks,
+            unsigned int blockSize=512);
+    
+    virtual ssize_t readBlock(void *buffer, size_t size, off_t where);
+    
+    virtual ssize_t writeBlock(const void *buffer, size_t size, off_t where);
+    
+    virtual int ioctl(int cmd, void *arg);
+    
+    /**
+     * Destructor, writes back dirty blocks
+     */
+    virtual ~BlockCache();
+    
+private:
+    BlockCache(const BlockCache&);
+    BlockCache& operator= (const BlockCache&);
+    
+    /**
+     * A cached block
+     */
+    struct Entry
+    {
+        Entry *prev;         ///< Previous entry in the LRU list
+        Entry *next;         ///< Next entry in the LRU list
+        unsigned char *data; ///< Block data
+        unsigned int block;  ///< Block number
+        bool valid;          ///< True if data holds a block
+        bool dirty;          ///< True if data was not yet written to the device
+    };
+    
+    /**
+     * \param block block number
+     * \return the entry holding the block, or NULL if it is not cached. The
+     * entry is moved to the front of the LRU list
+     */
+    Entry *lookup(unsigned int block);
+    
+    /**
+     * Get the least recently used entry, writing it back if dirty, and move
+     * it to the front of the LRU list
+     * \return the entry, or NULL if writing it back failed
+     */
+    Entry *replace();
+    
+    /**
+     * Write back a dirty entry
+     * \param e entry
+     * \return true on success
+     */
+    bool writeBack(Entry *e);
+    
+    /**
+     * Write back all the dirty entries in a range of blocks
+     * \param first first block
+     * \param count number of blocks
+     * \return true on success
+     */
+    bool writeBackRange(unsigned int first, unsigned int count);
+    
+    /**
+     * Move an entry to the front of the LRU list
+     * \param e entry
+     */
+    void moveToFront(Entry *e);
+    
+    FastMutex mutex;
+    intrusive_ref_ptr<Device> dev; ///< Underlying device
+    Entry *entries;                ///< All the entries
+    unsigned char *blocks;         ///< Data of all the entries
+    Entry *head;                   ///< Most recently used entry
+    Entry *tail;                   ///< Least recently used entry
+    const unsigned int numBlocks;  ///< Number of blocks in the cache
+    const unsigned int blockSize;  ///< Block size in bytes
+};
+
+} //namespace miosix
+
+#endif //BLOCK_CACHE_H
@@ -82,6 +82,28 @@ public:
      */
     virtual ssize_t read(void *data, size_t len);
     
+    /**
+     * Read data from the device at the given offset, without moving the file
+     * pointer, if the device is seekable.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the device
+     * \return the number of read characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t pread(void *data, size_t len, off_t pos);
+    
+    /**
+     * Write data to the device at the given offset, without moving the file
+     * pointer, if the device is seekable.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param pos offset from the beginning of the device
+     * \return the number of written characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t pwrite(const void *data, size_t len, off_t pos);
+    
     /**
      * Move file pointer, if the file supports random-access.
      * \param pos offset to sum to the beginning of the file, current position
@@ -140,6 +162,22 @@ ssize_t DevFsFile::read(void *data, size_t len)
     return result;
 }
 
+ssize_t DevFsFile::pread(void *data, size_t len, off_t pos)
+{
+    if((flags & _FREAD)==0) return -EINVAL;
+    if(flags & _NOSEEK) return -ESPIPE;
+    if(pos+static_cast<off_t>(len)<0) len=numeric_limits<off_t>::max()-pos;
+    return dev->readBlock(data,len,pos);
+}
+
+ssize_t DevFsFile::pwrite(const void *data, size_t len, off_t pos)
+{
+    if((flags & _FWRITE)==0) return -EINVAL;
+    if(flags & _NOSEEK) return -ESPIPE;
+    if(pos+static_cast<off_t>(len)<0) len=numeric_limits<off_t>::max()-pos;
+    return dev->writeBlock(data,len,pos);
+}
+
 off_t DevFsFile::lseek(off_t pos, int whence)
 {
     if(flags & _NOSEEK) return -EBADF; //No seek support
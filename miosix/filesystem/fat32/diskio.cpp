@@ -49,11 +49,13 @@ DRESULT disk_read (
     intrusive_ref_ptr<FileBase> pdrv,		/* Physical drive nmuber (0..) */
 	BYTE *buff,		/* Data buffer to store read data */
 	DWORD sector,           /* Sector address (LBA) */
-	UINT count		/* Number of sectors to read (1..255) */
+	UINT count,		/* Number of sectors to read (1..255) */
+	UINT ssize		/* Sector size in bytes */
 )
 {
-    if(pdrv->lseek(static_cast<off_t>(sector)*512,SEEK_SET)<0) return RES_ERROR;
-    if(pdrv->read(buff,count*512)!=static_cast<ssize_t>(count)*512) return RES_ERROR;
+    off_t pos=static_cast<off_t>(sector)*ssize;
+    if(pdrv->pread(buff,count*ssize,pos)!=static_cast<ssize_t>(count*ssize))
+        return RES_ERROR;
     return RES_OK;
 }
 
@@ -65,11 +67,13 @@ DRESULT disk_write (
     intrusive_ref_ptr<FileBase> pdrv,		/* Physical drive nmuber (0..) */
 	const BYTE *buff,	/* Data to be written */
 	DWORD sector,		/* Sector address (LBA) */
-	UINT count		/* Number of sectors to write (1..255) */
+	UINT count,		/* Number of sectors to write (1..255) */
+	UINT ssize		/* Sector size in bytes */
 )
 {
-    if(pdrv->lseek(static_cast<off_t>(sector)*512,SEEK_SET)<0) return RES_ERROR;
-    if(pdrv->write(buff,count*512)!=static_cast<ssize_t>(count)*512) return RES_ERROR;
+    off_t pos=static_cast<off_t>(sector)*ssize;
+    if(pdrv->pwrite(buff,count*ssize,pos)!=static_cast<ssize_t>(count*ssize))
+        return RES_ERROR;
     return RES_OK;
 }
 
@@ -39,9 +39,9 @@ typedef enum {
 DSTATUS disk_initialize (miosix::intrusive_ref_ptr<miosix::FileBase> pdrv);
 DSTATUS disk_status (miosix::intrusive_ref_ptr<miosix::FileBase> pdrv);
 DRESULT disk_read (miosix::intrusive_ref_ptr<miosix::FileBase> pdrv,
-        BYTE*buff, DWORD sector, UINT count);
+        BYTE*buff, DWORD sector, UINT count, UINT ssize=512);
 DRESULT disk_write (miosix::intrusive_ref_ptr<miosix::FileBase> pdrv,
-        const BYTE* buff, DWORD sector, UINT count);
+        const BYTE* buff, DWORD sector, UINT count, UINT ssize=512);
 DRESULT disk_ioctl (miosix::intrusive_ref_ptr<miosix::FileBase> pdrv,
         BYTE cmd, void* buff);
 
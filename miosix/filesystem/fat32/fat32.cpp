@@ -35,6 +35,8 @@
 #include <cstring>
 #include <string>
 #include <cstdio>
+#include <algorithm>
+#include <new>
 #include "filesystem/stringpart.h"
 #include "filesystem/ioctl.h"
 #include "util/unicode.h"
@@ -179,8 +181,18 @@ Fat32Directory::~Fat32Directory()
     f_closedir(&dir);
 }
 
+//With _FS_TINY the file data goes through the win[] buffer of the volume,
+//which the per-file locking of Fat32File does not protect
+#if _FS_TINY
+#error Fat32File per-file locking requires _FS_TINY 0
+#endif //_FS_TINY
+
 /**
- * Files of the Fat32Fs filesystem
+ * Files of the Fat32Fs filesystem.
+ * Each file has its own mutex guarding its FIL object, so that reads and
+ * writes to different files proceed in parallel. The volume mutex is taken
+ * only when the FAT or the directory entry need to be accessed, always after
+ * the file mutex.
  */
 class Fat32File : public FileBase
 {
@@ -188,8 +200,9 @@ public:
     /**
      * Constructor
      * \param parent the filesystem to which this file belongs
+     * \param volumeMutex mutex to lock when accessing the FAT or directories
      */
-    Fat32File(intrusive_ref_ptr<FilesystemBase> parent, FastMutex& mutex);
+    Fat32File(intrusive_ref_ptr<FilesystemBase> parent, FastMutex& volumeMutex);
     
     /**
      * Write data to the file, if the file supports writing.
@@ -209,6 +222,49 @@ public:
      */
     virtual ssize_t read(void *data, size_t len);
     
+    /**
+     * Read data from the file into multiple buffers. The file is locked only
+     * once for all the buffers.
+     * \param iov array of buffers
+     * \param iovcnt number of buffers
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t readv(const struct iovec *iov, int iovcnt);
+    
+    /**
+     * Write data to the file from multiple buffers. The file is locked only
+     * once for all the buffers, and if SYNC_AFTER_WRITE is defined it is
+     * synced once at the end instead of once per buffer.
+     * \param iov array of buffers
+     * \param iovcnt number of buffers
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t writev(const struct iovec *iov, int iovcnt);
+    
+    /**
+     * Read data from the file at the given offset, without moving the file
+     * pointer. As with lseek, offsets past the end of file are not supported.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the file
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t pread(void *data, size_t len, off_t pos);
+    
+    /**
+     * Write data to the file at the given offset, without moving the file
+     * pointer. As with lseek, offsets past the end of file are not supported.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param pos offset from the beginning of the file
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t pwrite(const void *data, size_t len, off_t pos);
+    
     /**
      * Move file pointer, if the file supports random-access.
      * \param pos offset to sum to the beginning of the file, current position
@@ -227,7 +283,15 @@ public:
     virtual int fstat(struct stat *pstat) const;
     
     /**
-     * Perform various operations on a file descriptor
+     * Perform various operations on a file descriptor.
+     * In addition to IOCTL_SYNC, IOCTL_FAST_SEEK is supported, that enables
+     * FatFs fast seek for this file. The cluster link map is allocated and
+     * built at the next lseek, and allows to seek in constant time instead
+     * of following the cluster chain from the start of the file.
+     * IOCTL_PREALLOCATE takes a pointer to an off_t, and reserves a contiguous
+     * cluster run for that many bytes past the end of the file, without
+     * changing the file size, so that writes into it do not update the FAT.
+     * Space still unused is released when the file is closed
      * \param cmd specifies the operation to perform
      * \param arg optional argument that some operation require
      * \return the exact return value depends on CMD, -1 is returned on error
@@ -250,35 +314,176 @@ public:
     ~Fat32File();
     
 private:
+    /**
+     * Read data from the file, the caller must hold the file mutex
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    ssize_t readUnlocked(void *data, size_t len);
+    
+    /**
+     * Write data to the file without syncing it, the caller must hold the
+     * file mutex
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    ssize_t writeUnlocked(const void *data, size_t len);
+    
+    /**
+     * Seek the file to an offset not past the end of file, the caller must
+     * hold the file mutex
+     * \param offset offset from the beginning of the file
+     * \return 0 on success, or a negative number on failure
+     */
+    int seekUnlocked(off_t offset);
+    
+    /**
+     * Write data past the clusters in the link map, the caller must hold the
+     * file mutex. As FatFs can't stretch the chain of a file in fast seek
+     * mode, the data is written in normal mode one cluster at a time, and
+     * each new cluster is appended to the link map
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    ssize_t appendUnlocked(const void *data, size_t len);
+    
+    /**
+     * Build the cluster link map of the file, if fast seek is enabled and the
+     * map has not yet been built. On failure the file keeps using normal seek
+     */
+    void buildLinkMap();
+    
+    /**
+     * Add a cluster past the end of the chain to a link map
+     * \param map the link map, reallocated if it has to grow
+     * \param clust the cluster number
+     * \return false if there is not enough memory to grow the map
+     */
+    bool extendLinkMap(DWORD *& map, DWORD clust);
+    
+    /**
+     * Discard the cluster link map. It will be rebuilt at the next lseek
+     */
+    void dropLinkMap();
+    
+    /**
+     * \return the size in bytes of a cluster
+     */
+    DWORD clusterSize() const
+    {
+        #if _MAX_SS != 512
+        return file.fs->csize*file.fs->ssize;
+        #else //_MAX_SS != 512
+        return file.fs->csize*512;
+        #endif //_MAX_SS != 512
+    }
+    
     FIL file;
-    FastMutex& mutex;
+    FastMutex mutex;        ///< Guards file
+    FastMutex& volumeMutex; ///< Parent filesystem's mutex
     int inode;
+    DWORD reservedEnd;      ///< End of the space reserved by IOCTL_PREALLOCATE
+    DWORD mapSize;          ///< Number of items allocated for the link map
+    DWORD mappedClusters;   ///< Number of clusters in the link map
+    bool fastSeek;          ///< True if IOCTL_FAST_SEEK was requested
 };
 
 //
 // class Fat32File
 //
 
-Fat32File::Fat32File(intrusive_ref_ptr<FilesystemBase> parent, FastMutex& mutex)
-        : FileBase(parent), mutex(mutex), inode(0) {}
+Fat32File::Fat32File(intrusive_ref_ptr<FilesystemBase> parent,
+        FastMutex& volumeMutex) : FileBase(parent), volumeMutex(volumeMutex),
+        inode(0), reservedEnd(0), mapSize(0), mappedClusters(0),
+        fastSeek(false) {}
 
 ssize_t Fat32File::write(const void *data, size_t len)
 {
     Lock<FastMutex> l(mutex);
-    unsigned int bytesWritten;
-    if(int res=translateError(f_write(&file,data,len,&bytesWritten))) return res;
+    ssize_t result=writeUnlocked(data,len);
     #ifdef SYNC_AFTER_WRITE
+    if(result<0) return result;
+    Lock<FastMutex> l2(volumeMutex);
     if(f_sync(&file)!=FR_OK) return -EIO;
     #endif //SYNC_AFTER_WRITE    
-    return static_cast<int>(bytesWritten);
+    return result;
 }
 
 ssize_t Fat32File::read(void *data, size_t len)
 {
     Lock<FastMutex> l(mutex);
-    unsigned int bytesRead;
-    if(int res=translateError(f_read(&file,data,len,&bytesRead))) return res;
-    return static_cast<int>(bytesRead);
+    return readUnlocked(data,len);
+}
+
+ssize_t Fat32File::readv(const struct iovec *iov, int iovcnt)
+{
+    Lock<FastMutex> l(mutex);
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        ssize_t result=readUnlocked(iov[i].iov_base,iov[i].iov_len);
+        if(result<0) return total>0 ? total : result;
+        total+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break; //EOF
+    }
+    return total;
+}
+
+ssize_t Fat32File::writev(const struct iovec *iov, int iovcnt)
+{
+    Lock<FastMutex> l(mutex);
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        ssize_t result=writeUnlocked(iov[i].iov_base,iov[i].iov_len);
+        if(result<0)
+        {
+            if(total==0) return result;
+            break;
+        }
+        total+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break; //Disk full
+    }
+    #ifdef SYNC_AFTER_WRITE
+    Lock<FastMutex> l2(volumeMutex);
+    if(f_sync(&file)!=FR_OK) return -EIO;
+    #endif //SYNC_AFTER_WRITE
+    return total;
+}
+
+ssize_t Fat32File::pread(void *data, size_t len, off_t pos)
+{
+    if(pos<0) return -EINVAL;
+    Lock<FastMutex> l(mutex);
+    //Reading at or past EOF is not an error, it just reads nothing
+    if(pos>=static_cast<off_t>(f_size(&file))) return 0;
+    off_t prev=static_cast<off_t>(f_tell(&file));
+    if(int res=seekUnlocked(pos)) return res;
+    ssize_t result=readUnlocked(data,len);
+    if(int res=seekUnlocked(prev)) return res;
+    return result;
+}
+
+ssize_t Fat32File::pwrite(const void *data, size_t len, off_t pos)
+{
+    if(pos<0) return -EINVAL;
+    Lock<FastMutex> l(mutex);
+    off_t prev=static_cast<off_t>(f_tell(&file));
+    if(int res=seekUnlocked(pos)) return res;
+    ssize_t result=writeUnlocked(data,len);
+    if(int res=seekUnlocked(prev)) return res;
+    #ifdef SYNC_AFTER_WRITE
+    if(result<0) return result;
+    Lock<FastMutex> l2(volumeMutex);
+    if(f_sync(&file)!=FR_OK) return -EIO;
+    #endif //SYNC_AFTER_WRITE
+    return result;
 }
 
 off_t Fat32File::lseek(off_t pos, int whence)
@@ -299,10 +504,7 @@ off_t Fat32File::lseek(off_t pos, int whence)
         default:
             return -EINVAL;
     }
-    //We don't support seek past EOF for Fat32
-    if(offset<0 || offset>static_cast<off_t>(f_size(&file))) return -EOVERFLOW;
-    if(int result=translateError(
-        f_lseek(&file,static_cast<unsigned long>(offset)))) return result;
+    if(int result=seekUnlocked(offset)) return result;
     return offset;
 }
 
@@ -314,22 +516,175 @@ int Fat32File::fstat(struct stat *pstat) const
     pstat->st_mode=S_IFREG | 0755; //-rwxr-xr-x
     pstat->st_nlink=1;
     pstat->st_size=f_size(&file);
+    #if _MAX_SS != 512
+    pstat->st_blksize=file.fs->ssize; //Sector size of the volume
+    #else //_MAX_SS != 512
     pstat->st_blksize=512;
+    #endif //_MAX_SS != 512
     pstat->st_blocks=(static_cast<off_t>(f_size(&file))+511)/512;
     return 0;
 }
 
 int Fat32File::ioctl(int cmd, void *arg)
 {
-    if(cmd!=IOCTL_SYNC) return -ENOTTY;
     Lock<FastMutex> l(mutex);
-    return translateError(f_sync(&file));
+    switch(cmd)
+    {
+        case IOCTL_SYNC:
+        {
+            Lock<FastMutex> l2(volumeMutex);
+            return translateError(f_sync(&file));
+        }
+        case IOCTL_FAST_SEEK:
+            fastSeek=true;
+            return 0;
+        case IOCTL_PREALLOCATE:
+        {
+            off_t size=*reinterpret_cast<off_t*>(arg);
+            if(size<0) return -EINVAL;
+            Lock<FastMutex> l2(volumeMutex);
+            if(int res=translateError(f_expand(&file,size))) return res;
+            reservedEnd=f_size(&file)+size;
+            //The chain has grown, so the link map has to be rebuilt
+            dropLinkMap();
+            if(fastSeek) buildLinkMap();
+            return 0;
+        }
+        default:
+            return -ENOTTY;
+    }
 }
 
 Fat32File::~Fat32File()
 {
     Lock<FastMutex> l(mutex);
-    if(inode) f_close(&file); //TODO: what to do with error code?
+    Lock<FastMutex> l2(volumeMutex);
+    if(inode)
+    {
+        if(reservedEnd>f_size(&file))
+        {
+            //Release preallocated clusters that were not written
+            if(f_lseek(&file,f_size(&file))==FR_OK) f_truncate(&file);
+        }
+        f_close(&file); //TODO: what to do with error code?
+    }
+    delete[] file.cltbl;
+}
+
+ssize_t Fat32File::readUnlocked(void *data, size_t len)
+{
+    unsigned int bytesRead;
+    if(int res=translateError(f_read(&file,data,len,&bytesRead))) return res;
+    return static_cast<int>(bytesRead);
+}
+
+ssize_t Fat32File::writeUnlocked(const void *data, size_t len)
+{
+    if(file.cltbl && len>0 &&
+       (f_tell(&file)+len-1)/clusterSize()>=mappedClusters)
+        return appendUnlocked(data,len);
+    unsigned int bytesWritten;
+    //f_write() takes the volume mutex by itself when stretching the chain
+    if(int res=translateError(f_write(&file,data,len,&bytesWritten))) return res;
+    return static_cast<int>(bytesWritten);
+}
+
+ssize_t Fat32File::appendUnlocked(const void *data, size_t len)
+{
+    const unsigned char *src=reinterpret_cast<const unsigned char*>(data);
+    DWORD size=clusterSize();
+    DWORD *map=file.cltbl;
+    file.cltbl=0;
+    size_t written=0;
+    FRESULT res=FR_OK;
+    while(written<len)
+    {
+        DWORD pos=f_tell(&file);
+        unsigned int chunk=min<size_t>(len-written,size-pos%size);
+        unsigned int bytesWritten;
+        //f_write() takes the volume mutex by itself when stretching the chain
+        res=f_write(&file,src+written,chunk,&bytesWritten);
+        written+=bytesWritten;
+        //The cluster the write ended in is the current one
+        if(map && bytesWritten>0 && (pos+bytesWritten-1)/size>=mappedClusters
+           && extendLinkMap(map,file.clust)==false)
+        {
+            //Out of memory, the file falls back to normal seek
+            delete[] map;
+            map=0;
+        }
+        if(res!=FR_OK || bytesWritten<chunk) break;
+    }
+    file.cltbl=map;
+    if(int err=translateError(res)) return err;
+    return static_cast<int>(written);
+}
+
+int Fat32File::seekUnlocked(off_t offset)
+{
+    //We don't support seek past EOF for Fat32
+    if(offset<0 || offset>static_cast<off_t>(f_size(&file))) return -EOVERFLOW;
+    if(fastSeek && file.cltbl==0) buildLinkMap();
+    return translateError(f_lseek(&file,static_cast<unsigned long>(offset)));
+}
+
+void Fat32File::buildLinkMap()
+{
+    if(file.sclust==0) return; //No cluster chain to map yet
+    //First pass with a table that is too small, just to get the required size
+    DWORD probe[2]={2,0};
+    file.cltbl=probe;
+    FRESULT res=f_lseek(&file,CREATE_LINKMAP);
+    file.cltbl=0;
+    if(res!=FR_NOT_ENOUGH_CORE) return;
+    DWORD size=probe[0];
+    DWORD *map=new (nothrow) DWORD[size];
+    if(map==0) return; //Not enough memory, keep using normal seek
+    map[0]=size;
+    file.cltbl=map;
+    if(f_lseek(&file,CREATE_LINKMAP)!=FR_OK)
+    {
+        dropLinkMap();
+        return;
+    }
+    //The map is a list of cluster count, first cluster pairs, terminated by 0
+    mapSize=size;
+    mappedClusters=0;
+    for(DWORD i=1;map[i]!=0;i+=2) mappedClusters+=map[i];
+}
+
+bool Fat32File::extendLinkMap(DWORD *& map, DWORD clust)
+{
+    DWORD used=map[0];
+    //If the cluster follows the last fragment, just make it longer
+    if(used>2 && map[used-3]+map[used-2]==clust)
+    {
+        map[used-3]++;
+        mappedClusters++;
+        return true;
+    }
+    if(used+2>mapSize)
+    {
+        DWORD size=2*mapSize;
+        DWORD *newMap=new (nothrow) DWORD[size];
+        if(newMap==0) return false;
+        memcpy(newMap,map,used*sizeof(DWORD));
+        delete[] map;
+        map=newMap;
+        mapSize=size;
+    }
+    map[used-1]=1;
+    map[used]=clust;
+    map[used+1]=0;
+    map[0]=used+2;
+    mappedClusters++;
+    return true;
+}
+
+void Fat32File::dropLinkMap()
+{
+    delete[] file.cltbl;
+    file.cltbl=0;
 }
 
 //
@@ -340,6 +695,7 @@ Fat32Fs::Fat32Fs(intrusive_ref_ptr<FileBase> disk)
         : mutex(FastMutex::RECURSIVE), failed(true)
 {
     filesystem.drv=disk;
+    filesystem.mutex=&mutex;
     failed=f_mount(&filesystem,1,false)!=FR_OK;
 }
 
@@ -785,13 +785,13 @@ FRESULT sync_window (
 
 	if (fs->wflag) {	/* Write back the sector if it is dirty */
 		wsect = fs->winsect;	/* Current sector number */
-		if (disk_write(fs->drv, fs->win, wsect, 1))
+		if (disk_write(fs->drv, fs->win, wsect, 1, SS(fs)))
 			return FR_DISK_ERR;
 		fs->wflag = 0;
 		if (wsect - fs->fatbase < fs->fsize) {		/* Is it in the FAT area? */
 			for (nf = fs->n_fats; nf >= 2; nf--) {	/* Reflect the change to all FAT copies */
 				wsect += fs->fsize;
-				disk_write(fs->drv, fs->win, wsect, 1);
+				disk_write(fs->drv, fs->win, wsect, 1, SS(fs));
 			}
 		}
 	}
@@ -811,7 +811,7 @@ FRESULT move_window (
 		if (sync_window(fs) != FR_OK)
 			return FR_DISK_ERR;
 #endif
-		if (disk_read(fs->drv, fs->win, sector, 1))
+		if (disk_read(fs->drv, fs->win, sector, 1, SS(fs)))
 			return FR_DISK_ERR;
 		fs->winsect = sector;
 	}
@@ -847,7 +847,7 @@ FRESULT sync_fs (	/* FR_OK: successful, FR_DISK_ERR: failed */
 			ST_DWORD(fs->win+FSI_Nxt_Free, fs->last_clust);
 			/* Write it into the FSINFO sector */
 			fs->winsect = fs->volbase + 1;
-			disk_write(fs->drv, fs->win, fs->winsect, 1);
+			disk_write(fs->drv, fs->win, fs->winsect, 1, SS(fs));
 			fs->fsi_flag = 0;
 		}
 		/* Make sure that no pending write process in the physical drive */
@@ -1099,6 +1099,38 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 
 
 
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Access the FAT on behalf of a file object              */
+/*-----------------------------------------------------------------------*/
+/* Miosix: f_read(), f_write() and f_lseek() are called holding only the  */
+/* lock of the file object, so they take the volume lock when they follow */
+/* or stretch the cluster chain, as the FAT is accessed through win[]     */
+
+static
+DWORD get_fat_locked (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD clst		/* Cluster# to get the link information */
+)
+{
+	miosix::Lock<miosix::FastMutex> l(*fp->fs->mutex);
+	return get_fat(fp->fs, clst);
+}
+
+#if !_FS_READONLY
+static
+DWORD create_chain_locked (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD clst		/* Cluster# to stretch. 0 means create a new chain. */
+)
+{
+	miosix::Lock<miosix::FastMutex> l(*fp->fs->mutex);
+	return create_chain(fp->fs, clst);
+}
+#endif /* !_FS_READONLY */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* FAT handling - Convert offset into cluster with link map table        */
 /*-----------------------------------------------------------------------*/
@@ -2179,6 +2211,9 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 	DSTATUS stat;
 	DWORD bsect, fasize, tsect, sysect, nclst, szbfat;
 	WORD nrsv;
+#if _MAX_SS != 512
+	WORD ss;
+#endif
 	//FATFS *fs;
 
 
@@ -2214,8 +2249,10 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 	if (!_FS_READONLY && wmode && (stat & STA_PROTECT))	/* Check disk write protection if needed */
 		return FR_WRITE_PROTECTED;
 #if _MAX_SS != 512						/* Get sector size (variable sector size cfg only) */
-	if (disk_ioctl(fs->drv, GET_SECTOR_SIZE, &fs->ssize) != RES_OK)
-		return FR_DISK_ERR;
+	//Block devices are byte addressed, so the sector size is the one
+	//the volume was formatted with. Boot records are read in 512 byte units,
+	//then the sector size is taken from the BPB
+	fs->ssize = 512;
 #endif
 	/* Find an FAT partition on the drive. Supports only generic partitioning, FDISK and SFD. */
 	bsect = 0;
@@ -2240,6 +2277,15 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 
 	/* An FAT volume is found. Following code initializes the file system object */
 
+#if _MAX_SS != 512
+	ss = LD_WORD(fs->win+BPB_BytsPerSec);
+	if (ss < 512 || ss > _MAX_SS || (ss & (ss - 1)) || bsect % (ss / 512))
+		return FR_NO_FILESYSTEM;	/* (Unsupported sector size or misaligned partition) */
+	fs->ssize = ss;
+	bsect /= ss / 512;				/* Partition offset in sectors of the volume */
+	fs->winsect = 0xFFFFFFFF;		/* Only 512 bytes of the boot sector were read */
+#endif
+
 	if (LD_WORD(fs->win+BPB_BytsPerSec) != SS(fs))		/* (BPB_BytsPerSec must be equal to the physical sector size) */
 		return FR_NO_FILESYSTEM;
 
@@ -2590,7 +2636,7 @@ FRESULT f_read (
 						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
 					else
 #endif
-						clst = get_fat(fp->fs, fp->clust);	/* Follow cluster chain on the FAT */
+						clst = get_fat_locked(fp, fp->clust);	/* Follow cluster chain on the FAT */
 				}
 				if (clst < 2) ABORT(fp->fs, FR_INT_ERR);
 				if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
@@ -2603,7 +2649,7 @@ FRESULT f_read (
 			if (cc) {							/* Read maximum contiguous sectors directly */
 				if (csect + cc > fp->fs->csize)	/* Clip at cluster boundary */
 					cc = fp->fs->csize - csect;
-				if (disk_read(fp->fs->drv, rbuff, sect, cc))
+				if (disk_read(fp->fs->drv, rbuff, sect, cc, SS(fp->fs)))
 					ABORT(fp->fs, FR_DISK_ERR);
 #if !_FS_READONLY && _FS_MINIMIZE <= 2			/* Replace one of the read sectors with cached data if it contains a dirty sector */
 #if _FS_TINY
@@ -2621,12 +2667,12 @@ FRESULT f_read (
 			if (fp->dsect != sect) {			/* Load data sector if not in cache */
 #if !_FS_READONLY
 				if (fp->flag & FA__DIRTY) {		/* Write-back dirty sector cache */
-					if (disk_write(fp->fs->drv, fp->buf, fp->dsect, 1))
+					if (disk_write(fp->fs->drv, fp->buf, fp->dsect, 1, SS(fp->fs)))
 						ABORT(fp->fs, FR_DISK_ERR);
 					fp->flag &= ~FA__DIRTY;
 				}
 #endif
-				if (disk_read(fp->fs->drv, fp->buf, sect, 1))	/* Fill sector cache */
+				if (disk_read(fp->fs->drv, fp->buf, sect, 1, SS(fp->fs)))	/* Fill sector cache */
 					ABORT(fp->fs, FR_DISK_ERR);
 			}
 #endif
@@ -2686,14 +2732,14 @@ FRESULT f_write (
 				if (fp->fptr == 0) {		/* On the top of the file? */
 					clst = fp->sclust;		/* Follow from the origin */
 					if (clst == 0)			/* When no cluster is allocated, */
-						fp->sclust = clst = create_chain(fp->fs, 0);	/* Create a new cluster chain */
+						fp->sclust = clst = create_chain_locked(fp, 0);	/* Create a new cluster chain */
 				} else {					/* Middle or end of the file */
 #if _USE_FASTSEEK
 					if (fp->cltbl)
 						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
 					else
 #endif
-						clst = create_chain(fp->fs, fp->clust);	/* Follow or stretch cluster chain on the FAT */
+						clst = create_chain_locked(fp, fp->clust);	/* Follow or stretch cluster chain on the FAT */
 				}
 				if (clst == 0) break;		/* Could not allocate a new cluster (disk full) */
 				if (clst == 1) ABORT(fp->fs, FR_INT_ERR);
@@ -2705,7 +2751,7 @@ FRESULT f_write (
 				ABORT(fp->fs, FR_DISK_ERR);
 #else
 			if (fp->flag & FA__DIRTY) {		/* Write-back sector cache */
-				if (disk_write(fp->fs->drv, fp->buf, fp->dsect, 1))
+				if (disk_write(fp->fs->drv, fp->buf, fp->dsect, 1, SS(fp->fs)))
 					ABORT(fp->fs, FR_DISK_ERR);
 				fp->flag &= ~FA__DIRTY;
 			}
@@ -2717,7 +2763,7 @@ FRESULT f_write (
 			if (cc) {						/* Write maximum contiguous sectors directly */
 				if (csect + cc > fp->fs->csize)	/* Clip at cluster boundary */
 					cc = fp->fs->csize - csect;
-				if (disk_write(fp->fs->drv, wbuff, sect, cc))
+				if (disk_write(fp->fs->drv, wbuff, sect, cc, SS(fp->fs)))
 					ABORT(fp->fs, FR_DISK_ERR);
 #if _FS_MINIMIZE <= 2
 #if _FS_TINY
@@ -2743,7 +2789,7 @@ FRESULT f_write (
 #else
 			if (fp->dsect != sect) {		/* Fill sector cache with file data */
 				if (fp->fptr < fp->fsize &&
-					disk_read(fp->fs->drv, fp->buf, sect, 1))
+					disk_read(fp->fs->drv, fp->buf, sect, 1, SS(fp->fs)))
 						ABORT(fp->fs, FR_DISK_ERR);
 			}
 #endif
@@ -2790,7 +2836,7 @@ FRESULT f_sync (
 			/* Write-back dirty buffer */
 #if !_FS_TINY
 			if (fp->flag & FA__DIRTY) {
-				if (disk_write(fp->fs->drv, fp->buf, fp->dsect, 1))
+				if (disk_write(fp->fs->drv, fp->buf, fp->dsect, 1, SS(fp->fs)))
 					LEAVE_FF(fp->fs, FR_DISK_ERR);
 				fp->flag &= ~FA__DIRTY;
 			}
@@ -3034,7 +3080,7 @@ FRESULT f_lseek (
 					tcl = cl; ncl = 0; ulen += 2;	/* Top, length and used items */
 					do {
 						pcl = cl; ncl++;
-						cl = get_fat(fp->fs, cl);
+						cl = get_fat_locked(fp, cl);
 						if (cl <= 1) ABORT(fp->fs, FR_INT_ERR);
 						if (cl == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
 					} while (cl == pcl + 1);
@@ -3062,12 +3108,12 @@ FRESULT f_lseek (
 #if !_FS_TINY
 #if !_FS_READONLY
 					if (fp->flag & FA__DIRTY) {		/* Write-back dirty sector cache */
-						if (disk_write(fp->fs->drv, fp->buf, fp->dsect, 1))
+						if (disk_write(fp->fs->drv, fp->buf, fp->dsect, 1, SS(fp->fs)))
 							ABORT(fp->fs, FR_DISK_ERR);
 						fp->flag &= ~FA__DIRTY;
 					}
 #endif
-					if (disk_read(fp->fs->drv, fp->buf, dsc, 1))	/* Load current sector */
+					if (disk_read(fp->fs->drv, fp->buf, dsc, 1, SS(fp->fs)))	/* Load current sector */
 						ABORT(fp->fs, FR_DISK_ERR);
 #endif
 					fp->dsect = dsc;
@@ -3100,7 +3146,7 @@ FRESULT f_lseek (
 				clst = fp->sclust;						/* start from the first cluster */
 #if !_FS_READONLY
 				if (clst == 0) {						/* If no cluster chain, create a new chain */
-					clst = create_chain(fp->fs, 0);
+					clst = create_chain_locked(fp, 0);
 					if (clst == 1) ABORT(fp->fs, FR_INT_ERR);
 					if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
 					fp->sclust = clst;
@@ -3112,13 +3158,13 @@ FRESULT f_lseek (
 				while (ofs > bcs) {						/* Cluster following loop */
 #if !_FS_READONLY
 					if (fp->flag & FA_WRITE) {			/* Check if in write mode or not */
-						clst = create_chain(fp->fs, clst);	/* Force stretch if in write mode */
+						clst = create_chain_locked(fp, clst);	/* Force stretch if in write mode */
 						if (clst == 0) {				/* When disk gets full, clip file size */
 							ofs = bcs; break;
 						}
 					} else
 #endif
-						clst = get_fat(fp->fs, clst);	/* Follow cluster chain if not in write mode */
+						clst = get_fat_locked(fp, clst);	/* Follow cluster chain if not in write mode */
 					if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
 					if (clst <= 1 || clst >= fp->fs->n_fatent) ABORT(fp->fs, FR_INT_ERR);
 					fp->clust = clst;
@@ -3137,12 +3183,12 @@ FRESULT f_lseek (
 #if !_FS_TINY
 #if !_FS_READONLY
 			if (fp->flag & FA__DIRTY) {			/* Write-back dirty sector cache */
-				if (disk_write(fp->fs->drv, fp->buf, fp->dsect, 1))
+				if (disk_write(fp->fs->drv, fp->buf, fp->dsect, 1, SS(fp->fs)))
 					ABORT(fp->fs, FR_DISK_ERR);
 				fp->flag &= ~FA__DIRTY;
 			}
 #endif
-			if (disk_read(fp->fs->drv, fp->buf, nsect, 1))	/* Fill sector cache */
+			if (disk_read(fp->fs->drv, fp->buf, nsect, 1, SS(fp->fs)))	/* Fill sector cache */
 				ABORT(fp->fs, FR_DISK_ERR);
 #endif
 			fp->dsect = nsect;
@@ -3415,7 +3461,8 @@ FRESULT f_truncate (
 		}
 	}
 	if (res == FR_OK) {
-		if (fp->fsize > fp->fptr) {
+		/* Miosix: also when fsize == fptr, to release clusters preallocated past the end of file by f_expand() */
+		if (fp->fsize >= fp->fptr && fp->sclust) {
 			fp->fsize = fp->fptr;	/* Set file size to current R/W point */
 			fp->flag |= FA__WRITTEN;
 			if (fp->fptr == 0) {	/* When set file size to zero, remove entire cluster chain */
@@ -3433,7 +3480,7 @@ FRESULT f_truncate (
 			}
 #if !_FS_TINY
 			if (res == FR_OK && (fp->flag & FA__DIRTY)) {
-				if (disk_write(fp->fs->drv, fp->buf, fp->dsect, 1))
+				if (disk_write(fp->fs->drv, fp->buf, fp->dsect, 1, SS(fp->fs)))
 					res = FR_DISK_ERR;
 				else
 					fp->flag &= ~FA__DIRTY;
@@ -3449,6 +3496,83 @@ FRESULT f_truncate (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Miosix: Preallocate a contiguous cluster run past the end of a file   */
+/*-----------------------------------------------------------------------*/
+/* The file size is not changed, clusters not used by the time the file   */
+/* is closed can be released with f_lseek() to the file size followed by  */
+/* f_truncate(). Writes to the preallocated space only read the FAT.      */
+
+FRESULT f_expand (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD fsz		/* Number of bytes to preallocate past the end of file */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD bcs, lcl, ncl, need, have, stcl, scl, clst, v;
+
+
+	res = validate(fp);						/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (fp->err)							/* Check error */
+		LEAVE_FF(fp->fs, (FRESULT)fp->err);
+	if (!(fp->flag & FA_WRITE))				/* Check access mode */
+		LEAVE_FF(fp->fs, FR_DENIED);
+	fs = fp->fs;
+	bcs = (DWORD)fs->csize * SS(fs);		/* Cluster size (byte) */
+	if (fp->fsize + fsz < fp->fsize)		/* File size cannot reach 4GB */
+		LEAVE_FF(fs, FR_DENIED);
+	need = (fp->fsize + fsz + bcs - 1) / bcs;	/* Clusters required in the chain */
+
+	lcl = 0; have = 0;						/* Find the last cluster of the chain */
+	for (clst = fp->sclust; clst >= 2 && clst < fs->n_fatent; clst = v) {
+		lcl = clst; have++;
+		v = get_fat(fs, clst);
+		if (v == 1) ABORT(fs, FR_INT_ERR);
+		if (v == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+	}
+	if (have >= need) LEAVE_FF(fs, FR_OK);	/* Already allocated (e.g: by a previous call) */
+	need -= have;
+
+	stcl = fs->last_clust;					/* Find a contiguous run of free clusters */
+	if (stcl < 2 || stcl >= fs->n_fatent) stcl = 2;
+	scl = clst = stcl; ncl = 0;
+	for (;;) {
+		v = get_fat(fs, clst);
+		if (v == 1) ABORT(fs, FR_INT_ERR);
+		if (v == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+		if (v == 0) {						/* Free cluster, extend the run */
+			if (++ncl == need) break;
+		} else {							/* Used cluster, restart the run after it */
+			scl = clst + 1; ncl = 0;
+		}
+		if (++clst >= fs->n_fatent) {		/* End of the FAT, a run cannot cross it */
+			if (stcl == 2) LEAVE_FF(fs, FR_DENIED);	/* Whole FAT scanned, no contiguous run large enough */
+			scl = clst = stcl = 2; ncl = 0;	/* Scan again from the start, also finds runs spanning the old start */
+		}
+	}
+
+	for (clst = scl; clst < scl + need && res == FR_OK; clst++)	/* Link the run */
+		res = put_fat(fs, clst, clst + 1 < scl + need ? clst + 1 : 0x0FFFFFFF);
+	if (res == FR_OK) {						/* Append it to the file */
+		if (lcl) res = put_fat(fs, lcl, scl);
+		else fp->sclust = scl;
+	}
+	if (res != FR_OK) ABORT(fs, res);
+	fs->last_clust = scl + need - 1;		/* Update FSINFO */
+	if (fs->free_clust != 0xFFFFFFFF) {
+		fs->free_clust -= need;
+		fs->fsi_flag |= 1;
+	}
+	fp->flag |= FA__WRITTEN;				/* The start cluster may have changed */
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Delete a File or Directory                                            */
 /*-----------------------------------------------------------------------*/
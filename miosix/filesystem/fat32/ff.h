@@ -36,6 +36,7 @@
 //#endif
 
 #include <filesystem/file.h>
+#include "kernel/sync.h"
 #include "config/miosix_settings.h"
 
 #include "integer.h"	/* Basic integer types */
@@ -144,6 +145,7 @@ struct FATFS {
     FILESEM	Files[_FS_LOCK];/* Open object lock semaphores */
 #endif
     miosix::intrusive_ref_ptr<miosix::FileBase> drv; /* drive device */
+    miosix::FastMutex *mutex; /* volume lock, guards win[], the FAT and Files[] */
 };
 
 
@@ -253,6 +255,7 @@ FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);	/* Write data t
 FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf);	/* Forward data to the stream */
 FRESULT f_lseek (FIL* fp, DWORD ofs);								/* Move file pointer of a file object */
 FRESULT f_truncate (FIL* fp);										/* Truncate file */
+FRESULT f_expand (FIL* fp, DWORD fsz);								/* Preallocate contiguous clusters past the end of file */
 FRESULT f_sync (FIL* fp);											/* Flush cached data of a writing file */
 FRESULT f_opendir (FATFS *fs, DIR_* dp, const /*TCHAR*/char *path);						/* Open a directory */
 FRESULT f_closedir (DIR_* dp);										/* Close an open directory */
@@ -18,6 +18,8 @@
 /* When _FS_TINY is set to 1, FatFs uses the sector buffer in the file system
 /  object instead of the sector buffer in the individual file object for file
 /  data transfer. This reduces memory consumption 512 bytes each file object. */
+/* Note: Miosix requires _FS_TINY 0, as Fat32File locks each file object with
+/  its own mutex, which does not protect the shared sector buffer. */
 
 
 #define _FS_READONLY	0	/* 0:Read/Write or 1:Read only */
@@ -44,7 +46,7 @@
 /* To enable f_mkfs() function, set _USE_MKFS to 1 and set _FS_READONLY to 0 */
 
 
-#define	_USE_FASTSEEK	0	/* 0:Disable or 1:Enable */
+#define	_USE_FASTSEEK	1	/* 0:Disable or 1:Enable */
 /* To enable fast seek feature, set _USE_FASTSEEK to 1. */
 
 
@@ -150,7 +152,10 @@
 / is tied to the partitions listed in VolToPart[]. */
 
 
-#define	_MAX_SS		512		/* 512, 1024, 2048 or 4096 */
+//Set through FAT32_MAX_SECTOR_SIZE in miosix_settings.h. With
+//sectors larger than 512 bytes, GET_SECTOR_SIZE is not used, the sector size
+//is taken from the BPB of the volume
+#define	_MAX_SS		FAT32_MAX_SECTOR_SIZE	/* 512, 1024, 2048 or 4096 */
 /* Maximum sector size to be handled.
 /  Always set 512 for memory card and hard disk but a larger value may be
 /  required for on-board flash memory, floppy disk and optical disk.
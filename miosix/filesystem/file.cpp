@@ -73,6 +73,44 @@ int FileBase::getdents(void *dp, int len)
     return -EBADF;
 }
 
+ssize_t FileBase::readv(const struct iovec *iov, int iovcnt)
+{
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        if(iov[i].iov_len==0) continue;
+        ssize_t result=read(iov[i].iov_base,iov[i].iov_len);
+        if(result<0) return total>0 ? total : result;
+        total+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break;
+    }
+    return total;
+}
+
+ssize_t FileBase::writev(const struct iovec *iov, int iovcnt)
+{
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        if(iov[i].iov_len==0) continue;
+        ssize_t result=write(iov[i].iov_base,iov[i].iov_len);
+        if(result<0) return total>0 ? total : result;
+        total+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break;
+    }
+    return total;
+}
+
+ssize_t FileBase::pread(void *data, size_t len, off_t pos)
+{
+    return -ESPIPE; //Means the file does not support random-access
+}
+
+ssize_t FileBase::pwrite(const void *data, size_t len, off_t pos)
+{
+    return -ESPIPE;
+}
+
 #endif //WITH_FILESYSTEM
 
 FileBase::~FileBase()
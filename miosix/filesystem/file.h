@@ -29,6 +29,7 @@
 #include <sys/stat.h>
 #include "kernel/intrusive.h"
 #include "config/miosix_settings.h"
+#include "uio.h"
 
 #ifndef FILE_H
 #define	FILE_H
@@ -124,6 +125,50 @@ public:
      */
     virtual int getdents(void *dp, int len);
     
+    /**
+     * Read data from the file into multiple buffers, in order, as if by a
+     * single read. The default implementation calls read() for each buffer
+     * and stops at the first short read.
+     * \param iov array of buffers
+     * \param iovcnt number of buffers
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t readv(const struct iovec *iov, int iovcnt);
+    
+    /**
+     * Write data to the file from multiple buffers, in order, as if by a
+     * single write. The default implementation calls write() for each buffer
+     * and stops at the first short write.
+     * \param iov array of buffers
+     * \param iovcnt number of buffers
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t writev(const struct iovec *iov, int iovcnt);
+    
+    /**
+     * Read data from the file at the given offset, without moving the file
+     * pointer, if the file supports random-access.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the file
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t pread(void *data, size_t len, off_t pos);
+    
+    /**
+     * Write data to the file at the given offset, without moving the file
+     * pointer, if the file supports random-access.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param pos offset from the beginning of the file
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t pwrite(const void *data, size_t len, off_t pos);
+    
     /**
      * \return a pointer to the parent filesystem
      */
@@ -32,6 +32,7 @@
 #include "console/console_device.h"
 #include "mountpointfs/mountpointfs.h"
 #include "fat32/fat32.h"
+#include "block_cache.h"
 #include "kernel/logging.h"
 #ifdef WITH_PROCESSES
 #include "kernel/process.h"
@@ -224,6 +225,21 @@ int FileDescriptorTable::statImpl(const char* name, struct stat* pstat, bool f)
     return FilesystemManager::instance().statHelper(path,pstat,f);
 }
 
+int FileDescriptorTable::checkIovec(const struct iovec *iov, int iovcnt)
+{
+    if(iovcnt<0 || iovcnt>IOV_MAX) return -EINVAL;
+    if(iov==0 && iovcnt>0) return -EFAULT;
+    //The total length has to fit in the signed return value
+    size_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        if(iov[i].iov_base==0 && iov[i].iov_len>0) return -EFAULT;
+        total+=iov[i].iov_len;
+        if(total<iov[i].iov_len || static_cast<ssize_t>(total)<0) return -EINVAL;
+    }
+    return 0;
+}
+
 FileDescriptorTable::~FileDescriptorTable()
 {
     FilesystemManager::instance().removeFileDescriptorTable(this);
@@ -495,6 +511,55 @@ int PathResolution::recursiveFindFs(string& path)
     return 0;
 }
 
+#ifdef WITH_PATH_CACHE
+
+//
+// class PathCache
+//
+
+bool PathCache::lookup(const string& dir, string& resolvedDir,
+        ResolvedPath& resolved, bool& mountpoints)
+{
+    Lock<FastMutex> l(mutex);
+    if(enabled==false) return false;
+    for(unsigned int i=0;i<PATH_CACHE_ENTRIES;i++)
+    {
+        if(entries[i].dir!=dir) continue;
+        resolvedDir=entries[i].resolvedDir;
+        resolved=entries[i].resolved;
+        mountpoints=entries[i].mountpoints;
+        return true;
+    }
+    return false;
+}
+
+void PathCache::insert(const string& dir, const string& resolvedDir,
+        const ResolvedPath& resolved, bool mountpoints)
+{
+    Lock<FastMutex> l(mutex);
+    if(enabled==false) return;
+    Entry& e=entries[next];
+    if(++next>=PATH_CACHE_ENTRIES) next=0;
+    e.dir=dir;
+    e.resolvedDir=resolvedDir;
+    e.resolved=resolved;
+    e.mountpoints=mountpoints;
+}
+
+void PathCache::invalidate(bool enable)
+{
+    Lock<FastMutex> l(mutex);
+    for(unsigned int i=0;i<PATH_CACHE_ENTRIES;i++)
+    {
+        //Also release the reference to the filesystem, that may be unmounted
+        entries[i].dir.clear();
+        entries[i].resolved=ResolvedPath();
+    }
+    enabled=enable;
+}
+
+#endif //WITH_PATH_CACHE
+
 //
 // class FilesystemManager
 //
@@ -508,23 +573,25 @@ FilesystemManager& FilesystemManager::instance()
 int FilesystemManager::kmount(const char* path, intrusive_ref_ptr<FilesystemBase> fs)
 {
     if(path==0 || path[0]=='\0' || fs==0) return -EFAULT;
-    Lock<FastMutex> l(mutex);
+    Lock<RWMutex> l(mutex);
     size_t len=strlen(path);
     if(len>PATH_MAX) return -ENAMETOOLONG;
     string temp(path);
     if(!(temp=="/" && filesystems.empty())) //Skip check when mounting /
     {
         struct stat st;
-        if(int result=statHelper(temp,&st,false)) return result;
+        if(int result=statImpl(temp,&st,false)) return result;
         if(!S_ISDIR(st.st_mode)) return -ENOTDIR;
         string parent=temp+"/..";
-        if(int result=statHelper(parent,&st,false)) return result;
+        if(int result=statImpl(parent,&st,false)) return result;
         fs->setParentFsMountpointInode(st.st_ino);
     }
     if(filesystems.insert(make_pair(StringPart(temp),fs)).second==false)
         return -EBUSY; //Means already mounted
-    else
-        return 0;
+    #ifdef WITH_PATH_CACHE
+    invalidatePathCache();
+    #endif //WITH_PATH_CACHE
+    return 0;
 }
 
 int FilesystemManager::umount(const char* path, bool force)
@@ -535,7 +602,7 @@ int FilesystemManager::umount(const char* path, bool force)
     if(path==0 || path[0]=='\0') return -ENOENT;
     size_t len=strlen(path);
     if(len>PATH_MAX) return -ENAMETOOLONG;
-    Lock<FastMutex> l(mutex); //A reader-writer lock would be better
+    Lock<RWMutex> l(mutex);
     fsIt it=filesystems.find(StringPart(path));
     if(it==filesystems.end()) return -EINVAL;
     
@@ -613,12 +680,15 @@ int FilesystemManager::umount(const char* path, bool force)
     //It is now safe to umount all filesystems
     for(it5=fsToUmount.begin();it5!=fsToUmount.end();++it5)
         filesystems.erase(*it5);
+    #ifdef WITH_PATH_CACHE
+    invalidatePathCache();
+    #endif //WITH_PATH_CACHE
     return 0;
 }
 
 void FilesystemManager::umountAll()
 {
-    Lock<FastMutex> l(mutex);
+    Lock<RWMutex> l(mutex);
     #ifdef WITH_PROCESSES
     list<FileDescriptorTable*>::iterator it;
     for(it=fileTables.begin();it!=fileTables.end();++it) (*it)->closeAll();
@@ -626,6 +696,9 @@ void FilesystemManager::umountAll()
     getFileDescriptorTable().closeAll();
     #endif //WITH_PROCESSES
     filesystems.clear();
+    #ifdef WITH_PATH_CACHE
+    invalidatePathCache();
+    #endif //WITH_PATH_CACHE
 }
 
 ResolvedPath FilesystemManager::resolvePath(string& path, bool followLastSymlink)
@@ -635,7 +708,20 @@ ResolvedPath FilesystemManager::resolvePath(string& path, bool followLastSymlink
     if(path.length()>PATH_MAX) return ResolvedPath(-ENAMETOOLONG);
     if(path.empty() || path[0]!='/') return ResolvedPath(-ENOENT);
 
-    Lock<FastMutex> l(mutex);
+    #ifdef WITH_PATH_CACHE
+    ResolvedPath resolved;
+    if(cachedResolvePath(path,resolved)) return resolved;
+    #endif //WITH_PATH_CACHE
+    SharedLock l(mutex);
+    PathResolution pr(filesystems);
+    return pr.resolvePath(path,followLastSymlink);
+}
+
+ResolvedPath FilesystemManager::resolvePathImpl(string& path,
+        bool followLastSymlink)
+{
+    if(path.length()>PATH_MAX) return ResolvedPath(-ENAMETOOLONG);
+    if(path.empty() || path[0]!='/') return ResolvedPath(-ENOENT);
     PathResolution pr(filesystems);
     return pr.resolvePath(path,followLastSymlink);
 }
@@ -644,8 +730,8 @@ int FilesystemManager::unlinkHelper(string& path)
 {
     //Do everything while keeping the mutex locked to prevent someone to
     //concurrently mount a filesystem on the directory we're unlinking
-    Lock<FastMutex> l(mutex);
-    ResolvedPath openData=resolvePath(path,true);
+    SharedLock l(mutex);
+    ResolvedPath openData=resolvePathImpl(path,true);
     if(openData.result<0) return openData.result;
     //After resolvePath() so path is in canonical form and symlinks are followed
     if(filesystems.find(StringPart(path))!=filesystems.end()) return -EBUSY;
@@ -661,14 +747,38 @@ int FilesystemManager::statHelper(string& path, struct stat *pstat, bool f)
     return openData.fs->lstat(sp,pstat);
 }
 
+int FilesystemManager::statImpl(string& path, struct stat *pstat, bool f)
+{
+    ResolvedPath openData=resolvePathImpl(path,f);
+    if(openData.result<0) return openData.result;
+    StringPart sp(path,string::npos,openData.off);
+    return openData.fs->lstat(sp,pstat);
+}
+
 int FilesystemManager::renameHelper(string& oldPath, string& newPath)
+{
+    int result=renameImpl(oldPath,newPath);
+    #ifdef WITH_PATH_CACHE
+    //Lookups that missed the cache insert their result with the mutex locked
+    //in shared mode, so once we get it in exclusive mode none of them can be
+    //still inserting a resolution predating the rename
+    if(result==0)
+    {
+        Lock<RWMutex> l(mutex);
+        invalidatePathCache();
+    }
+    #endif //WITH_PATH_CACHE
+    return result;
+}
+
+int FilesystemManager::renameImpl(string& oldPath, string& newPath)
 {
     //Do everything while keeping the mutex locked to prevent someone to
     //concurrently mount a filesystem on the directory we're renaming
-    Lock<FastMutex> l(mutex);
-    ResolvedPath oldOpenData=resolvePath(oldPath,true);
+    SharedLock l(mutex);
+    ResolvedPath oldOpenData=resolvePathImpl(oldPath,true);
     if(oldOpenData.result<0) return oldOpenData.result;
-    ResolvedPath newOpenData=resolvePath(newPath,true);
+    ResolvedPath newOpenData=resolvePathImpl(newPath,true);
     if(newOpenData.result<0) return newOpenData.result;
     
     if(oldOpenData.fs!=newOpenData.fs) return -EXDEV; //Can't rename across fs
@@ -685,6 +795,79 @@ int FilesystemManager::renameHelper(string& oldPath, string& newPath)
     return oldOpenData.fs->rename(oldSp,newSp);
 }
 
+#ifdef WITH_PATH_CACHE
+bool FilesystemManager::cachedResolvePath(string& path, ResolvedPath& resolved)
+{
+    //Only a plain name as last path component can be appended to the resolved
+    //directory, "." and ".." and trailing slashes need the full walk
+    size_t slash=path.find_last_of('/');
+    size_t nameLen=path.length()-slash-1;
+    if(nameLen==0) return false;
+    if(path[slash+1]=='.' && (nameLen==1 || (nameLen==2 && path[slash+2]=='.')))
+        return false;
+    
+    string dir(path,0,slash==0 ? 1 : slash);
+    string resolvedDir;
+    ResolvedPath dirResolved;
+    bool mountpoints;
+    if(pathCache.lookup(dir,resolvedDir,dirResolved,mountpoints)==false)
+    {
+        SharedLock l(mutex);
+        if(pathCache.isEnabled()==false) return false;
+        resolvedDir=dir;
+        PathResolution pr(filesystems);
+        dirResolved=pr.resolvePath(resolvedDir,true);
+        //If a filesystem is mounted in this directory, the last path component
+        //may be its mountpoint, so the full walk is needed
+        mountpoints=false;
+        bool isRoot=resolvedDir.empty() || resolvedDir=="/";
+        size_t dirLen=isRoot ? 1 : resolvedDir.length();
+        map<StringPart,intrusive_ref_ptr<FilesystemBase> >::const_iterator it;
+        for(it=filesystems.begin();it!=filesystems.end();++it)
+        {
+            if(it->first.length()<=1) continue; //The root filesystem
+            size_t parentLen=it->first.findLastOf('/');
+            if(parentLen==0) parentLen=1;
+            if(parentLen!=dirLen) continue;
+            if(isRoot || resolvedDir.compare(0,dirLen,it->first.c_str(),dirLen)==0)
+            {
+                mountpoints=true;
+                break;
+            }
+        }
+        pathCache.insert(dir,resolvedDir,dirResolved,mountpoints);
+    }
+    if(dirResolved.result<0)
+    {
+        resolved=dirResolved;
+        return true;
+    }
+    if(mountpoints) return false;
+    
+    //Directory part of the resolved path, empty for the root directory
+    size_t base=resolvedDir=="/" ? 0 : resolvedDir.length();
+    path.replace(0,slash,resolvedDir,0,base);
+    size_t off=dirResolved.off;
+    //If the directory is a mountpoint the relative path starts after it
+    if(off>=base) off=base+1;
+    resolved=ResolvedPath(dirResolved.fs,off);
+    return true;
+}
+
+void FilesystemManager::invalidatePathCache()
+{
+    bool enable=true;
+    map<StringPart,intrusive_ref_ptr<FilesystemBase> >::const_iterator it;
+    for(it=filesystems.begin();it!=filesystems.end();++it)
+    {
+        if(it->second->supportsSymlinks()==false) continue;
+        enable=false;
+        break;
+    }
+    pathCache.invalidate(enable);
+}
+#endif //WITH_PATH_CACHE
+
 short int FilesystemManager::getFilesystemId()
 {
     return atomicAddExchange(&devCount,1);
@@ -719,6 +902,9 @@ basicFilesystemSetup(intrusive_ref_ptr<Device> dev)
     bootlog("Mounting Fat32Fs as /sd ... ");
     bool fat32failed=false;
     intrusive_ref_ptr<FileBase> disk;
+    #ifdef WITH_BLOCK_CACHE
+    if(dev) dev=new BlockCache(dev,BLOCK_CACHE_BLOCKS,BLOCK_CACHE_BLOCK_SIZE);
+    #endif //WITH_BLOCK_CACHE
     #ifdef WITH_DEVFS
     if(dev) devfs->addDevice("sda",dev);
     StringPart sda("sda");
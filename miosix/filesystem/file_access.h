@@ -159,6 +159,76 @@ public:
         return file->read(data,len);
     }
     
+    /**
+     * Read data from the file into multiple buffers, if the file supports
+     * reading.
+     * \param iov array of buffers
+     * \param iovcnt number of buffers, at most IOV_MAX
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+    {
+        int result=checkIovec(iov,iovcnt);
+        if(result<0) return result;
+        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        if(!file) return -EBADF;
+        return file->readv(iov,iovcnt);
+    }
+    
+    /**
+     * Write data to the file from multiple buffers, if the file supports
+     * writing.
+     * \param iov array of buffers
+     * \param iovcnt number of buffers, at most IOV_MAX
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+    {
+        int result=checkIovec(iov,iovcnt);
+        if(result<0) return result;
+        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        if(!file) return -EBADF;
+        return file->writev(iov,iovcnt);
+    }
+    
+    /**
+     * Read data from the file at the given offset, without moving the file
+     * pointer, if the file supports random-access.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the file
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    ssize_t pread(int fd, void *data, size_t len, off_t pos)
+    {
+        if(data==0) return -EFAULT;
+        if(static_cast<ssize_t>(len)<0 || pos<0) return -EINVAL;
+        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        if(!file) return -EBADF;
+        return file->pread(data,len,pos);
+    }
+    
+    /**
+     * Write data to the file at the given offset, without moving the file
+     * pointer, if the file supports random-access.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param pos offset from the beginning of the file
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    ssize_t pwrite(int fd, const void *data, size_t len, off_t pos)
+    {
+        if(data==0) return -EFAULT;
+        if(static_cast<ssize_t>(len)<0 || pos<0) return -EINVAL;
+        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        if(!file) return -EBADF;
+        return file->pwrite(data,len,pos);
+    }
+    
     /**
      * Move file pointer, if the file supports random-access.
      * \param pos offset to sum to the beginning of the file, current position
@@ -347,6 +417,14 @@ private:
      */
     int statImpl(const char *name, struct stat *pstat, bool f);
     
+    /**
+     * Validate the arguments of readv and writev
+     * \param iov array of buffers
+     * \param iovcnt number of buffers
+     * \return 0 if the buffers are valid, or a negative number on failure
+     */
+    static int checkIovec(const struct iovec *iov, int iovcnt);
+    
     FastMutex mutex; ///< Locks on writes to file object pointers, not on accesses
     
     std::string cwd; ///< Current working directory
@@ -355,6 +433,81 @@ private:
     intrusive_ref_ptr<FileBase> files[MAX_OPEN_FILES];
 };
 
+#ifdef WITH_PATH_CACHE
+
+/**
+ * \internal
+ * A small cache of resolved directories, used by
+ * FilesystemManager::resolvePath(). The resolution of a directory, including
+ * a failed one, only depends on the mounted filesystems as long as no
+ * filesystem supports symlinks, so entries remain valid until a filesystem is
+ * mounted or unmounted.
+ */
+class PathCache
+{
+public:
+    /**
+     * Constructor
+     */
+    PathCache() : next(0), enabled(true) {}
+    
+    /**
+     * Look up a directory
+     * \param dir directory path, as passed to resolvePath() (not resolved)
+     * \param resolvedDir the resolved directory path is stored here on a hit
+     * \param resolved the resolution result is stored here on a hit
+     * \param mountpoints on a hit, true if the directory contains mountpoints
+     * \return true on a hit
+     */
+    bool lookup(const std::string& dir, std::string& resolvedDir,
+            ResolvedPath& resolved, bool& mountpoints);
+    
+    /**
+     * Add a directory to the cache, replacing the oldest entry
+     * \param dir directory path, as passed to resolvePath() (not resolved)
+     * \param resolvedDir resolved directory path
+     * \param resolved resolution result
+     * \param mountpoints true if the directory contains mountpoints
+     */
+    void insert(const std::string& dir, const std::string& resolvedDir,
+            const ResolvedPath& resolved, bool mountpoints);
+    
+    /**
+     * Remove all entries from the cache
+     * \param enable false to bypass the cache until the next invalidate()
+     */
+    void invalidate(bool enable);
+    
+    /**
+     * \return true if the cache is not bypassed
+     */
+    bool isEnabled() const { return enabled; }
+    
+private:
+    PathCache(const PathCache&);
+    PathCache& operator=(const PathCache&);
+    
+    /**
+     * A cache entry, unused if dir is empty
+     */
+    struct Entry
+    {
+        Entry() : mountpoints(false) {}
+        
+        std::string dir;         ///< Directory path, not resolved
+        std::string resolvedDir; ///< Resolved directory path
+        ResolvedPath resolved;   ///< Resolution result
+        bool mountpoints;        ///< True if the directory contains mountpoints
+    };
+    
+    FastMutex mutex; ///< Protects the entries, not the global filesystem mutex
+    Entry entries[PATH_CACHE_ENTRIES];
+    unsigned int next; ///< Next entry to replace
+    bool enabled;      ///< False if a filesystem supporting symlinks is mounted
+};
+
+#endif //WITH_PATH_CACHE
+
 /**
  * This class contains information on all the mounted filesystems
  */
@@ -466,7 +619,7 @@ public:
         #ifdef WITH_PROCESSES
         if(isKernelRunning())
         {
-            Lock<FastMutex> l(mutex);
+            Lock<RWMutex> l(mutex);
             fileTables.push_back(fdt);
         } else {
             //This function is also called before the kernel is started,
@@ -484,7 +637,7 @@ public:
     void removeFileDescriptorTable(FileDescriptorTable *fdt)
     {
         #ifdef WITH_PROCESSES
-        Lock<FastMutex> l(mutex);
+        Lock<RWMutex> l(mutex);
         fileTables.remove(fdt);
         #endif //WITH_PROCESSES
     }
@@ -500,12 +653,62 @@ private:
     /**
      * Constructor, private as it is a singleton
      */
-    FilesystemManager() : mutex(FastMutex::RECURSIVE) {}
+    FilesystemManager() {}
+    
+    /**
+     * Same as resolvePath(), but must be called with mutex already locked,
+     * either in shared or exclusive mode, and does not use the path cache
+     * \param path as in resolvePath()
+     * \param followLastSymlink as in resolvePath()
+     * \return the resolved path
+     */
+    ResolvedPath resolvePathImpl(std::string& path, bool followLastSymlink);
+    
+    /**
+     * Same as statHelper(), but must be called with mutex already locked,
+     * either in shared or exclusive mode
+     * \param path as in statHelper()
+     * \param pstat as in statHelper()
+     * \param f as in statHelper()
+     * \return 0 on success, or a negative number on failure
+     */
+    int statImpl(std::string& path, struct stat *pstat, bool f);
+    
+    /**
+     * Same as renameHelper(), but does not invalidate the path cache.
+     * Locks the mutex in shared mode
+     * \param oldPath as in renameHelper()
+     * \param newPath as in renameHelper()
+     * \return 0 on success, or a negative number on failure
+     */
+    int renameImpl(std::string& oldPath, std::string& newPath);
+    
+    #ifdef WITH_PATH_CACHE
+    /**
+     * Resolve a path reusing the cached resolution of its directory
+     * \param path as in resolvePath()
+     * \param resolved the result is stored here on success
+     * \return false if the path has to be resolved with PathResolution
+     */
+    bool cachedResolvePath(std::string& path, ResolvedPath& resolved);
+    
+    /**
+     * Invalidate the path cache, must be called with mutex locked in exclusive
+     * mode after the mounted filesystems change
+     */
+    void invalidatePathCache();
+    #endif //WITH_PATH_CACHE
     
     FilesystemManager(const FilesystemManager&);
     FilesystemManager& operator=(const FilesystemManager&);
     
-    FastMutex mutex; ///< To protect against concurrent access
+    /// Locked in exclusive mode to change the mounted filesystems, and in
+    /// shared mode to look them up
+    RWMutex mutex;
+    
+    #ifdef WITH_PATH_CACHE
+    PathCache pathCache; ///< Resolved directories
+    #endif //WITH_PATH_CACHE
     
     /// Mounted filesystem
     std::map<StringPart,intrusive_ref_ptr<FilesystemBase> > filesystems;
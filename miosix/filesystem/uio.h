@@ -0,0 +1,68 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef UIO_H
+#define	UIO_H
+
+#include <sys/types.h>
+
+/*
+ * Newlib does not provide sys/uio.h, so the scatter-gather I/O interface is
+ * declared here. Include this file instead of <sys/uio.h>
+ */
+
+/// Maximum number of iovec entries accepted by readv() and writev()
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif //IOV_MAX
+
+#ifdef __cplusplus
+extern "C" {
+#endif //__cplusplus
+
+/**
+ * A buffer for scatter-gather I/O
+ */
+struct iovec
+{
+    void *iov_base; ///< Pointer to the buffer
+    size_t iov_len; ///< Buffer size in bytes
+};
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt);
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt);
+
+ssize_t pread(int fd, void *buf, size_t size, off_t offset);
+
+ssize_t pwrite(int fd, const void *buf, size_t size, off_t offset);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //UIO_H
@@ -271,6 +271,32 @@ inline bool checkAreInterruptsEnabled();
  */
 void sleepCpu();
 
+#ifdef WITH_TICKLESS_IDLE
+/**
+ * \internal
+ * Used by the idle thread to skip tick interrupts. Reprogram the tick timer
+ * so that the next tick interrupt occurs after the given number of ticks,
+ * then the tick timer has to go back to periodic without further action.
+ * Must be called with interrupts disabled.
+ * \param ticks number of ticks after which the next tick interrupt is required
+ * \return the number of ticks the tick timer was actually stretched to, that
+ * can be lower than ticks due to the tick timer range, or zero if the
+ * tick timer was not stretched
+ */
+unsigned int IRQstretchTick(unsigned int ticks);
+
+/**
+ * \internal
+ * Called when a thread becomes ready before the stretched tick interrupt
+ * occurs. Reprogram the tick timer so that the next tick interrupt occurs
+ * at the next tick boundary and is then periodic.
+ * Must be called with interrupts disabled.
+ * \return the number of ticks elapsed since IRQstretchTick() was called and
+ * not yet accounted for by a tick interrupt
+ */
+unsigned int IRQrestoreTick();
+#endif //WITH_TICKLESS_IDLE
+
 #ifdef SCHED_TYPE_CONTROL_BASED
 /**
  * Allow access to a second timer to allow variable burst preemption together
@@ -17,7 +17,7 @@ void SystemMap::addElfProgram(const char* name, const unsigned int *elf, unsigne
 {
     string sName(name);
     if(mPrograms.find(sName) == mPrograms.end())
-        mPrograms.insert(make_pair(sName, make_pair(elf, size)));
+        mPrograms.insert(make_pair(sName, ElfProgram(elf, size)));
 }
 
 void SystemMap::removeElfProgram(const char* name)
@@ -36,7 +36,18 @@ pair<const unsigned int*, unsigned int>  SystemMap::getElfProgram(const char* na
     if(it == mPrograms.end())
         return make_pair<const unsigned int*, unsigned int>(0, 0);
 
-    return it->second;
+    return make_pair(reinterpret_cast<const unsigned int*>(it->second.getElfBase()),
+                     it->second.getElfSize());
+}
+
+const ElfProgram *SystemMap::getProgram(const char* name) const
+{
+    ProgramsMap::const_iterator it = mPrograms.find(string(name));
+
+    if(it == mPrograms.end())
+        return 0;
+
+    return &it->second;
 }
 
 unsigned int SystemMap::getElfCount() const
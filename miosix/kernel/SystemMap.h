@@ -3,6 +3,7 @@
 
 #include "kernel/sync.h"
 #include "config/miosix_settings.h"
+#include "elf_program.h"
 
 #include <map>
 #include <string>
@@ -16,10 +17,26 @@ class SystemMap
 public:
     static SystemMap &instance();
 
+    /**
+     * Register a program. The elf file is validated once here, and the
+     * validated program is cached, so that starting it does not parse it again
+     * \param name program name
+     * \param elf pointer to the elf file, must remain valid until the program
+     * is removed
+     * \param size elf file size
+     * \throws runtime_error if the elf file is not valid
+     */
     void addElfProgram(const char *name, const unsigned int *elf, unsigned int size);
     void removeElfProgram(const char *name);
     std::pair<const unsigned int*, unsigned int> getElfProgram(const char *name) const;
 
+    /**
+     * \param name program name
+     * \return the already validated program, or null if no program with that
+     * name is registered
+     */
+    const ElfProgram *getProgram(const char *name) const;
+
     unsigned int getElfCount() const;
 
 private:
@@ -27,7 +44,7 @@ private:
     SystemMap(const SystemMap&);
     SystemMap& operator= (const SystemMap&);
 
-    typedef std::map<std::string, std::pair<const unsigned int*, unsigned int> > ProgramsMap;
+    typedef std::map<std::string, ElfProgram> ProgramsMap;
     ProgramsMap mPrograms;
 };
 
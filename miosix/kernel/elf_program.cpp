@@ -49,7 +49,8 @@ static const unsigned int DATA_START=0x10000000;
 //
 
 ElfProgram::ElfProgram(const unsigned int *elf, unsigned int size)
-    : elf(elf), size(size)
+    : elf(elf), size(size), dataOffset(0), dataFileSize(0), dataMemSize(0),
+      relOffset(0), relCount(0), ramSize(0)
 {
     //Trying to follow the "full recognition before processing" approach,
     //(http://www.cs.dartmouth.edu/~sergey/langsec/occupy/FullRecognition.jpg)
@@ -120,6 +121,9 @@ bool ElfProgram::validateHeader()
                     if(phdr->p_memsz>=maxSize)
                         throw runtime_error("Data segment too big");
                     dataSegmentSize=phdr->p_memsz;
+                    dataOffset=phdr->p_offset;
+                    dataFileSize=phdr->p_filesz;
+                    dataMemSize=phdr->p_memsz;
                 }
                 break;
             case PT_DYNAMIC:
@@ -136,6 +140,8 @@ bool ElfProgram::validateHeader()
         }
     }
     if(codeSegmentPresent==false) return false; //Can't not have code segment
+    //Can't not have dynamic segment, it contains the process image size
+    if(dynamicSegmentPresent==false) return false;
     return true;
 }
 
@@ -198,6 +204,7 @@ bool ElfProgram::validateDynamicSegment(const Elf32_Phdr *dynamic,
        (dataSegmentSize>MAX_PROCESS_IMAGE_SIZE) ||
        (dataSegmentSize+stackSize>ramSize))
         throw runtime_error("Invalid stack or RAM size");
+    this->ramSize=ramSize;
     
     if(hasRelocs!=0 && hasRelocs!=0x7) return false;
     if(hasRelocs)
@@ -206,9 +213,12 @@ bool ElfProgram::validateDynamicSegment(const Elf32_Phdr *dynamic,
         if(dtRel>=size) return false;
         if(dtRelsz>=size) return false;
         if(dtRel+dtRelsz>size) return false;
+        if(dtRel & 0x3) return false;
         
         const Elf32_Rel *rel=reinterpret_cast<const Elf32_Rel*>(base+dtRel);
         const int relSize=dtRelsz/sizeof(Elf32_Rel);
+        relOffset=dtRel;
+        relCount=relSize;
         for(int i=0;i<relSize;i++,rel++)
         {
             switch(ELF32_R_TYPE(rel->r_info))
@@ -234,74 +244,39 @@ bool ElfProgram::validateDynamicSegment(const Elf32_Phdr *dynamic,
 
 void ProcessImage::load(const ElfProgram& program)
 {
-    if(image) ProcessPool::instance().deallocate(image);
-    const unsigned int base=program.getElfBase();
-    const Elf32_Phdr *phdr=program.getProgramHeaderTable();
-    const Elf32_Phdr *dataSegment=0;
-    Elf32_Addr dtRel=0;
-    Elf32_Word dtRelsz=0;
-    bool hasRelocs=false;
-    for(int i=0;i<program.getNumOfProgramHeaderEntries();i++,phdr++)
+    //The elf file has already been parsed and validated by ElfProgram, so
+    //loading a new process only costs allocating its image, copying .data,
+    //zeroing .bss and applying the relocations
+    if(image)
     {
-        switch(phdr->p_type)
-        {
-            case PT_LOAD:
-                if((phdr->p_flags & PF_W) && !(phdr->p_flags & PF_X))
-                    dataSegment=phdr;
-                break;
-            case PT_DYNAMIC:
-            {
-                const Elf32_Dyn *dyn=reinterpret_cast<const Elf32_Dyn*>
-                    (base+phdr->p_offset);
-                const int dynSize=phdr->p_memsz/sizeof(Elf32_Dyn);
-                for(int i=0;i<dynSize;i++,dyn++)
-                {
-                    switch(dyn->d_tag)
-                    {
-                        case DT_REL:
-                            hasRelocs=true;
-                            dtRel=dyn->d_un.d_ptr;
-                            break;
-                        case DT_RELSZ:
-                            hasRelocs=true;
-                            dtRelsz=dyn->d_un.d_val;
-                            break;
-                        case DT_MX_RAMSIZE:
-                            size=dyn->d_un.d_val;
-                            image=ProcessPool::instance()
-                                    .allocate(dyn->d_un.d_val);
-                        default:
-                            break;
-                    }
-                }
-                break;
-            }
-            default:
-                //Ignoring other segments
-                break;
-        }
+        ProcessPool::instance().deallocate(image);
+        image=0;
     }
+    const unsigned int base=program.getElfBase();
+    size=program.ramSize;
+    image=ProcessPool::instance().allocate(size);
     const char *dataSegmentInFile=
-        reinterpret_cast<const char*>(base+dataSegment->p_offset);
+        reinterpret_cast<const char*>(base+program.dataOffset);
     char *dataSegmentInMem=reinterpret_cast<char*>(image);
-    memcpy(dataSegmentInMem,dataSegmentInFile,dataSegment->p_filesz);
-    dataSegmentInMem+=dataSegment->p_filesz;
-    memset(dataSegmentInMem,0,dataSegment->p_memsz-dataSegment->p_filesz);
-    if(hasRelocs)
+    memcpy(dataSegmentInMem,dataSegmentInFile,program.dataFileSize);
+    dataSegmentInMem+=program.dataFileSize;
+    memset(dataSegmentInMem,0,program.dataMemSize-program.dataFileSize);
+    if(program.relCount>0)
     {
-        const Elf32_Rel *rel=reinterpret_cast<const Elf32_Rel*>(base+dtRel);
-        const int relSize=dtRelsz/sizeof(Elf32_Rel);
-        const unsigned int base=reinterpret_cast<unsigned int>(image);
-        DBG("Relocations -- start (process RAM image @ 0x%x)\n",base);
-        for(int i=0;i<relSize;i++,rel++)
+        const Elf32_Rel *rel=
+            reinterpret_cast<const Elf32_Rel*>(base+program.relOffset);
+        const unsigned int imageBase=reinterpret_cast<unsigned int>(image);
+        DBG("Relocations -- start (process RAM image @ 0x%x)\n",imageBase);
+        for(unsigned int i=0;i<program.relCount;i++,rel++)
         {
             unsigned int offset=(rel->r_offset-DATA_START)/4;
             switch(ELF32_R_TYPE(rel->r_info))
             {
                 case R_ARM_RELATIVE:
                     DBG("R_ARM_RELATIVE offset 0x%x from 0x%x to 0x%x\n",
-                        offset*4,image[offset],image[offset]+base-DATA_START);
-                    image[offset]+=base-DATA_START;
+                        offset*4,image[offset],
+                        image[offset]+imageBase-DATA_START);
+                    image[offset]+=imageBase-DATA_START;
                     break;
                 default:
                     break;
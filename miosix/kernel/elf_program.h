@@ -103,6 +103,15 @@ public:
         return size;
     }
     
+    /**
+     * \return the size of the RAM image a process running this program needs,
+     * as requested through DT_MX_RAMSIZE
+     */
+    unsigned int getProcessImageSize() const
+    {
+        return ramSize;
+    }
+    
 private:
     /**
      * \param size elf file size
@@ -123,6 +132,17 @@ private:
     
     const unsigned int * const elf; ///<Pointer to the content of the elf file
     unsigned int size; ///< Size of the elf file
+    
+    //Load information, collected while validating the elf file so that the
+    //elf is parsed once, and all processes running this program share it
+    unsigned int dataOffset;   ///< Offset of the data segment in the elf file
+    unsigned int dataFileSize; ///< Size of the data segment in the elf file
+    unsigned int dataMemSize;  ///< Size of the data segment in memory
+    unsigned int relOffset;    ///< Offset of the relocation table, if any
+    unsigned int relCount;     ///< Number of entries in the relocation table
+    unsigned int ramSize;      ///< Size of the process image
+    
+    friend class ProcessImage;
 };
 
 /**
@@ -139,7 +159,10 @@ public:
     /**
      * Starting from the content of the elf program, create an image in RAM of
      * the process, including copying .data, zeroing .bss and performing
-     * relocations
+     * relocations. Only code is executed in place from the elf file and shared
+     * among all the processes running the same program. The data segment,
+     * which also contains .rodata as the compiler addresses it relative to
+     * r9, is copied and relocated for each process.
      */
     void load(const ElfProgram& program);
     
@@ -36,6 +36,8 @@
 #include "stage_2_boot.h"
 #include "process.h"
 #include "kernel/scheduler/scheduler.h"
+#include "kernel/pairing_heap.h"
+#include "kernel/thread_pool.h"
 #include <stdexcept>
 #include <algorithm>
 #include <string.h>
@@ -57,13 +59,21 @@ namespace miosix {
 
 volatile Thread *cur=NULL;///<\internal Thread currently running
 
-///\internal True if there are threads in the DELETED status. Used by idle thread
-static volatile bool exist_deleted=false;
+///\internal List of threads that are deleted and detached, whose memory has
+///yet to be deallocated. Used by idle thread
+static Thread *volatile zombie_list=NULL;
 
-static SleepData *sleeping_list=NULL;///<\internal list of sleeping threads
+///\internal Heap of sleeping threads, sorted by wakeup time
+static SleepData *sleeping_list=NULL;
 
 static volatile long long tick=0;///<\internal Kernel tick
 
+#ifdef WITH_TICKLESS_IDLE
+///\internal Number of ticks the tick interrupt has been stretched to by the
+///idle thread, or zero if the tick is periodic
+static unsigned int stretched_ticks=0;
+#endif //WITH_TICKLESS_IDLE
+
 ///\internal !=0 after pauseKernel(), ==0 after restartKernel()
 volatile int kernel_running=0;
 
@@ -83,6 +93,40 @@ static ProcessBase *kernel=0;
 
 #endif //WITH_PROCESSES
 
+#ifdef WITH_TICKLESS_IDLE
+/**
+ * \internal
+ * Called by the idle thread with interrupts disabled to stretch the tick
+ * interrupt up to the wakeup time of the first sleeping thread.
+ */
+static void IRQenterTicklessIdle()
+{
+    if(stretched_ticks!=0) return; //Already stretched
+    unsigned int ticks=0xffffffff;
+    if(sleeping_list!=NULL)
+    {
+        long long delta=sleeping_list->wakeup_time-tick;
+        if(delta<=1) return;
+        if(delta<ticks) ticks=delta;
+    }
+    stretched_ticks=miosix_private::IRQstretchTick(ticks);
+}
+
+/**
+ * \internal
+ * Called by the scheduler with interrupts disabled when a thread other than
+ * the idle thread is selected to run, restores the periodic tick.
+ */
+void IRQresumePeriodicTick()
+{
+    if(stretched_ticks==0) return;
+    stretched_ticks=0;
+    //No need to wake threads, since the stretched tick interrupt has not
+    //occurred, no wakeup time has been reached yet
+    tick+=miosix_private::IRQrestoreTick();
+}
+#endif //WITH_TICKLESS_IDLE
+
 /**
  * \internal
  * Idle thread. Created when the kernel is started, it phisically deallocates
@@ -92,12 +136,22 @@ void *idleThread(void *argv)
 {
     for(;;)
     {
-        if(exist_deleted)
+        if(zombie_list!=NULL) Thread::reclaimZombies();
+        #ifdef WITH_TICKLESS_IDLE
+        //Interrupts are disabled also while the cpu sleeps, the cpu wakes
+        //when an interrupt becomes pending, that is served after the lock
+        //goes out of scope
+        FastInterruptDisableLock dLock;
+        //An interrupt may have woken a thread without calling
+        //IRQfindNextThread(), which would then wait for the stretched tick
+        if(PriorityScheduler::IRQhasReadyThreads())
         {
-            PauseKernelLock lock;
-            exist_deleted=false;
-            Scheduler::PKremoveDeadThreads();
+            FastInterruptEnableLock eLock(dLock);
+            Thread::yield();
+            continue;
         }
+        IRQenterTicklessIdle();
+        #endif //WITH_TICKLESS_IDLE
         #ifndef JTAG_DISABLE_SLEEP
         //JTAG debuggers lose communication with the device if it enters sleep
         //mode, so to use debugging it is necessary to remove this instruction
@@ -170,6 +224,14 @@ void startKernel()
     }
     #endif //WITH_PROCESSES
 
+    #ifdef WITH_THREAD_POOL
+    if(ThreadPool::init()==false)
+    {
+        errorHandler(OUT_OF_MEMORY);
+        return;
+    }
+    #endif //WITH_THREAD_POOL
+
     // Create the idle and main thread
     Thread *idle, *main;
     idle=Thread::doCreate(idleThread,STACK_IDLE,NULL,Thread::DEFAULT,true);
@@ -223,9 +285,9 @@ long long getTick()
 
 /**
  * \internal
- * Used by Thread::sleep() to add a thread to sleeping list. The list is sorted
- * by the wakeup_time field to reduce time required to wake threads during
- * context switch.
+ * Used by Thread::sleep() to add a thread to sleeping list. The list is a
+ * pairing heap sorted by the wakeup_time field, so that insertion is O(1) and
+ * waking threads during context switch is O(log n).
  * Also sets thread SLEEP_FLAG. It is labeled IRQ not because it is meant to be
  * used inside an IRQ, but because interrupts must be disabled prior to calling
  * this function.
@@ -233,45 +295,57 @@ long long getTick()
 void IRQaddToSleepingList(SleepData *x)
 {
     x->p->flags.IRQsetSleep(true);
-    if((sleeping_list==NULL)||(x->wakeup_time <= sleeping_list->wakeup_time))
-    {
-        x->next=sleeping_list;
-        sleeping_list=x;   
-    } else {
-       SleepData *cur=sleeping_list;
-       for(;;)
-       {
-           if((cur->next==NULL)||(x->wakeup_time <= cur->next->wakeup_time))
-           {
-               x->next=cur->next;
-               cur->next=x;
-               break;
-           }
-           cur=cur->next;
-       }
-    }
+    pairingHeapInsert(sleeping_list,x);
+}
+
+void IRQaddTimeoutToSleepingList(SleepData *x)
+{
+    pairingHeapInsert(sleeping_list,x);
+}
+
+bool IRQremoveTimeoutFromSleepingList(SleepData *x)
+{
+    if(x->p==NULL) return true;
+    pairingHeapRemove(sleeping_list,x);
+    return false;
 }
 
 /**
  * \internal
  * Called @ every tick to check if it's time to wake some thread.
- * Also increases the system tick.
- * Takes care of clearing SLEEP_FLAG.
+ * Also increases the system tick, by more than one if the tick was stretched
+ * by the idle thread.
+ * Takes care of clearing SLEEP_FLAG, or the wait flags for timed waits.
  * It is used by the kernel, and should not be used by end users.
  * \return true if some thread was woken.
  */
 bool IRQwakeThreads()
 {
+    #ifdef WITH_TICKLESS_IDLE
+    //If the tick was stretched, this interrupt accounts for all skipped ticks
+    if(stretched_ticks!=0)
+    {
+        tick+=stretched_ticks;
+        stretched_ticks=0;
+    } else tick++;
+    #else //WITH_TICKLESS_IDLE
     tick++;//Increment tick
+    #endif //WITH_TICKLESS_IDLE
     bool result=false;
     for(;;)
     {
         if(sleeping_list==NULL) break;//If no item in list, return
-        //Since list is sorted, if we don't need to wake the first element
-        //we don't need to wake the other too
-        if(tick != sleeping_list->wakeup_time) break;
-        sleeping_list->p->flags.IRQsetSleep(false);//Wake thread
-        sleeping_list=sleeping_list->next;//Remove from list
+        //The root of the heap is the first thread to wake, if we don't need
+        //to wake it we don't need to wake the others too
+        if(tick < sleeping_list->wakeup_time) break;
+        //Wake thread and remove from heap
+        SleepData *d=pairingHeapRemoveMin(sleeping_list);
+        if(d->p->flags.isSleeping()) d->p->flags.IRQsetSleep(false);
+        else {
+            //Timed wait, signal the timeout through a NULL thread pointer
+            d->p->flags.IRQtimeout();
+            d->p=NULL;
+        }
         result=true;
     }
     return result;
@@ -308,7 +382,7 @@ Thread *Thread::create(void *(*startfunc)(void *), unsigned int stacksize,
             //Reached limit on number of threads
             unsigned int *base=thread->watermark;
             thread->~Thread();
-            free(base); //Delete ALL thread memory
+            deallocateMemory(base); //Delete ALL thread memory
             return NULL;
         }
     }
@@ -411,8 +485,8 @@ void Thread::setPriority(Priority pr)
         Mutex *walk=current->mutexLocked;
         while(walk!=0)
         {
-            if(walk->waiting.empty()==false)
-                pr=std::max(pr,walk->waiting.front()->getPriority());
+            if(walk->waiting!=0)
+                pr=std::max(pr,walk->waiting->getPriority());
             walk=walk->next;
         }
     }
@@ -466,10 +540,12 @@ void Thread::PKwakeup()
 void Thread::detach()
 {
     FastInterruptDisableLock lock;
+    //Already detached, if also terminated it is already in the zombie list
+    if(this->flags.isDetached()) return;
     this->flags.IRQsetDetached();
     
     //we detached a terminated thread, so its memory needs to be deallocated
-    if(this->flags.isDeletedJoin()) exist_deleted=true;
+    if(this->flags.isDeletedJoin()) IRQaddToZombieList(this);
 
     //Corner case: detaching a thread, but somebody else already called join
     //on it. This makes join return false instead of deadlocking
@@ -521,13 +597,11 @@ bool Thread::join(void** result)
         //so its memory can be deallocated
         this->flags.IRQsetDetached();
         if(result!=NULL) *result=this->joinData.result;
+        IRQaddToZombieList(this);
     }
-    {
-        PauseKernelLock lock;
-        //Since there is surely one dead thread, deallocate it immediately
-        //to free its memory as soon as possible
-        Scheduler::PKremoveDeadThreads();
-    }
+    //Since there is surely one dead thread, deallocate it immediately
+    //to free its memory as soon as possible
+    reclaimZombies();
     return true;
 }
 
@@ -551,6 +625,25 @@ void Thread::IRQwait()
     const_cast<Thread*>(cur)->flags.IRQsetWait(true);
 }
 
+TimedWaitResult Thread::IRQenableIrqAndTimedWait(
+        FastInterruptDisableLock& dLock, long long absoluteTime)
+{
+    if(absoluteTime<=getTick()) return TimedWaitResult::Timeout;
+    //The SleepData variable has to be in scope till the thread is removed
+    //from the sleeping list, either by the timeout or by us
+    SleepData d;
+    d.p=const_cast<Thread*>(cur);
+    d.wakeup_time=absoluteTime;
+    d.p->flags.IRQsetWait(true);
+    IRQaddTimeoutToSleepingList(&d);
+    {
+        FastInterruptEnableLock eLock(dLock);
+        Thread::yield();
+    }
+    if(IRQremoveTimeoutFromSleepingList(&d)) return TimedWaitResult::Timeout;
+    return TimedWaitResult::NoTimeout;
+}
+
 void Thread::IRQwakeup()
 {
     this->flags.IRQsetWait(false);
@@ -575,15 +668,15 @@ int Thread::getStackSize()
 Thread *Thread::doCreate(void*(*startfunc)(void*) , unsigned int stacksize,
                       void* argv, unsigned short options, bool defaultReent)
 {
-    unsigned int fullStackSize=WATERMARK_LEN+CTXSAVE_ON_STACK+stacksize;
-    
-    //Align fullStackSize to the platform required stack alignment
-    fullStackSize+=CTXSAVE_STACK_ALIGNMENT-1;
-    fullStackSize/=CTXSAVE_STACK_ALIGNMENT;
-    fullStackSize*=CTXSAVE_STACK_ALIGNMENT;
+    unsigned int *base=NULL;
+    #ifdef WITH_THREAD_POOL
+    //Also rounds stacksize up to the stack size of the pool class
+    base=ThreadPool::allocate(stacksize);
+    #endif //WITH_THREAD_POOL
+    unsigned int fullStackSize=memorySize(stacksize)-sizeof(Thread);
     
     //Allocate memory for the thread, return if fail
-    unsigned int *base=static_cast<unsigned int*>(malloc(sizeof(Thread)+
+    if(base==NULL) base=static_cast<unsigned int*>(malloc(sizeof(Thread)+
             fullStackSize));
     if(base==NULL) return NULL;
     
@@ -595,7 +688,7 @@ Thread *Thread::doCreate(void*(*startfunc)(void*) , unsigned int stacksize,
        thread->cppReent.isInitialized()==false)
     {
          thread->~Thread();
-         free(base); //Delete ALL thread memory
+         deallocateMemory(base); //Delete ALL thread memory
          return NULL;
     }
 
@@ -613,6 +706,25 @@ Thread *Thread::doCreate(void*(*startfunc)(void*) , unsigned int stacksize,
     return thread;
 }
 
+unsigned int Thread::memorySize(unsigned int stacksize)
+{
+    unsigned int fullStackSize=WATERMARK_LEN+CTXSAVE_ON_STACK+stacksize;
+    
+    //Align fullStackSize to the platform required stack alignment
+    fullStackSize+=CTXSAVE_STACK_ALIGNMENT-1;
+    fullStackSize/=CTXSAVE_STACK_ALIGNMENT;
+    fullStackSize*=CTXSAVE_STACK_ALIGNMENT;
+    return sizeof(Thread)+fullStackSize;
+}
+
+void Thread::deallocateMemory(void *base)
+{
+    #ifdef WITH_THREAD_POOL
+    if(ThreadPool::deallocate(base)) return;
+    #endif //WITH_THREAD_POOL
+    free(base);
+}
+
 #ifdef WITH_PROCESSES
 
 void Thread::IRQhandleSvc(unsigned int svcNumber)
@@ -680,7 +792,7 @@ void Thread::threadLauncher(void *(*threadfunc)(void*), void *argv)
             cur->joinData.result=result;
         } else {
             //If thread is detached, memory can be deallocated immediately
-            exist_deleted=true;
+            IRQaddToZombieList(const_cast<Thread*>(cur));
         }
     }
     Thread::yield();//Since the thread is now deleted, yield immediately.
@@ -688,6 +800,39 @@ void Thread::threadLauncher(void *(*threadfunc)(void*), void *argv)
     errorHandler(UNEXPECTED);
 }
 
+void Thread::IRQaddToZombieList(Thread *thread)
+{
+    thread->zombieNext=zombie_list;
+    zombie_list=thread;
+}
+
+void Thread::reclaimZombies()
+{
+    Thread *zombies;
+    {
+        PauseKernelLock lock;
+        {
+            //Zombies are added with interrupts disabled
+            FastInterruptDisableLock dLock;
+            zombies=zombie_list;
+            zombie_list=NULL;
+        }
+        if(zombies==NULL) return;
+        Scheduler::PKremoveDeadThreads(zombies);
+    }
+    //Once removed from the scheduler the threads can't be reached anymore,
+    //so there is no need to keep the kernel paused while freeing memory
+    while(zombies!=NULL)
+    {
+        Thread *d=zombies;
+        zombies=zombies->zombieNext;
+        //Call destructor manually because of placement new
+        void *base=d->watermark;
+        d->~Thread();
+        deallocateMemory(base); //Delete ALL thread memory
+    }
+}
+
 #ifdef WITH_PROCESSES
 
 miosix_private::SyscallParameters Thread::switchToUserspace()
@@ -709,7 +854,7 @@ Thread *Thread::createUserspace(void *(*startfunc)(void *), void *argv,
         thread->userCtxsave=new unsigned int[CTXSAVE_SIZE];
     } catch(std::bad_alloc&) {
         thread->~Thread();
-        free(base); //Delete ALL thread memory
+        deallocateMemory(base); //Delete ALL thread memory
         return NULL;//Error
     }
     
@@ -725,7 +870,7 @@ Thread *Thread::createUserspace(void *(*startfunc)(void *), void *argv,
             //Reached limit on number of threads
             base=thread->watermark;
             thread->~Thread();
-            free(base); //Delete ALL thread memory
+            deallocateMemory(base); //Delete ALL thread memory
             return NULL;
         }
     }
@@ -744,9 +889,10 @@ void Thread::setupUserspaceContext(unsigned int entry, unsigned int *gotBase,
 #endif //WITH_PROCESSES
 
 Thread::Thread(unsigned int *watermark, unsigned int stacksize,
-               bool defaultReent) : schedData(), flags(), savedPriority(0),
-               mutexLocked(0), mutexWaiting(0), watermark(watermark),
-               ctxsave(), stacksize(stacksize), cReent(defaultReent), cppReent()
+               bool defaultReent) : schedData(), flags(this), savedPriority(0),
+               mutexLocked(0), mutexWaiting(0), mutexWaitingNext(0),
+               watermark(watermark), ctxsave(), stacksize(stacksize),
+               zombieNext(0), cReent(defaultReent), cppReent()
 {
     joinData.waitingForJoin=NULL;
     #ifdef WITH_PROCESSES
@@ -769,31 +915,37 @@ Thread::~Thread()
 void Thread::ThreadFlags::IRQsetWait(bool waiting)
 {
     if(waiting) flags |= WAIT; else flags &= ~WAIT;
-    Scheduler::IRQwaitStatusHook();
+    Scheduler::IRQwaitStatusHook(t);
 }
 
 void Thread::ThreadFlags::IRQsetJoinWait(bool waiting)
 {
     if(waiting) flags |= WAIT_JOIN; else flags &= ~WAIT_JOIN;
-    Scheduler::IRQwaitStatusHook();
+    Scheduler::IRQwaitStatusHook(t);
 }
 
 void Thread::ThreadFlags::IRQsetCondWait(bool waiting)
 {
     if(waiting) flags |= WAIT_COND; else flags &= ~WAIT_COND;
-    Scheduler::IRQwaitStatusHook();
+    Scheduler::IRQwaitStatusHook(t);
 }
 
 void Thread::ThreadFlags::IRQsetSleep(bool sleeping)
 {
     if(sleeping) flags |= SLEEP; else flags &= ~SLEEP;
-    Scheduler::IRQwaitStatusHook();
+    Scheduler::IRQwaitStatusHook(t);
+}
+
+void Thread::ThreadFlags::IRQtimeout()
+{
+    flags &= ~(WAIT | WAIT_COND);
+    Scheduler::IRQwaitStatusHook(t);
 }
 
 void Thread::ThreadFlags::IRQsetDeleted()
 {
     flags |= DELETED;
-    Scheduler::IRQwaitStatusHook();
+    Scheduler::IRQwaitStatusHook(t);
 }
 
 } //namespace miosix
@@ -398,6 +398,15 @@ class ConditionVariable;
 class ProcessBase;
 #endif //WITH_PROCESSES
 
+/**
+ * Return value of timed wait functions
+ */
+enum class TimedWaitResult
+{
+    NoTimeout, ///< The wait ended before the timeout
+    Timeout    ///< The wait ended because the timeout expired
+};
+
 /**
  * This class represents a thread. It has methods for creating, deleting and
  * handling threads.<br>It has private constructor and destructor, since memory
@@ -661,6 +670,28 @@ public:
      */
     static void IRQwait();
 
+    /**
+     * Same as IRQwait(), but the thread is also woken up when the kernel tick
+     * reaches absoluteTime. Differently from IRQwait(), this function also
+     * enables back interrupts, yields and returns when the thread has been
+     * woken up, with interrupts disabled again. As with IRQwait(), the caller
+     * must check the condition it is waiting for, as the thread may be woken
+     * by an unrelated call to wakeup().
+     *
+     * \code
+     * FastInterruptDisableLock dLock;
+     * while(!condition)
+     *     if(Thread::IRQenableIrqAndTimedWait(dLock,timeout)
+     *         ==TimedWaitResult::Timeout) break;
+     * \endcode
+     * \param dLock the lock that disabled interrupts
+     * \param absoluteTime absolute time in ticks after which the wait times out
+     * \return TimedWaitResult::Timeout if the wakeup was caused by the timeout,
+     * which includes the case of absoluteTime being already in the past
+     */
+    static TimedWaitResult IRQenableIrqAndTimedWait(
+            FastInterruptDisableLock& dLock, long long absoluteTime);
+
     /**
      * Same as wakeup(), but is meant to be used only inside an IRQ or when
      * interrupts are disabled.
@@ -724,8 +755,10 @@ private:
     public:
         /**
          * Constructor, sets flags to default.
+         * \param t thread to which these flags belong, passed to the
+         * scheduler when the thread changes its running status
          */
-        ThreadFlags() : flags(0) {}
+        ThreadFlags(Thread *t) : t(t), flags(0) {}
 
         /**
          * Set the wait flag of the thread.
@@ -755,6 +788,13 @@ private:
          */
         void IRQsetSleep(bool sleeping);
 
+        /**
+         * Clear both the wait and wait_cond flags of the thread, used when
+         * the timeout of a timed wait expires.
+         * Can only be called with interrupts disabled or within an interrupt.
+         */
+        void IRQtimeout();
+
         /**
          * Set the deleted flag of the thread. This flag can't be cleared.
          * Can only be called with interrupts disabled or within an interrupt.
@@ -869,6 +909,7 @@ private:
         ///\internal Thread is running in userspace
         static const unsigned int USERSPACE=1<<7;
 
+        Thread *t;///<\internal Thread to which these flags belong
         unsigned short flags;///<\internal flags are stored here
     };
     
@@ -944,6 +985,36 @@ private:
      */
     static void threadLauncher(void *(*threadfunc)(void*), void *argv);
 
+    /**
+     * \param stacksize stack size of a thread
+     * \return the size of the memory holding the watermark, the stack and the
+     * Thread object of a thread with the given stack size
+     */
+    static unsigned int memorySize(unsigned int stacksize);
+
+    /**
+     * Deallocate the memory of a thread, whose destructor has already been
+     * called
+     * \param base pointer to the memory of the thread, that is its watermark
+     */
+    static void deallocateMemory(void *base);
+
+    /**
+     * Add a thread that is deleted and detached to the zombie list, so that
+     * its memory will be deallocated by reclaimZombies().
+     * Must be called with interrupts disabled, and at most once per thread.
+     * \param thread thread to add
+     */
+    static void IRQaddToZombieList(Thread *thread);
+
+    /**
+     * Remove all threads in the zombie list from the scheduler and deallocate
+     * their memory. The time taken only depends on the number of zombie
+     * threads, not on the total number of threads.
+     * Must be called with interrupts enabled and the kernel not paused.
+     */
+    static void reclaimZombies();
+
     //Thread data
     SchedulerData schedData; ///< Scheduler data, only used by class Scheduler
     ThreadFlags flags;///< thread status
@@ -956,9 +1027,14 @@ private:
     Mutex *mutexLocked;
     ///If the thread is waiting on a Mutex, mutexWaiting points to that Mutex
     Mutex *mutexWaiting;
+    ///Next thread in the waiting list of the Mutex the thread is waiting on
+    Thread *mutexWaitingNext;
     unsigned int *watermark;///< pointer to watermark area
     unsigned int ctxsave[CTXSAVE_SIZE];///< Holds cpu registers during ctxswitch
     unsigned int stacksize;///< Contains stack size
+    ///Next thread in the zombie list, relevant only once the thread is both
+    ///deleted and detached
+    Thread *zombieNext;
     ///This union is used to join threads. When the thread to join has not yet
     ///terminated and no other thread called join it contains (Thread *)NULL,
     ///when a thread calls join on this thread it contains the thread waiting
@@ -1007,9 +1083,14 @@ private:
     //Needs access to flags
     friend int ::pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
     //Needs access to flags
+    friend int ::pthread_cond_timedwait(pthread_cond_t *cond,
+            pthread_mutex_t *mutex, const struct timespec *abstime);
+    //Needs access to flags
     friend int ::pthread_cond_signal(pthread_cond_t *cond);
     //Needs access to flags
     friend int ::pthread_cond_broadcast(pthread_cond_t *cond);
+    //Needs access to memorySize()
+    friend class ThreadPool;
     //Needs access to cReent
     friend class CReentrancyAccessor;
     //Needs access to cppReent
@@ -1042,7 +1123,8 @@ public:
 /**
  * \internal
  * \struct Sleep_data
- * This struct is used to make a list of sleeping threads.
+ * This struct is used to make a heap of sleeping threads, sorted by wakeup
+ * time (see pairing_heap.h).
  * It is used by the kernel, and should not be used by end users.
  */
 struct SleepData
@@ -1054,9 +1136,33 @@ struct SleepData
     ///the thread will wake
     long long wakeup_time;
     
-    SleepData *next;///<\internal Next thread in the list
+    SleepData *child;  ///<\internal First child in the heap
+    SleepData *sibling;///<\internal Next sibling in the heap
+    SleepData *prev;   ///<\internal Parent if first child, else prev sibling
 };
 
+/**
+ * \internal
+ * Used to implement timed waits, adds a thread to the sleeping list without
+ * setting its sleep flag. The thread is expected to be already waiting (wait
+ * or wait_cond flag set). If the wakeup time is reached, the wait and
+ * wait_cond flags are cleared and x->p is set to NULL.
+ * Must be called with interrupts disabled.
+ * \param x sleep data, has to stay in scope until
+ * IRQremoveTimeoutFromSleepingList() is called
+ */
+void IRQaddTimeoutToSleepingList(SleepData *x);
+
+/**
+ * \internal
+ * Must be called when the thread that called IRQaddTimeoutToSleepingList()
+ * is woken up, to remove it from the sleeping list if the wakeup happened
+ * before the timeout. Must be called with interrupts disabled.
+ * \param x the same sleep data passed to IRQaddTimeoutToSleepingList()
+ * \return true if the timeout expired
+ */
+bool IRQremoveTimeoutFromSleepingList(SleepData *x);
+
 /**
  * \}
  */
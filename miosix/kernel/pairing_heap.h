@@ -0,0 +1,166 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef PAIRING_HEAP_H
+#define PAIRING_HEAP_H
+
+#include <cstddef>
+
+/**
+ * \internal
+ * \file pairing_heap.h
+ * An intrusive min pairing heap, used by the kernel to keep sleeping threads
+ * sorted by wakeup time. Insertion is O(1), finding the minimum is O(1) and
+ * removing the minimum or an arbitrary node is O(log n) amortized, as opposed to
+ * a sorted list where insertion is O(n).
+ *
+ * The heap does not allocate memory, the nodes are provided by the caller and
+ * the heap is referred to through a pointer to its root node, which is NULL
+ * when the heap is empty. This allows the root to be a plain global pointer.
+ * The node type T must have these public fields:
+ * - long long wakeup_time, the key
+ * - T *child, first child of this node
+ * - T *sibling, next sibling of this node
+ * - T *prev, parent node if this is the first child, else previous sibling
+ *
+ * This file has no dependencies on the rest of the kernel, so that it can be
+ * tested on a host machine.
+ */
+
+namespace miosix {
+
+/**
+ * \internal
+ * Meld two heaps, either of which can be empty
+ * \param a root of the first heap, its sibling field must be NULL
+ * \param b root of the second heap, its sibling field must be NULL
+ * \return the root of the melded heap
+ */
+template<typename T>
+inline T *pairingHeapMeld(T *a, T *b)
+{
+    if(a==NULL) return b;
+    if(b==NULL) return a;
+    if(b->wakeup_time<a->wakeup_time)
+    {
+        T *temp=a;
+        a=b;
+        b=temp;
+    }
+    b->sibling=a->child;
+    if(a->child) a->child->prev=b;
+    b->prev=a;
+    a->child=b;
+    return a;
+}
+
+/**
+ * \internal
+ * Insert a node in the heap
+ * \param root pointer to the root of the heap, will be updated
+ * \param x node to insert, must not be already in a heap
+ */
+template<typename T>
+inline void pairingHeapInsert(T *& root, T *x)
+{
+    x->child=NULL;
+    x->sibling=NULL;
+    x->prev=NULL;
+    root=pairingHeapMeld(root,x);
+}
+
+/**
+ * \internal
+ * Remove the node with the lowest wakeup_time from the heap
+ * \param root pointer to the root of the heap, will be updated. Must not be
+ * an empty heap
+ * \return the removed node, which was the root of the heap
+ */
+template<typename T>
+T *pairingHeapRemoveMin(T *& root)
+{
+    T *result=root;
+    //Two pass pairing. First pass, left to right, meld children in pairs and
+    //link the resulting heaps in reverse order through the sibling field
+    T *first=result->child;
+    T *pairs=NULL;
+    while(first!=NULL)
+    {
+        T *a=first;
+        T *b=a->sibling;
+        if(b!=NULL)
+        {
+            first=b->sibling;
+            b->sibling=NULL;
+        } else first=NULL;
+        a->sibling=NULL;
+        T *m=pairingHeapMeld(a,b);
+        m->sibling=pairs;
+        pairs=m;
+    }
+    //Second pass, right to left, meld everything in a single heap
+    T *newRoot=NULL;
+    while(pairs!=NULL)
+    {
+        T *next=pairs->sibling;
+        pairs->sibling=NULL;
+        newRoot=pairingHeapMeld(newRoot,pairs);
+        pairs=next;
+    }
+    if(newRoot) newRoot->prev=NULL;
+    root=newRoot;
+    return result;
+}
+
+/**
+ * \internal
+ * Remove an arbitrary node from the heap
+ * \param root pointer to the root of the heap, will be updated
+ * \param x node to remove, must be in the heap
+ */
+template<typename T>
+void pairingHeapRemove(T *& root, T *x)
+{
+    if(x==root)
+    {
+        pairingHeapRemoveMin(root);
+        return;
+    }
+    //Detach the subtree rooted at x, then meld its children back in the heap
+    if(x->prev->child==x) x->prev->child=x->sibling;
+    else x->prev->sibling=x->sibling;
+    if(x->sibling) x->sibling->prev=x->prev;
+    x->sibling=NULL;
+    x->prev=NULL;
+    T *subtree=x;
+    pairingHeapRemoveMin(subtree);
+    root=pairingHeapMeld(root,subtree);
+}
+
+} //namespace miosix
+
+#endif //PAIRING_HEAP_H
@@ -264,239 +264,307 @@ void *Process::start(void *argv)
 }
 
 bool Process::handleSvc(miosix_private::SyscallParameters sp)
+{
+    int id=sp.getSyscallId();
+    switch(id)
+    {
+        case SYS_EXIT:
+            exitCode=(sp.getFirstParameter() & 0xff)<<8;
+            return false;
+        case SYS_BATCH:
+            sp.setReturnValue(sysBatch(sp.getFirstParameter(),
+                sp.getSecondParameter()));
+            return true;
+        default:
+            break;
+    }
+    SyscallHandler handler=lookupSyscall(id);
+    if(handler==0)
+    {
+        exitCode=SIGSYS; //Bad syscall
+        #ifdef WITH_ERRLOG
+        iprintf("Unexpected syscall number %d\n",id);
+        #endif //WITH_ERRLOG
+        return false;
+    }
+    sp.setReturnValue(dispatch(handler,sp.getFirstParameter(),
+        sp.getSecondParameter(),sp.getThirdParameter()));
+    return true;
+}
+
+const Process::SyscallHandler Process::syscallTable[]=
+{
+    0,                  //SYS_YIELD, handled by the kernel
+    0,                  //SYS_USERSPACE, handled by the kernel
+    0,                  //SYS_EXIT, handled in handleSvc
+    &Process::sysWrite,
+    &Process::sysRead,
+    &Process::sysUsleep,
+    &Process::sysOpen,
+    &Process::sysClose,
+    &Process::sysLseek,
+    &Process::sysSystem,
+    &Process::sysFstat,
+    &Process::sysIsatty,
+    &Process::sysStat,
+    &Process::sysLstat,
+    &Process::sysFcntl,
+    &Process::sysIoctl,
+    &Process::sysGetdents,
+    &Process::sysGetcwd,
+    &Process::sysChdir,
+    &Process::sysMkdir,
+    &Process::sysRmdir,
+    &Process::sysUnlink,
+    &Process::sysRename,
+    &Process::sysReadv,
+    &Process::sysWritev,
+    &Process::sysPread,
+    &Process::sysPwrite
+};
+
+Process::SyscallHandler Process::lookupSyscall(int id)
+{
+    const int numSyscalls=sizeof(syscallTable)/sizeof(syscallTable[0]);
+    //SYS_BATCH is the last syscall, and is handled in handleSvc
+    static_assert(numSyscalls==SYS_BATCH,"syscallTable out of sync with Syscalls");
+    if(id<0 || id>=numSyscalls) return 0;
+    return syscallTable[id];
+}
+
+int Process::dispatch(SyscallHandler handler, unsigned int a, unsigned int b,
+        unsigned int c)
 {
     try {
-        switch(sp.getSyscallId())
+        return (this->*handler)(a,b,c);
+    } catch(exception& e) {
+        return -ENOMEM;
+    }
+}
+
+int Process::sysBatch(unsigned int a, unsigned int b)
+{
+    SyscallBatchEntry *ops=reinterpret_cast<SyscallBatchEntry*>(a);
+    int count=b;
+    if(count<0 || count>maxBatchSize) return -EINVAL;
+    //Unaligned accesses to the array would fault in the kernel
+    if(a & 3) return -EFAULT;
+    //Results are written back in the array, so it must be writable
+    if(!mpu.withinForWriting(ops,count*sizeof(SyscallBatchEntry)))
+        return -EFAULT;
+    for(int i=0;i<count;i++)
+    {
+        //Copy the entry, or the process could change it while it is executed
+        SyscallBatchEntry op=ops[i];
+        SyscallHandler handler=lookupSyscall(op.id);
+        if(handler==0)
         {
-            case SYS_EXIT:
-            {
-                exitCode=(sp.getFirstParameter() & 0xff)<<8;
-                return false;
-            }
-            case SYS_WRITE:
-            {
-                int fd=sp.getFirstParameter();
-                void *ptr=reinterpret_cast<void*>(sp.getSecondParameter());
-                size_t size=sp.getThirdParameter();
-                if(mpu.withinForReading(ptr,size))
-                {
-                    ssize_t result=fileTable.write(fd,ptr,size);
-                    sp.setReturnValue(result);
-                } else sp.setReturnValue(-EFAULT);
-                break;
-            }
-            case SYS_READ:
-            {
-                int fd=sp.getFirstParameter();
-                void *ptr=reinterpret_cast<void*>(sp.getSecondParameter());
-                size_t size=sp.getThirdParameter();
-                if(mpu.withinForWriting(ptr,size))
-                {
-                    ssize_t result=fileTable.read(fd,ptr,size);
-                    sp.setReturnValue(result);
-                } else sp.setReturnValue(-EFAULT);
-                break;
-            }
-            case SYS_USLEEP:
-            {
-                sp.setReturnValue(usleep(sp.getFirstParameter()));
-                break;
-            }
-            case SYS_OPEN:
-            {
-                const char *str;
-                str=reinterpret_cast<const char*>(sp.getFirstParameter());
-                int flags=sp.getSecondParameter();
-                if(mpu.withinForReading(str))
-                {
-                    int fd=fileTable.open(str,flags,
-                        (flags & O_CREAT) ? sp.getThirdParameter() : 0);
-                    sp.setReturnValue(fd);
-                } else sp.setReturnValue(-EFAULT);
-                break;
-            }
-            case SYS_CLOSE:
-            {
-                int result=fileTable.close(sp.getFirstParameter());
-                sp.setReturnValue(result);
-                break;
-            }
-            case SYS_LSEEK:
-            {
-                //FIXME: need to pass and return a 64 bit parameter,
-                //now it is truncated to 32 bit but this is wrong
-                off_t result=fileTable.lseek(sp.getFirstParameter(),
-                    sp.getSecondParameter(),sp.getThirdParameter());
-                sp.setReturnValue(result);
-                break;
-            }
-            case SYS_SYSTEM:
-            {
-                const char *str;
-                str=reinterpret_cast<const char*>(sp.getFirstParameter());
-                if(mpu.withinForReading(str))
-                {
-                    std::pair<const unsigned int*,unsigned int> res;
-                    res=SystemMap::instance().getElfProgram(str);
-                    if(res.first==0 || res.second==0)
-                    {
-                        sp.setReturnValue(-1);
-                    } else {
-                        ElfProgram program(res.first,res.second);
-                        int ret=0;
-                        pid_t child=Process::create(program);
-                        Process::waitpid(child,&ret,0);
-                        sp.setReturnValue(WEXITSTATUS(ret));
-                    }
-                } else sp.setReturnValue(-EFAULT);
-                break;
-            }
-            case SYS_FSTAT:
-            {
-                struct stat *pstat;
-                pstat=reinterpret_cast<struct stat*>(sp.getSecondParameter());
-                if(mpu.withinForWriting(pstat,sizeof(struct stat)))
-                {
-                    int result=fileTable.fstat(sp.getFirstParameter(),pstat);
-                    sp.setReturnValue(result);
-                } else sp.setReturnValue(-EFAULT);
-                break;
-            }
-            case SYS_ISATTY:
-            {
-                int result=fileTable.isatty(sp.getFirstParameter());
-                sp.setReturnValue(result);
-                break;
-            }
-            case SYS_STAT:
-            {
-                const char *str;
-                str=reinterpret_cast<const char*>(sp.getFirstParameter());
-                struct stat *pstat;
-                pstat=reinterpret_cast<struct stat*>(sp.getSecondParameter());
-                if(mpu.withinForReading(str) &&
-                   mpu.withinForWriting(pstat,sizeof(struct stat)))
-                {
-                    int result=fileTable.stat(str,pstat);
-                    sp.setReturnValue(result);
-                } else sp.setReturnValue(-EFAULT);
-            }
-            case SYS_LSTAT:
-            {
-                const char *str;
-                str=reinterpret_cast<const char*>(sp.getFirstParameter());
-                struct stat *pstat;
-                pstat=reinterpret_cast<struct stat*>(sp.getSecondParameter());
-                if(mpu.withinForReading(str) &&
-                   mpu.withinForWriting(pstat,sizeof(struct stat)))
-                {
-                    int result=fileTable.lstat(str,pstat);
-                    sp.setReturnValue(result);
-                } else sp.setReturnValue(-EFAULT);
-            }
-            case SYS_FCNTL:
-            {
-                int result=fileTable.fcntl(sp.getFirstParameter(),
-                    sp.getSecondParameter(),sp.getThirdParameter());
-                sp.setReturnValue(result);
-                break;
-            }
-            case SYS_IOCTL:
-            {
-                //TODO: need a way to validate ARG
-                break;
-            }
-            case SYS_GETDENTS:
-            {
-                int fd=sp.getFirstParameter();
-                void *ptr=reinterpret_cast<void*>(sp.getSecondParameter());
-                size_t size=sp.getThirdParameter();
-                if(mpu.withinForWriting(ptr,size))
-                {
-                    int result=fileTable.getdents(fd,ptr,size);
-                    sp.setReturnValue(result);
-                } else sp.setReturnValue(-EFAULT);
-                break;
-            }
-            case SYS_GETCWD:
-            {
-                char *buf=reinterpret_cast<char*>(sp.getFirstParameter());
-                size_t size=sp.getSecondParameter();
-                if(mpu.withinForWriting(buf,size))
-                {
-                    int result=fileTable.getcwd(buf,size);
-                    sp.setReturnValue(result);
-                } else sp.setReturnValue(-EFAULT);
-                break;
-            }
-            case SYS_CHDIR:
-            {
-                const char *str;
-                str=reinterpret_cast<const char*>(sp.getFirstParameter());
-                if(mpu.withinForReading(str))
-                {
-                    int result=fileTable.chdir(str);
-                    sp.setReturnValue(result);
-                } else sp.setReturnValue(-EFAULT);
-                break;
-            }
-            case SYS_MKDIR:
-            {
-                const char *str;
-                str=reinterpret_cast<const char*>(sp.getFirstParameter());
-                if(mpu.withinForReading(str))
-                {
-                    int result=fileTable.mkdir(str,sp.getSecondParameter());
-                    sp.setReturnValue(result);
-                } else sp.setReturnValue(-EFAULT);
-                break;
-            }
-            case SYS_RMDIR:
-            {
-                const char *str;
-                str=reinterpret_cast<const char*>(sp.getFirstParameter());
-                if(mpu.withinForReading(str))
-                {
-                    int result=fileTable.rmdir(str);
-                    sp.setReturnValue(result);
-                } else sp.setReturnValue(-EFAULT);
-                break;
-            }
-            case SYS_UNLINK:
-            {
-                const char *str;
-                str=reinterpret_cast<const char*>(sp.getFirstParameter());
-                if(mpu.withinForReading(str))
-                {
-                    int result=fileTable.unlink(str);
-                    sp.setReturnValue(result);
-                } else sp.setReturnValue(-EFAULT);
-                break;
-            }
-            case SYS_RENAME:
-            {
-                const char *oldName, *newName;
-                oldName=reinterpret_cast<const char*>(sp.getFirstParameter());
-                newName=reinterpret_cast<const char*>(sp.getSecondParameter());
-                if(mpu.withinForReading(oldName) &&
-                   mpu.withinForReading(newName))
-                {
-                    int result=fileTable.rename(oldName,newName);
-                    sp.setReturnValue(result);
-                } else sp.setReturnValue(-EFAULT);
-                break;
-            }
-            default:
-                exitCode=SIGSYS; //Bad syscall
-                #ifdef WITH_ERRLOG
-                iprintf("Unexpected syscall number %d\n",sp.getSyscallId());
-                #endif //WITH_ERRLOG
-                return false;
+            //Exit and nested batches are not allowed, stop here
+            ops[i].result=-ENOSYS;
+            return i;
         }
-    } catch(exception& e) {
-        sp.setReturnValue(-ENOMEM);
+        ops[i].result=dispatch(handler,op.params[0],op.params[1],op.params[2]);
+        if(Thread::testTerminate()) return i+1;
     }
-    return true;
+    return count;
+}
+
+int Process::sysWrite(unsigned int a, unsigned int b, unsigned int c)
+{
+    void *ptr=reinterpret_cast<void*>(b);
+    if(!mpu.withinForReading(ptr,c)) return -EFAULT;
+    return fileTable.write(a,ptr,c);
+}
+
+int Process::sysRead(unsigned int a, unsigned int b, unsigned int c)
+{
+    void *ptr=reinterpret_cast<void*>(b);
+    if(!mpu.withinForWriting(ptr,c)) return -EFAULT;
+    return fileTable.read(a,ptr,c);
+}
+
+int Process::sysUsleep(unsigned int a, unsigned int, unsigned int)
+{
+    return usleep(a);
+}
+
+int Process::sysOpen(unsigned int a, unsigned int b, unsigned int c)
+{
+    const char *str=reinterpret_cast<const char*>(a);
+    int flags=b;
+    if(!mpu.withinForReading(str)) return -EFAULT;
+    return fileTable.open(str,flags,(flags & O_CREAT) ? c : 0);
+}
+
+int Process::sysClose(unsigned int a, unsigned int, unsigned int)
+{
+    return fileTable.close(a);
+}
+
+int Process::sysLseek(unsigned int a, unsigned int b, unsigned int c)
+{
+    //FIXME: need to pass and return a 64 bit parameter,
+    //now it is truncated to 32 bit but this is wrong
+    return fileTable.lseek(a,static_cast<int>(b),c);
+}
+
+int Process::sysSystem(unsigned int a, unsigned int, unsigned int)
+{
+    const char *str=reinterpret_cast<const char*>(a);
+    if(!mpu.withinForReading(str)) return -EFAULT;
+    //The program has already been validated when added to the SystemMap
+    const ElfProgram *program=SystemMap::instance().getProgram(str);
+    if(program==0) return -1;
+    int ret=0;
+    pid_t child=Process::create(*program);
+    Process::waitpid(child,&ret,0);
+    return WEXITSTATUS(ret);
+}
+
+int Process::sysFstat(unsigned int a, unsigned int b, unsigned int)
+{
+    struct stat *pstat=reinterpret_cast<struct stat*>(b);
+    if(!mpu.withinForWriting(pstat,sizeof(struct stat))) return -EFAULT;
+    return fileTable.fstat(a,pstat);
+}
+
+int Process::sysIsatty(unsigned int a, unsigned int, unsigned int)
+{
+    return fileTable.isatty(a);
+}
+
+int Process::sysStat(unsigned int a, unsigned int b, unsigned int)
+{
+    const char *str=reinterpret_cast<const char*>(a);
+    struct stat *pstat=reinterpret_cast<struct stat*>(b);
+    if(!mpu.withinForReading(str) ||
+       !mpu.withinForWriting(pstat,sizeof(struct stat))) return -EFAULT;
+    return fileTable.stat(str,pstat);
+}
+
+int Process::sysLstat(unsigned int a, unsigned int b, unsigned int)
+{
+    const char *str=reinterpret_cast<const char*>(a);
+    struct stat *pstat=reinterpret_cast<struct stat*>(b);
+    if(!mpu.withinForReading(str) ||
+       !mpu.withinForWriting(pstat,sizeof(struct stat))) return -EFAULT;
+    return fileTable.lstat(str,pstat);
+}
+
+int Process::sysFcntl(unsigned int a, unsigned int b, unsigned int c)
+{
+    return fileTable.fcntl(a,b,c);
+}
+
+int Process::sysIoctl(unsigned int, unsigned int, unsigned int)
+{
+    //TODO: need a way to validate ARG
+    return -EFAULT;
+}
+
+int Process::sysGetdents(unsigned int a, unsigned int b, unsigned int c)
+{
+    void *ptr=reinterpret_cast<void*>(b);
+    if(!mpu.withinForWriting(ptr,c)) return -EFAULT;
+    return fileTable.getdents(a,ptr,c);
+}
+
+int Process::sysGetcwd(unsigned int a, unsigned int b, unsigned int)
+{
+    char *buf=reinterpret_cast<char*>(a);
+    if(!mpu.withinForWriting(buf,b)) return -EFAULT;
+    return fileTable.getcwd(buf,b);
+}
+
+int Process::sysChdir(unsigned int a, unsigned int, unsigned int)
+{
+    const char *str=reinterpret_cast<const char*>(a);
+    if(!mpu.withinForReading(str)) return -EFAULT;
+    return fileTable.chdir(str);
+}
+
+int Process::sysMkdir(unsigned int a, unsigned int b, unsigned int)
+{
+    const char *str=reinterpret_cast<const char*>(a);
+    if(!mpu.withinForReading(str)) return -EFAULT;
+    return fileTable.mkdir(str,b);
+}
+
+int Process::sysRmdir(unsigned int a, unsigned int, unsigned int)
+{
+    const char *str=reinterpret_cast<const char*>(a);
+    if(!mpu.withinForReading(str)) return -EFAULT;
+    return fileTable.rmdir(str);
+}
+
+int Process::sysUnlink(unsigned int a, unsigned int, unsigned int)
+{
+    const char *str=reinterpret_cast<const char*>(a);
+    if(!mpu.withinForReading(str)) return -EFAULT;
+    return fileTable.unlink(str);
+}
+
+int Process::sysRename(unsigned int a, unsigned int b, unsigned int)
+{
+    const char *oldName=reinterpret_cast<const char*>(a);
+    const char *newName=reinterpret_cast<const char*>(b);
+    if(!mpu.withinForReading(oldName) ||
+       !mpu.withinForReading(newName)) return -EFAULT;
+    return fileTable.rename(oldName,newName);
+}
+
+int Process::sysReadv(unsigned int a, unsigned int b, unsigned int c)
+{
+    return vectorIo(true,a,b,c);
+}
+
+int Process::sysWritev(unsigned int a, unsigned int b, unsigned int c)
+{
+    return vectorIo(false,a,b,c);
+}
+
+int Process::vectorIo(bool isRead, int fd, unsigned int uiovPtr, int iovcnt)
+{
+    const struct iovec *uiov=reinterpret_cast<const struct iovec*>(uiovPtr);
+    if(iovcnt<0 || iovcnt>IOV_MAX) return -EINVAL;
+    //Unaligned accesses to the array would fault in the kernel
+    if(uiovPtr & 3) return -EFAULT;
+    if(!mpu.withinForReading(uiov,iovcnt*sizeof(struct iovec))) return -EFAULT;
+    //Copy the array, or the process could change it after the
+    //buffers have been validated
+    struct iovec iov[IOV_MAX];
+    memcpy(iov,uiov,iovcnt*sizeof(struct iovec));
+    for(int i=0;i<iovcnt;i++)
+    {
+        bool valid;
+        if(isRead) valid=mpu.withinForWriting(iov[i].iov_base,iov[i].iov_len);
+        else valid=mpu.withinForReading(iov[i].iov_base,iov[i].iov_len);
+        if(!valid) return -EFAULT;
+    }
+    if(isRead) return fileTable.readv(fd,iov,iovcnt);
+    else return fileTable.writev(fd,iov,iovcnt);
+}
+
+int Process::sysPread(unsigned int a, unsigned int b, unsigned int c)
+{
+    const struct iovec *uiov=reinterpret_cast<const struct iovec*>(b);
+    if((b & 3) || !mpu.withinForReading(uiov,sizeof(struct iovec)))
+        return -EFAULT;
+    struct iovec iov=*uiov;
+    if(!mpu.withinForWriting(iov.iov_base,iov.iov_len)) return -EFAULT;
+    //FIXME: the offset is truncated to 32 bit, as for lseek
+    return fileTable.pread(a,iov.iov_base,iov.iov_len,static_cast<int>(c));
+}
+
+int Process::sysPwrite(unsigned int a, unsigned int b, unsigned int c)
+{
+    const struct iovec *uiov=reinterpret_cast<const struct iovec*>(b);
+    if((b & 3) || !mpu.withinForReading(uiov,sizeof(struct iovec)))
+        return -EFAULT;
+    struct iovec iov=*uiov;
+    if(!mpu.withinForReading(iov.iov_base,iov.iov_len)) return -EFAULT;
+    //FIXME: the offset is truncated to 32 bit, as for lseek
+    return fileTable.pwrite(a,iov.iov_base,iov.iov_len,static_cast<int>(c));
 }
 
 pid_t Process::getNewPid()
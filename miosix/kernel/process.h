@@ -80,7 +80,32 @@ enum Syscalls
     SYS_MKDIR=19,
     SYS_RMDIR=20,
     SYS_UNLINK=21,
-    SYS_RENAME=22
+    SYS_RENAME=22,
+    // Scatter-gather and positional I/O. Since SVCs take at most three
+    // parameters, pread/pwrite take a pointer to a single struct iovec with
+    // the buffer, and the offset is truncated to 32 bit, as for lseek
+    SYS_READV=23,
+    SYS_WRITEV=24,
+    SYS_PREAD=25,
+    SYS_PWRITE=26,
+    // Batched syscalls. Takes a pointer to an array of SyscallBatchEntry and
+    // the number of entries (at most 16), executes them in order writing each
+    // result in the entry, and returns the number of executed entries. Allows
+    // a process to perform many small I/O operations with a single SVC. The
+    // batch stops at the first entry that is not an allowed syscall, such as
+    // SYS_EXIT or a nested SYS_BATCH, whose result is set to -ENOSYS
+    SYS_BATCH=27
+};
+
+/**
+ * An entry of the array passed to SYS_BATCH. This struct is part of the
+ * userspace ABI, so its layout must not be changed
+ */
+struct SyscallBatchEntry
+{
+    int id;                  ///< Syscall number
+    unsigned int params[3];  ///< Syscall parameters
+    int result;              ///< Syscall return value, written by the kernel
 };
 
 //Forware decl
@@ -190,6 +215,75 @@ private:
      */
     bool handleSvc(miosix_private::SyscallParameters sp);
     
+    /**
+     * A syscall implementation. Takes the three syscall parameters, whose
+     * meaning depends on the syscall, and returns the syscall return value
+     */
+    typedef int (Process::*SyscallHandler)(unsigned int a, unsigned int b,
+                                           unsigned int c);
+    
+    /**
+     * \param id syscall number
+     * \return the syscall implementation, or null if the syscall number is
+     * not valid or the syscall can't be handled through the syscall table
+     */
+    static SyscallHandler lookupSyscall(int id);
+    
+    /**
+     * Call a syscall implementation, converting exceptions to -ENOMEM
+     * \param handler syscall implementation
+     * \param a first syscall parameter
+     * \param b second syscall parameter
+     * \param c third syscall parameter
+     * \return the syscall return value
+     */
+    int dispatch(SyscallHandler handler, unsigned int a, unsigned int b,
+                 unsigned int c);
+    
+    /**
+     * Execute the syscalls in a SYS_BATCH array
+     * \param a pointer to the SyscallBatchEntry array in the process memory
+     * \param b number of entries
+     * \return the number of executed entries, or a negative error code
+     */
+    int sysBatch(unsigned int a, unsigned int b);
+    
+    /**
+     * Common code of readv and writev
+     */
+    int vectorIo(bool isRead, int fd, unsigned int uiovPtr, int iovcnt);
+    
+    //Syscall implementations, parameters are the same as the SVC ones
+    int sysWrite(unsigned int a, unsigned int b, unsigned int c);
+    int sysRead(unsigned int a, unsigned int b, unsigned int c);
+    int sysUsleep(unsigned int a, unsigned int b, unsigned int c);
+    int sysOpen(unsigned int a, unsigned int b, unsigned int c);
+    int sysClose(unsigned int a, unsigned int b, unsigned int c);
+    int sysLseek(unsigned int a, unsigned int b, unsigned int c);
+    int sysSystem(unsigned int a, unsigned int b, unsigned int c);
+    int sysFstat(unsigned int a, unsigned int b, unsigned int c);
+    int sysIsatty(unsigned int a, unsigned int b, unsigned int c);
+    int sysStat(unsigned int a, unsigned int b, unsigned int c);
+    int sysLstat(unsigned int a, unsigned int b, unsigned int c);
+    int sysFcntl(unsigned int a, unsigned int b, unsigned int c);
+    int sysIoctl(unsigned int a, unsigned int b, unsigned int c);
+    int sysGetdents(unsigned int a, unsigned int b, unsigned int c);
+    int sysGetcwd(unsigned int a, unsigned int b, unsigned int c);
+    int sysChdir(unsigned int a, unsigned int b, unsigned int c);
+    int sysMkdir(unsigned int a, unsigned int b, unsigned int c);
+    int sysRmdir(unsigned int a, unsigned int b, unsigned int c);
+    int sysUnlink(unsigned int a, unsigned int b, unsigned int c);
+    int sysRename(unsigned int a, unsigned int b, unsigned int c);
+    int sysReadv(unsigned int a, unsigned int b, unsigned int c);
+    int sysWritev(unsigned int a, unsigned int b, unsigned int c);
+    int sysPread(unsigned int a, unsigned int b, unsigned int c);
+    int sysPwrite(unsigned int a, unsigned int b, unsigned int c);
+    
+    ///Syscall implementations, indexed by syscall number
+    static const SyscallHandler syscallTable[];
+    ///Maximum number of entries in a SYS_BATCH array
+    static const int maxBatchSize=16;
+    
     /**
      * \return an unique pid that is not zero and is not already in use in the
      * system, used to assign a pid to a new process.<br>
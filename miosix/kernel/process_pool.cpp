@@ -29,6 +29,12 @@
 #include <stdexcept>
 #include <cstring>
 
+#ifdef TEST_ALLOC
+#include <vector>
+#include <cstdlib>
+#include <ctime>
+#endif //TEST_ALLOC
+
 using namespace std;
 
 #ifdef WITH_PROCESSES
@@ -46,7 +52,11 @@ ProcessPool& ProcessPool::instance()
         reinterpret_cast<unsigned int>(&_process_pool_start));
     return pool;
     #else //TEST_ALLOC
-    static ProcessPool pool(reinterpret_cast<unsigned int*>(0x20008000),96*1024);
+    //Same size and alignment as the process pool of the stm32f4discovery,
+    //but in host memory, as free blocks hold the free list pointers
+    static unsigned int poolMemory[96*1024/sizeof(unsigned int)]
+        __attribute__((aligned(32*1024)));
+    static ProcessPool pool(poolMemory,sizeof(poolMemory));
     return pool;
     #endif //TEST_ALLOC
 }
@@ -60,29 +70,24 @@ unsigned int *ProcessPool::allocate(unsigned int size)
     if((size & (size - 1)) || size>poolSize || size<blockSize)
             throw runtime_error("");
     
-    unsigned int offset=0;
-    if(reinterpret_cast<unsigned int>(poolBase) % size)
-        offset=size-(reinterpret_cast<unsigned int>(poolBase) % size);
-    unsigned int startBit=offset/blockSize;
-    unsigned int sizeBit=size/blockSize;
-
-    for(unsigned int i=startBit;i<=poolSize/blockSize;i+=sizeBit)
+    //Find the smallest free block that is large enough
+    unsigned int order=__builtin_ctz(size)-blockBits;
+    unsigned int i=order;
+    while(i<numOrders && freeLists[i]==0) i++;
+    if(i==numOrders) throw bad_alloc();
+    FreeBlock *block=freeLists[i];
+    removeFree(block,i);
+    
+    //Split it, putting the upper halves back in the free lists. Blocks are
+    //aligned to their size, and so are their halves
+    while(i>order)
     {
-        bool notEmpty=false;
-        for(unsigned int j=0;j<sizeBit;j++)
-        {
-            if(testBit(i+j)==0) continue;
-            notEmpty=true;
-            break;
-        }
-        if(notEmpty) continue;
-        
-        for(unsigned int j=0;j<sizeBit;j++) setBit(i+j);
-        unsigned int *result=poolBase+i*blockSize/sizeof(unsigned int);
-        allocatedBlocks[result]=size;
-        return result;
+        i--;
+        pushFree(reinterpret_cast<FreeBlock*>(
+            reinterpret_cast<char*>(block)+(blockSize<<i)),i);
     }
-    throw bad_alloc();
+    blockState[blockIndex(block)]=headFlag | order;
+    return reinterpret_cast<unsigned int*>(block);
 }
 
 void ProcessPool::deallocate(unsigned int *ptr)
@@ -90,39 +95,147 @@ void ProcessPool::deallocate(unsigned int *ptr)
     #ifndef TEST_ALLOC
     miosix::Lock<miosix::FastMutex> l(mutex);
     #endif //TEST_ALLOC
-    map<unsigned int*, unsigned int>::iterator it= allocatedBlocks.find(ptr);
-    if(it==allocatedBlocks.end())throw runtime_error("");
-    unsigned int size =(it->second)/blockSize;
-    unsigned int firstBit=(reinterpret_cast<unsigned int>(ptr)-
-                           reinterpret_cast<unsigned int>(poolBase))/blockSize;
-    for(unsigned int i=firstBit;i<firstBit+size;i++) clearBit(i);
-    allocatedBlocks.erase(it);
+    size_t start=reinterpret_cast<size_t>(poolBase);
+    size_t end=start+poolSize;
+    size_t addr=reinterpret_cast<size_t>(ptr);
+    if(addr<start || addr>=end || (addr-start) % blockSize)
+        throw runtime_error("");
+    unsigned int index=blockIndex(ptr);
+    if((blockState[index] & (headFlag | freeFlag))!=headFlag)
+        throw runtime_error("");
+    unsigned int order=blockState[index] & orderMask;
+    blockState[index]=0;
+    
+    //Merge with the buddy as long as it is free and of the same order
+    while(order+1<numOrders)
+    {
+        size_t buddy=addr ^ (static_cast<size_t>(blockSize)<<order);
+        if(buddy<start || buddy>=end) break;
+        if(blockState[blockIndex(reinterpret_cast<void*>(buddy))]!=
+            (headFlag | freeFlag | order)) break;
+        removeFree(reinterpret_cast<FreeBlock*>(buddy),order);
+        if(buddy<addr) addr=buddy;
+        order++;
+    }
+    pushFree(reinterpret_cast<FreeBlock*>(addr),order);
 }
 
 ProcessPool::ProcessPool(unsigned int *poolBase, unsigned int poolSize)
     : poolBase(poolBase), poolSize(poolSize)
 {
-    int numBytes=poolSize/blockSize/8;
-    bitmap=new unsigned int[numBytes/sizeof(unsigned int)];
-    memset(bitmap,0,numBytes);
+    unsigned int numBlocks=poolSize/blockSize;
+    blockState=new unsigned char[numBlocks];
+    memset(blockState,0,numBlocks);
+    for(unsigned int i=0;i<numOrders;i++) freeLists[i]=0;
+    
+    //The pool needs not be aligned to its size, so it is split in the
+    //largest blocks that are aligned to their size
+    size_t addr=reinterpret_cast<size_t>(poolBase);
+    size_t end=addr+numBlocks*blockSize;
+    while(addr<end)
+    {
+        unsigned int order=0;
+        while(order+1<numOrders)
+        {
+            size_t size=static_cast<size_t>(blockSize)<<(order+1);
+            if((addr & (size-1)) || addr+size>end) break;
+            order++;
+        }
+        pushFree(reinterpret_cast<FreeBlock*>(addr),order);
+        addr+=static_cast<size_t>(blockSize)<<order;
+    }
+}
+
+void ProcessPool::pushFree(FreeBlock *block, unsigned int order)
+{
+    block->prev=0;
+    block->next=freeLists[order];
+    if(block->next) block->next->prev=block;
+    freeLists[order]=block;
+    blockState[blockIndex(block)]=headFlag | freeFlag | order;
+}
+
+void ProcessPool::removeFree(FreeBlock *block, unsigned int order)
+{
+    if(block->prev) block->prev->next=block->next;
+    else freeLists[order]=block->next;
+    if(block->next) block->next->prev=block->prev;
+    blockState[blockIndex(block)]=0;
 }
 
 ProcessPool::~ProcessPool()
 {
-    delete[] bitmap;
+    delete[] blockState;
 }
 
+} //namespace miosix
+
 #ifdef TEST_ALLOC
+
+using namespace miosix;
+
+/**
+ * Randomly allocate and deallocate blocks, checking that allocated blocks are
+ * aligned to their size and do not overlap, and that freeing everything
+ * restores the initial state. Prints the time taken.
+ * \param iterations number of random operations
+ */
+static void fuzz(unsigned int iterations)
+{
+    ProcessPool& pool=ProcessPool::instance();
+    vector<pair<char*,unsigned int> > blocks;
+    unsigned int failures=0;
+    clock_t begin=clock();
+    for(unsigned int i=0;i<iterations;i++)
+    {
+        if(blocks.empty() || rand() % 2)
+        {
+            unsigned int size=ProcessPool::blockSize<<(rand() % 7);
+            char *p;
+            try {
+                p=reinterpret_cast<char*>(pool.allocate(size));
+            } catch(bad_alloc&) {
+                failures++;
+                continue;
+            }
+            if(reinterpret_cast<size_t>(p) % size)
+            {
+                cout<<"Misaligned block @ "<<(void*)p<<endl;
+                return;
+            }
+            for(unsigned int j=0;j<blocks.size();j++)
+            {
+                if(p+size<=blocks[j].first ||
+                   blocks[j].first+blocks[j].second<=p) continue;
+                cout<<"Overlapping block @ "<<(void*)p<<endl;
+                return;
+            }
+            blocks.push_back(make_pair(p,size));
+        } else {
+            unsigned int j=rand() % blocks.size();
+            pool.deallocate(reinterpret_cast<unsigned int*>(blocks[j].first));
+            blocks[j]=blocks.back();
+            blocks.pop_back();
+        }
+    }
+    for(unsigned int j=0;j<blocks.size();j++)
+        pool.deallocate(reinterpret_cast<unsigned int*>(blocks[j].first));
+    double time=static_cast<double>(clock()-begin)/CLOCKS_PER_SEC;
+    cout<<iterations<<" operations ("<<failures<<" out of memory) in "
+        <<time<<"s"<<endl;
+    pool.printAllocatedBlocks();
+}
+
 int main()
 {
     ProcessPool& pool=ProcessPool::instance();
     while(1)
     {
-        cout<<"a<size(exponent)>|d<addr>"<<endl;
-        unsigned int param;
+        cout<<"a<size(exponent)>|d<addr>|f<iterations>"<<endl;
+        unsigned long param;
         char op;
         string line;
-        getline(cin,line);
+        if(!getline(cin,line)) return 0;
         stringstream ss(line);
         ss>>op;
         switch(op)
@@ -130,7 +243,7 @@ int main()
             case 'a':
                 ss>>dec>>param;
                 try {
-                    pool.allocate(1<<param);
+                    cout<<pool.allocate(1<<param)<<endl;
                 } catch(exception& e) {
                     cout<<typeid(e).name();
                 }
@@ -145,6 +258,10 @@ int main()
                 }
                 pool.printAllocatedBlocks();
                 break;
+            case 'f':
+                ss>>dec>>param;
+                fuzz(param);
+                break;
             default:
                 cout<<"Incorrect option"<<endl;
                 break;
@@ -153,6 +270,4 @@ int main()
 }
 #endif //TEST_ALLOC
 
-} //namespace miosix
-
 #endif //WITH_PROCESSES
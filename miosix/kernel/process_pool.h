@@ -28,7 +28,7 @@
 #ifndef PROCESS_POOL
 #define PROCESS_POOL
 
-#include <map>
+#include <cstddef>
 
 #ifndef TEST_ALLOC
 #include <miosix.h>
@@ -45,6 +45,11 @@ namespace miosix {
 /**
  * This class allows to handle a memory area reserved for the allocation of
  * processes' images. This memory area is called process pool.
+ * 
+ * It is a buddy allocator. Free blocks are kept in one intrusive list per
+ * order (block size), and the order and state of each block are stored in a
+ * side table with one byte per blockSize, so both allocation and deallocation
+ * take a time proportional to the number of orders, not to the pool size.
  */
 class ProcessPool
 {
@@ -81,28 +86,23 @@ public:
     void printAllocatedBlocks()
     {
         using namespace std;
-        map<unsigned int*, unsigned int>::iterator it;
         cout<<endl;
-        for(it=allocatedBlocks.begin();it!=allocatedBlocks.end();it++)
-            cout <<"block of size " << it->second
-                 << " allocated @ " << it->first<<endl;
-        
-        cout<<"Bitmap:"<<endl;
-        const int SHIFT = 8 * sizeof(unsigned int);
-        const unsigned int MASK = 1 << (SHIFT-1);
-        int bitarray[32];
-        for(int i=0; i<(poolSize/blockSize)/(sizeof(unsigned int)*8);i++)
-        {   
-            int value=bitmap[i];
-            for ( int j = 0; j < SHIFT; j++ ) 
-            {
-                bitarray[31-j]= ( value & MASK ? 1 : 0 );
-                value <<= 1;
-            }
-            for(int j=0;j<32;j++)
-                cout<<bitarray[j];
-            cout << endl;
-        }  
+        for(unsigned int i=0;i<poolSize/blockSize;i++)
+        {
+            if((blockState[i] & headFlag)==0) continue;
+            cout<<((blockState[i] & freeFlag) ? "free " : "allocated ")
+                <<"block of size "<<(blockSize<<(blockState[i] & orderMask))
+                <<" @ "<<poolBase+i*blockSize/sizeof(unsigned int)
+                <<endl;
+        }
+        cout<<"Free lists:"<<endl;
+        for(unsigned int i=0;i<numOrders;i++)
+        {
+            if(freeLists[i]==0) continue;
+            cout<<(blockSize<<i)<<":";
+            for(FreeBlock *it=freeLists[i];it;it=it->next) cout<<" "<<it;
+            cout<<endl;
+        }
     }
     #endif //TEST_ALLOC
     
@@ -129,38 +129,51 @@ private:
     ~ProcessPool();
     
     /**
-     * \param bit bit to test, from 0 to poolSize/blockSize
-     * \return true if the bit is set
+     * Header placed at the start of each free block, to link it in the free
+     * list of its order
      */
-    bool testBit(unsigned int bit)
+    struct FreeBlock
     {
-        return (bitmap[bit/(sizeof(unsigned int)*8)] &
-            1<<(bit % (sizeof(unsigned int)*8))) ? true : false;
-    }
+        FreeBlock *prev;
+        FreeBlock *next;
+    };
     
     /**
-     * \param bit bit to set, from 0 to poolSize/blockSize
+     * \param block a block inside the pool
+     * \return its index in blockState
      */
-    void setBit(unsigned int bit)
+    unsigned int blockIndex(const void *block) const
     {
-        bitmap[(bit/(sizeof(unsigned int)*8))] |= 
-            1<<(bit % (sizeof(unsigned int)*8));
+        return (reinterpret_cast<const char*>(block)-
+                reinterpret_cast<const char*>(poolBase))/blockSize;
     }
     
     /**
-     * \param bit bit to clear, from 0 to poolSize/blockSize
+     * Add a block to the free list of its order, and mark it as free
+     * \param block block to add
+     * \param order order of the block
      */
-    void clearBit(unsigned int bit)
-    {
-        bitmap[bit/(sizeof(unsigned int)*8)] &= 
-            ~(1<<(bit % (sizeof(unsigned int)*8)));
-    }
+    void pushFree(FreeBlock *block, unsigned int order);
+    
+    /**
+     * Remove a block from the free list of its order, and clear its state
+     * \param block block to remove
+     * \param order order of the block
+     */
+    void removeFree(FreeBlock *block, unsigned int order);
+    
+    ///Number of orders, block sizes range from blockSize to 2^31 bytes
+    static const unsigned int numOrders=32-blockBits;
+    ///Flags and mask for the blockState entries
+    static const unsigned char headFlag=0x80;  ///< First blockSize of a block
+    static const unsigned char freeFlag=0x40;  ///< The block is free
+    static const unsigned char orderMask=0x3f; ///< The order of the block
     
-    unsigned int *bitmap;   ///< Pointer to the status of the allocator
+    ///One entry per blockSize, nonzero only for the first one of each block
+    unsigned char *blockState;
+    FreeBlock *freeLists[numOrders]; ///< Free blocks of each order
     unsigned int *poolBase; ///< Base address of the entire pool
     unsigned int poolSize;  ///< Size of the pool, in bytes
-    ///Lists all allocated blocks, allows to retrieve their sizes
-    std::map<unsigned int*,unsigned int> allocatedBlocks;
     #ifndef TEST_ALLOC
     miosix::FastMutex mutex; ///< Mutex to guard concurrent access
     #endif //TEST_ALLOC
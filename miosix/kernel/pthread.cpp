@@ -46,6 +46,21 @@ using namespace miosix;
 // Miosix specific patches.
 //
 
+/**
+ * \internal
+ * Convert the absolute timeout of the pthread timed functions to kernel ticks.
+ * As Miosix has no real time clock, the timeout is expressed as time since
+ * boot, the same timebase as getTick(). Rounds up to the next tick, so that
+ * the wait never ends before the timeout
+ * \param abstime absolute timeout
+ * \return absolute timeout in ticks
+ */
+static long long timespecToTick(const struct timespec *abstime)
+{
+    return static_cast<long long>(abstime->tv_sec)*TICK_FREQ+
+        (static_cast<long long>(abstime->tv_nsec)*TICK_FREQ+999999999)/1000000000;
+}
+
 //These functions needs to be callable from C
 extern "C" {
 
@@ -215,6 +230,51 @@ int pthread_mutex_trylock(pthread_mutex_t *mutex)
     return EBUSY;
 }
 
+int pthread_mutex_timedlock(pthread_mutex_t *mutex,
+        const struct timespec *abstime)
+{
+    if(abstime->tv_nsec<0 || abstime->tv_nsec>=1000000000) return EINVAL;
+    long long absTime=timespecToTick(abstime);
+    FastInterruptDisableLock dLock;
+    void *p=reinterpret_cast<void*>(Thread::IRQgetCurrentThread());
+    if(mutex->owner==0)
+    {
+        mutex->owner=p;
+        return 0;
+    }
+    if(mutex->owner==p)
+    {
+        if(mutex->recursive<0) return EDEADLK;
+        mutex->recursive++;
+        return 0;
+    }
+
+    WaitingList waiting; //Element of a linked list on stack
+    waiting.thread=p;
+    waiting.next=0; //Putting this thread last on the list (lifo policy)
+    if(mutex->first==0)
+    {
+        mutex->first=&waiting;
+        mutex->last=&waiting;
+    } else {
+        mutex->last->next=&waiting;
+        mutex->last=&waiting;
+    }
+
+    //The owner is set by the unlocking thread, so the mutex may have been
+    //given to us even if the timeout expired in the meantime
+    while(mutex->owner!=p)
+    {
+        if(Thread::IRQenableIrqAndTimedWait(dLock,absTime)
+            ==TimedWaitResult::Timeout && mutex->owner!=p)
+        {
+            IRQremoveFromWaitingList(mutex->first,mutex->last,&waiting);
+            return ETIMEDOUT;
+        }
+    }
+    return 0;
+}
+
 int pthread_mutex_unlock(pthread_mutex_t *mutex)
 {
     #ifndef SCHED_TYPE_EDF
@@ -275,6 +335,45 @@ int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
     return 0;
 }
 
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+        const struct timespec *abstime)
+{
+    if(abstime->tv_nsec<0 || abstime->tv_nsec>=1000000000) return EINVAL;
+    long long absTime=timespecToTick(abstime);
+    FastInterruptDisableLock dLock;
+    if(absTime<=getTick()) return ETIMEDOUT;
+    Thread *p=Thread::IRQgetCurrentThread();
+    WaitingList waiting; //Element of a linked list on stack
+    waiting.thread=reinterpret_cast<void*>(p);
+    waiting.next=0; //Putting this thread last on the list (lifo policy)
+    if(cond->first==0)
+    {
+        cond->first=&waiting;
+        cond->last=&waiting;
+    } else {
+        cond->last->next=&waiting;
+        cond->last=&waiting;
+    }
+    //The SleepData variable has to be in scope till it is removed from the
+    //sleeping list
+    SleepData d;
+    d.p=p;
+    d.wakeup_time=absTime;
+    p->flags.IRQsetCondWait(true);
+    IRQaddTimeoutToSleepingList(&d);
+
+    unsigned int depth=IRQdoMutexUnlockAllDepthLevels(mutex);
+    {
+        FastInterruptEnableLock eLock(dLock);
+        Thread::yield(); //Here the wait becomes effective
+    }
+    IRQremoveTimeoutFromSleepingList(&d);
+    //If still in the list no one signaled us, so the timeout expired
+    bool timeout=IRQremoveFromWaitingList(cond->first,cond->last,&waiting);
+    IRQdoMutexLockToDepth(mutex,dLock,depth);
+    return timeout ? ETIMEDOUT : 0;
+}
+
 int pthread_cond_signal(pthread_cond_t *cond)
 {
     #ifdef SCHED_TYPE_EDF
@@ -33,6 +33,34 @@
 
 namespace miosix {
 
+/**
+ * \internal
+ * Remove an entry from a singly linked list of waiting threads, used by timed
+ * waits when the timeout expires. Must be called with interrupts disabled.
+ * \param first first element of the list
+ * \param last last element of the list
+ * \param w entry to remove
+ * \return false if the entry was not in the list, as it was already removed
+ * by the thread that woke it up
+ */
+template<typename T>
+static inline bool IRQremoveFromWaitingList(T *& first, T *& last, T *w)
+{
+    if(first==w)
+    {
+        first=first->next;
+        return true;
+    }
+    for(T *walk=first;walk!=0;walk=walk->next)
+    {
+        if(walk->next!=w) continue;
+        walk->next=w->next;
+        if(last==w) last=walk;
+        return true;
+    }
+    return false;
+}
+
 /**
  * \internal
  * Implementation code to lock a mutex. Must be called with interrupts disabled
@@ -96,6 +96,16 @@ public:
      */
     void get(T& elem);
 
+    /**
+     * Get an element from the queue. If the queue is empty, then sleep until
+     * an element becomes available or the timeout expires.
+     * \param elem an element from the queue. The element is valid only if the
+     * return value is true
+     * \param absTime absolute timeout time in ticks, as returned by getTick()
+     * \return true if an element was got, false if the timeout expired
+     */
+    bool get(T& elem, long long absTime);
+
     /**
      * Put an element to the queue. If the queue is full, then sleep until a
      * place becomes available.
@@ -243,6 +253,24 @@ void Queue<T,len>::get(T& elem)
     if(++getPos==len) getPos=0;
 }
 
+template <typename T, unsigned int len>
+bool Queue<T,len>::get(T& elem, long long absTime)
+{
+    FastInterruptDisableLock dLock;
+    IRQwakeWaitingThread();
+    while(isEmpty())
+    {
+        waiting=Thread::IRQgetCurrentThread();
+        TimedWaitResult result=Thread::IRQenableIrqAndTimedWait(dLock,absTime);
+        IRQwakeWaitingThread();
+        if(result==TimedWaitResult::Timeout && isEmpty()) return false;
+    }
+    numElem--;
+    elem=buffer[getPos];
+    if(++getPos==len) getPos=0;
+    return true;
+}
+
 template <typename T, unsigned int len>
 void Queue<T,len>::put(const T& elem)
 {
@@ -58,6 +58,7 @@ bool ControlScheduler::PKaddThread(Thread *thread,
         //and cause all sorts of misterious crashes
         InterruptDisableLock dLock;
         thread->schedData.next=threadList;
+        if(threadList!=0) threadList->schedData.prev=thread;
         threadList=thread;
         threadListSize++;
         SP_Tr+=bNominal; //One thread more, increase round time
@@ -80,44 +81,20 @@ bool ControlScheduler::PKexists(Thread *thread)
     return false;
 }
 
-void ControlScheduler::PKremoveDeadThreads()
+void ControlScheduler::PKremoveDeadThreads(Thread *zombies)
 {
-    //Special case, threads at the head of the list
-    while(threadList!=0 && threadList->flags.isDeleted())
+    FastInterruptDisableLock dLock;
+    for(Thread *d=zombies;d!=0;d=d->zombieNext)
     {
-        Thread *toBeDeleted=threadList;
-        {
-            FastInterruptDisableLock dLock;
-            threadList=threadList->schedData.next;
-            threadListSize--;
-            SP_Tr-=bNominal; //One thread less, reduce round time
-        }
-        void *base=toBeDeleted->watermark;
-        toBeDeleted->~Thread();
-        free(base); //Delete ALL thread memory
-    }
-    if(threadList!=0)
-    {
-        //General case, delete threads not at the head of the list
-        for(Thread *it=threadList;it->schedData.next!=0;it=it->schedData.next)
-        {
-            if(it->schedData.next->flags.isDeleted()==false) continue;
-            Thread *toBeDeleted=it->schedData.next;
-            {
-                FastInterruptDisableLock dLock;
-                it->schedData.next=it->schedData.next->schedData.next;
-                threadListSize--;
-                SP_Tr-=bNominal; //One thread less, reduce round time
-            }
-            void *base=toBeDeleted->watermark;
-            toBeDeleted->~Thread();
-            free(base); //Delete ALL thread memory
-        }
-    }
-    {
-        FastInterruptDisableLock dLock;
-        IRQrecalculateAlfa();
+        Thread *next=d->schedData.next;
+        Thread *prev=d->schedData.prev;
+        if(prev!=0) prev->schedData.next=next;
+        else threadList=next;
+        if(next!=0) next->schedData.prev=prev;
+        threadListSize--;
+        SP_Tr-=bNominal; //One thread less, reduce round time
     }
+    IRQrecalculateAlfa();
 }
 
 void ControlScheduler::PKsetPriority(Thread *thread,
@@ -72,9 +72,11 @@ public:
     /**
      * \internal
      * Called when there is at least one dead thread to be removed from the
-     * scheduler
+     * scheduler. Only removes the threads from the scheduler, their memory is
+     * reclaimed by the caller afterwards.
+     * \param zombies list of dead threads, linked through Thread::zombieNext
      */
-    static void PKremoveDeadThreads();
+    static void PKremoveDeadThreads(Thread *zombies);
 
     /**
      * \internal
@@ -129,8 +131,9 @@ public:
      * This member function is called by the kernel every time a thread changes
      * its running status. For example when a thread become sleeping, waiting,
      * deleted or if it exits the sleeping or waiting status
+     * \param thread thread whose running status has changed
      */
-    static void IRQwaitStatusHook()
+    static void IRQwaitStatusHook(Thread *thread)
     {
         #ifdef ENABLE_FEEDFORWARD
         IRQrecalculateAlfa();
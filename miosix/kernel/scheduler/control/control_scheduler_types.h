@@ -117,7 +117,7 @@ class ControlSchedulerData
 {
 public:
     ControlSchedulerData(): priority(0), bo(bNominal*multFactor), alfa(0),
-            SP_Tp(0), Tp(bNominal), next(0) {}
+            SP_Tp(0), Tp(bNominal), next(0), prev(0) {}
 
     //Thread priority. Higher priority means longer burst
     ControlSchedulerPriority priority;
@@ -131,6 +131,7 @@ public:
     int SP_Tp;//Processing time set point
     int Tp;//Real processing time
     Thread *next;//Next thread in list
+    Thread *prev;//Previous thread in list
 };
 
 } //namespace miosix
@@ -62,33 +62,9 @@ bool EDFScheduler::PKexists(Thread *thread)
     return false;
 }
 
-void EDFScheduler::PKremoveDeadThreads()
+void EDFScheduler::PKremoveDeadThreads(Thread *zombies)
 {
-    //Delete all threads at the beginning of the list
-    for(;;)
-    {
-        if(head==0) errorHandler(UNEXPECTED); //Empty list is wrong.
-        if(head->flags.isDeleted()==false) break;
-        Thread *toBeDeleted=head;
-        head=head->schedData.next;
-        void *base=toBeDeleted->watermark;
-        toBeDeleted->~Thread();
-        free(base); //Delete ALL thread memory
-    }
-    //When we get here this->head is not null and does not need to be deleted
-    Thread *walk=head;
-    for(;;)
-    {
-        if(walk->schedData.next==0) break;
-        if(walk->schedData.next->flags.isDeleted())
-        {
-            Thread *toBeDeleted=walk->schedData.next;
-            walk->schedData.next=walk->schedData.next->schedData.next;
-            void *base=toBeDeleted->watermark;
-            toBeDeleted->~Thread();
-            free(base); //Delete ALL thread memory
-        } else walk=walk->schedData.next;
-    }
+    for(Thread *d=zombies;d!=0;d=d->zombieNext) remove(d);
 }
 
 void EDFScheduler::PKsetPriority(Thread *thread,
@@ -140,12 +116,16 @@ void EDFScheduler::add(Thread *thread)
     long long newDeadline=thread->schedData.deadline.get();
     if(head==0)
     {
+        thread->schedData.next=0;
+        thread->schedData.prev=0;
         head=thread;
         return;
     }
     if(newDeadline<=head->schedData.deadline.get())
     {
         thread->schedData.next=head;
+        thread->schedData.prev=0;
+        head->schedData.prev=thread;
         head=thread;
         return;
     }
@@ -156,6 +136,9 @@ void EDFScheduler::add(Thread *thread)
            walk->schedData.next->schedData.deadline.get())
         {
             thread->schedData.next=walk->schedData.next;
+            thread->schedData.prev=walk;
+            if(walk->schedData.next!=0)
+                walk->schedData.next->schedData.prev=thread;
             walk->schedData.next=thread;
             break;
         }
@@ -166,22 +149,12 @@ void EDFScheduler::add(Thread *thread)
 void EDFScheduler::remove(Thread *thread)
 {
     if(head==0) errorHandler(UNEXPECTED);
-    if(head==thread)
-    {
-        head=head->schedData.next;
-        return;
-    }
-    Thread *walk=head;
-    for(;;)
-    {
-        if(walk->schedData.next==0) errorHandler(UNEXPECTED);
-        if(walk->schedData.next==thread)
-        {
-            walk->schedData.next=walk->schedData.next->schedData.next;
-            break;
-        }
-        walk=walk->schedData.next;
-    }
+    Thread *next=thread->schedData.next;
+    Thread *prev=thread->schedData.prev;
+    if(prev!=0) prev->schedData.next=next;
+    else if(head==thread) head=next;
+    else errorHandler(UNEXPECTED); //Not in the list
+    if(next!=0) next->schedData.prev=prev;
 }
 
 Thread *EDFScheduler::head=0;
@@ -127,10 +127,11 @@ inline bool operator !=(EDFSchedulerPriority a, EDFSchedulerPriority b)
 class EDFSchedulerData
 {
 public:
-    EDFSchedulerData(): deadline(), next(0) {}
+    EDFSchedulerData(): deadline(), next(0), prev(0) {}
 
     EDFSchedulerPriority deadline; ///<\internal thread deadline
     Thread *next; ///<\internal to make a list of threads, ordered by deadline
+    Thread *prev; ///<\internal previous thread in the list
 };
 
 } //namespace miosix
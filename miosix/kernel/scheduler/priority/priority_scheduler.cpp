@@ -36,6 +36,12 @@ namespace miosix {
 //These are defined in kernel.cpp
 extern volatile Thread *cur;
 extern unsigned char kernel_running;
+#ifdef WITH_TICKLESS_IDLE
+extern void IRQresumePeriodicTick();
+#endif //WITH_TICKLESS_IDLE
+
+//The ready bitmap is an unsigned int
+static_assert(PRIORITY_MAX<=32,"PRIORITY_MAX must not exceed 32");
 
 //
 // class PriorityScheduler
@@ -44,150 +50,53 @@ extern unsigned char kernel_running;
 bool PriorityScheduler::PKaddThread(Thread *thread,
         PrioritySchedulerPriority priority)
 {
+    //Note: can't use FastInterruptDisableLock here since this code is
+    //also called *before* the kernel is started.
+    InterruptDisableLock dLock;
     thread->schedData.priority=priority;
-    if(thread_list[priority.get()]==NULL)
-    {
-        thread_list[priority.get()]=thread;
-        thread->schedData.next=thread;//Circular list
-    } else {
-        thread->schedData.next=thread_list[priority.get()]->schedData.next;
-        thread_list[priority.get()]->schedData.next=thread;
-    }
+    thread->schedData.next=thread_list;
+    if(thread_list!=NULL) thread_list->schedData.prev=thread;
+    thread_list=thread;
+    if(thread->flags.isReady()) IRQaddToReadyList(thread);
     return true;
 }
 
 bool PriorityScheduler::PKexists(Thread *thread)
 {
-    for(int i=PRIORITY_MAX-1;i>=0;i--)
+    for(Thread *it=thread_list;it!=NULL;it=it->schedData.next)
     {
-        if(thread_list[i]==NULL) continue;
-        Thread *temp=thread_list[i];
-        for(;;)
-        {
-            if((temp==thread)&&(! (temp->flags.isDeleted())))
-            {
-                //Found
-                return true;
-            }
-            temp=temp->schedData.next;
-            if(temp==thread_list[i]) break;
-        }
+        //Found, but can't be deleted
+        if(it==thread) return !it->flags.isDeleted();
     }
     return false;
 }
 
-void PriorityScheduler::PKremoveDeadThreads()
+void PriorityScheduler::PKremoveDeadThreads(Thread *zombies)
 {
-    for(int i=PRIORITY_MAX-1;i>=0;i--)
+    //Deleted threads are not ready, so they are not in any ready list and
+    //interrupts need not be disabled
+    for(Thread *d=zombies;d!=NULL;d=d->zombieNext)
     {
-        if(thread_list[i]==NULL) continue;
-        bool first=false;//If false the tail of the list hasn't been calculated
-        Thread *tail=NULL;//Tail of the list
-        //Special case: removing first element in the list
-        while(thread_list[i]->flags.isDeleted())
-        {
-            if(thread_list[i]->schedData.next==thread_list[i])
-            {
-                //Only one element in the list
-                //Call destructor manually because of placement new
-                void *base=thread_list[i]->watermark;
-                thread_list[i]->~Thread();
-                free(base); //Delete ALL thread memory
-                thread_list[i]=NULL;
-                break;
-            }
-            //If it is the first time the tail of the list hasn't
-            //been calculated
-            if(first==false)
-            {
-                first=true;
-                tail=thread_list[i];
-                while(tail->schedData.next!=thread_list[i])
-                    tail=tail->schedData.next;
-            }
-            Thread *d=thread_list[i];//Save a pointer to the thread
-            thread_list[i]=thread_list[i]->schedData.next;//Remove from list
-            //Fix the tail of the circular list
-            tail->schedData.next=thread_list[i];
-            //Call destructor manually because of placement new
-            void *base=d->watermark;
-            d->~Thread();
-            free(base);//Delete ALL thread memory
-        }
-        if(thread_list[i]==NULL) continue;
-        //If it comes here, the first item is not NULL, and doesn't have
-        //to be deleted General case: removing items not at the first
-        //place
-        Thread *temp=thread_list[i];
-        for(;;)
-        {
-            if(temp->schedData.next==thread_list[i]) break;
-            if(temp->schedData.next->flags.isDeleted())
-            {
-                Thread *d=temp->schedData.next;//Save a pointer to the thread
-                //Remove from list
-                temp->schedData.next=temp->schedData.next->schedData.next;
-                //Call destructor manually because of placement new
-                void *base=d->watermark;
-                d->~Thread();
-                free(base);//Delete ALL thread memory
-            } else temp=temp->schedData.next;
-        }
+        Thread *next=d->schedData.next;
+        Thread *prev=d->schedData.prev;
+        if(prev!=NULL) prev->schedData.next=next;
+        else thread_list=next;
+        if(next!=NULL) next->schedData.prev=prev;
     }
 }
 
 void PriorityScheduler::PKsetPriority(Thread *thread,
         PrioritySchedulerPriority newPriority)
 {
-    PrioritySchedulerPriority oldPriority=getPriority(thread);
-    //First set priority to the new value
-    thread->schedData.priority=newPriority;
-    //Then remove the thread from its old list
-    if(thread_list[oldPriority.get()]==thread)
-    {
-        if(thread_list[oldPriority.get()]->schedData.next==
-                thread_list[oldPriority.get()])
-        {
-            //Only one element in the list
-            thread_list[oldPriority.get()]=NULL;
-        } else {
-            Thread *tail=thread_list[oldPriority.get()];//Tail of the list
-            while(tail->schedData.next!=thread_list[oldPriority.get()])
-                tail=tail->schedData.next;
-            //Remove
-            thread_list[oldPriority.get()]=
-                    thread_list[oldPriority.get()]->schedData.next;
-            //Fix tail of the circular list
-            tail->schedData.next=thread_list[oldPriority.get()];
-        }
-    } else {
-        //If it comes here, the first item doesn't have to be removed
-        //General case: removing item not at the first place
-        Thread *temp=thread_list[oldPriority.get()];
-        for(;;)
-        {
-            if(temp->schedData.next==thread_list[oldPriority.get()])
-            {
-                //After walking all elements in the list the thread wasn't found
-                //This should never happen
-                errorHandler(UNEXPECTED);
-            }
-            if(temp->schedData.next==thread)
-            {
-                //Remove from list
-                temp->schedData.next=temp->schedData.next->schedData.next;
-                break;
-            } else temp=temp->schedData.next;
-        }
-    }
-    //Last insert the thread in the new list
-    if(thread_list[newPriority.get()]==NULL)
+    FastInterruptDisableLock dLock;
+    if(thread->schedData.readyNext==NULL)
     {
-        thread_list[newPriority.get()]=thread;
-        thread->schedData.next=thread;//Circular list
+        //Not ready, moved to the new ready list when it becomes ready
+        thread->schedData.priority=newPriority;
     } else {
-        thread->schedData.next=thread_list[newPriority.get()]->schedData.next;
-        thread_list[newPriority.get()]->schedData.next=thread;
+        IRQremoveFromReadyList(thread);
+        thread->schedData.priority=newPriority;
+        IRQaddToReadyList(thread);
     }
 }
 
@@ -197,39 +106,44 @@ void PriorityScheduler::IRQsetIdleThread(Thread *idleThread)
     idle=idleThread;
 }
 
+void PriorityScheduler::IRQwaitStatusHook(Thread *thread)
+{
+    //Priority is -1 for the idle thread and threads not yet added
+    if(thread->schedData.priority.get()<0) return;
+    if(thread->flags.isReady()) IRQaddToReadyList(thread);
+    else IRQremoveFromReadyList(thread);
+}
+
 void PriorityScheduler::IRQfindNextThread()
 {
     if(kernel_running!=0) return;//If kernel is paused, do nothing
-    for(int i=PRIORITY_MAX-1;i>=0;i--)
+    if(ready_bitmap!=0)
     {
-        if(thread_list[i]==NULL) continue;
-        Thread *temp=thread_list[i]->schedData.next;
-        for(;;)
+        //Highest priority with a ready thread, __builtin_clz compiles to a
+        //single instruction on architectures that have one
+        int i=31-__builtin_clz(ready_bitmap);
+        //Rotate to next thread so that next time a different thread, if
+        //available, will be chosen first
+        Thread *temp=ready_list[i]->schedData.readyNext;
+        ready_list[i]=temp;
+        cur=temp;
+        #ifdef WITH_TICKLESS_IDLE
+        IRQresumePeriodicTick();
+        #endif //WITH_TICKLESS_IDLE
+        #ifdef WITH_PROCESSES
+        if(const_cast<Thread*>(cur)->flags.isInUserspace()==false)
         {
-            if(temp->flags.isReady())
-            {
-                //Found a READY thread, so run this one
-                cur=temp;
-                #ifdef WITH_PROCESSES
-                if(const_cast<Thread*>(cur)->flags.isInUserspace()==false)
-                {
-                    ctxsave=cur->ctxsave;
-                    MPUConfiguration::IRQdisable();
-                } else {
-                    ctxsave=cur->userCtxsave;
-                    //A kernel thread is never in userspace, so the cast is safe
-                    static_cast<Process*>(cur->proc)->mpu.IRQenable();
-                }
-                #else //WITH_PROCESSES
-                ctxsave=temp->ctxsave;
-                #endif //WITH_PROCESSES
-                //Rotate to next thread so that next time the list is walked
-                //a different thread, if available, will be chosen first
-                thread_list[i]=temp;
-                return;
-            } else temp=temp->schedData.next;
-            if(temp==thread_list[i]->schedData.next) break;
+            ctxsave=cur->ctxsave;
+            MPUConfiguration::IRQdisable();
+        } else {
+            ctxsave=cur->userCtxsave;
+            //A kernel thread is never in userspace, so the cast is safe
+            static_cast<Process*>(cur->proc)->mpu.IRQenable();
         }
+        #else //WITH_PROCESSES
+        ctxsave=temp->ctxsave;
+        #endif //WITH_PROCESSES
+        return;
     }
     //No thread found, run the idle thread
     cur=idle;
@@ -239,7 +153,50 @@ void PriorityScheduler::IRQfindNextThread()
     #endif //WITH_PROCESSES
 }
 
-Thread *PriorityScheduler::thread_list[PRIORITY_MAX]={0};
+void PriorityScheduler::IRQaddToReadyList(Thread *thread)
+{
+    if(thread->schedData.readyNext!=NULL) return; //Already in the list
+    int i=thread->schedData.priority.get();
+    Thread *head=ready_list[i];
+    if(head==NULL)
+    {
+        ready_list[i]=thread;
+        thread->schedData.readyNext=thread;//Circular list
+        thread->schedData.readyPrev=thread;
+        ready_bitmap |= 1<<i;
+    } else {
+        //Insert after the head, it will be the next of this priority to run
+        thread->schedData.readyNext=head->schedData.readyNext;
+        thread->schedData.readyPrev=head;
+        head->schedData.readyNext->schedData.readyPrev=thread;
+        head->schedData.readyNext=thread;
+    }
+}
+
+void PriorityScheduler::IRQremoveFromReadyList(Thread *thread)
+{
+    if(thread->schedData.readyNext==NULL) return; //Not in the list
+    int i=thread->schedData.priority.get();
+    if(thread->schedData.readyNext==thread)
+    {
+        //Only one element in the list
+        ready_list[i]=NULL;
+        ready_bitmap &= ~(1<<i);
+    } else {
+        Thread *next=thread->schedData.readyNext;
+        Thread *prev=thread->schedData.readyPrev;
+        prev->schedData.readyNext=next;
+        next->schedData.readyPrev=prev;
+        //Keep the round robin order, the next to run is still thread's next
+        if(ready_list[i]==thread) ready_list[i]=prev;
+    }
+    thread->schedData.readyNext=NULL;
+    thread->schedData.readyPrev=NULL;
+}
+
+Thread *PriorityScheduler::thread_list=0;
+Thread *PriorityScheduler::ready_list[PRIORITY_MAX]={0};
+unsigned int PriorityScheduler::ready_bitmap=0;
 Thread *PriorityScheduler::idle=0;
 
 } //namespace miosix
@@ -70,9 +70,11 @@ public:
     /**
      * \internal
      * Called when there is at least one dead thread to be removed from the
-     * scheduler
+     * scheduler. Only removes the threads from the scheduler, their memory is
+     * reclaimed by the caller afterwards.
+     * \param zombies list of dead threads, linked through Thread::zombieNext
      */
-    static void PKremoveDeadThreads();
+    static void PKremoveDeadThreads(Thread *zombies);
 
     /**
      * \internal
@@ -120,9 +122,11 @@ public:
      * \internal
      * This member function is called by the kernel every time a thread changes
      * its running status. For example when a thread become sleeping, waiting,
-     * deleted or if it exits the sleeping or waiting status
+     * deleted or if it exits the sleeping or waiting status.
+     * Moves the thread in or out of the ready list of its priority.
+     * \param thread thread whose running status has changed
      */
-    static void IRQwaitStatusHook() {}
+    static void IRQwaitStatusHook(Thread *thread);
 
     /**
      * \internal
@@ -139,12 +143,50 @@ public:
      */
     static void IRQfindNextThread();
 
+    /**
+     * \internal
+     * Used by the idle thread to know if a thread has been made ready by an
+     * interrupt that did not call IRQfindNextThread(). Must be called with
+     * interrupts disabled.
+     * \return true if there is at least one ready thread, excluding the idle
+     * thread
+     */
+    static bool IRQhasReadyThreads()
+    {
+        return ready_bitmap!=0;
+    }
+
 private:
 
-    ///\internal Vector of lists of threads, there's one list for each priority
-    ///Each list s a circular list.
+    /**
+     * \internal
+     * Add a thread to the ready list of its priority, if it is not already
+     * in it. Must be called with interrupts disabled.
+     * \param thread thread to add
+     */
+    static void IRQaddToReadyList(Thread *thread);
+
+    /**
+     * \internal
+     * Remove a thread from the ready list of its priority, if it is in it.
+     * Must be called with interrupts disabled.
+     * \param thread thread to remove
+     */
+    static void IRQremoveFromReadyList(Thread *thread);
+
+    ///\internal List of all threads, except the idle thread. Only modified
+    ///with the kernel paused, so it can be walked with interrupts enabled
+    static Thread *thread_list;
+
+    ///\internal Vector of lists of ready threads, there's one list for each
+    ///priority. Each list is a circular list, and the list head is the thread
+    ///of that priority that was last selected to run.
+    ///Only modified with interrupts disabled.
     ///(since 0=NULL, using aggregate initialization)
-    static Thread *thread_list[PRIORITY_MAX];
+    static Thread *ready_list[PRIORITY_MAX];
+
+    ///\internal Bit i is set if ready_list[i] is not empty
+    static unsigned int ready_bitmap;
 
     ///\internal idle thread
     static Thread *idle;
@@ -113,12 +113,22 @@ inline bool operator !=(PrioritySchedulerPriority a, PrioritySchedulerPriority b
 class PrioritySchedulerData
 {
 public:
+    ///Priority is -1 till the thread is added to the scheduler
+    PrioritySchedulerData() : priority(-1), next(0), prev(0), readyNext(0),
+            readyPrev(0) {}
+
     ///Thread priority. Used to speed up the implementation of getPriority.<br>
     ///Note that to change the priority of a thread it is not enough to change
     ///this.<br>It is also necessary to move the thread from the old prority
-    ///list to the new priority list.
+    ///ready list to the new priority ready list.
     PrioritySchedulerPriority priority;
-    Thread *next;///<Pointer to next thread of the same priority. CIRCULAR list
+    Thread *next;///<Pointer to next thread in the list of all threads
+    Thread *prev;///<Pointer to previous thread in the list of all threads
+    ///Pointers to next and previous thread in the ready list of the same
+    ///priority, which is a CIRCULAR doubly linked list. Both are null if the
+    ///thread is not ready
+    Thread *readyNext;
+    Thread *readyPrev;
 };
 
 } //namespace miosix
@@ -0,0 +1,216 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+namespace miosix {
+
+/**
+ * \addtogroup Sync
+ * \{
+ */
+
+/**
+ * A lock-free queue used to transfer data between ONE producer and ONE
+ * consumer, that can be two threads or a thread and an interrupt routine.<br>
+ * Unlike Queue, this class never disables interrupts, and besides copying
+ * single elements it allows the producer to reserve a contiguous span of the
+ * buffer and write it in place, for example by DMA, and the consumer to read a
+ * whole contiguous span in place. A span ends at the end of the underlying
+ * buffer, so when the queue wraps around two spans are needed.<br>
+ * Like BufferQueue, this class is only a data structure and not a
+ * synchronization primitive: it never blocks. If the consumer has to wait for
+ * data, combine it with a Semaphore or EventFlags.<br>
+ * This file has no dependencies on the rest of the kernel, so that it can be
+ * tested on a host machine.
+ * \tparam T type of elements of the queue
+ * \tparam len maximum number of elements, MUST be a power of two
+ */
+template<typename T, unsigned int len>
+class SpscQueue
+{
+public:
+    static_assert(len>0 && (len & (len-1))==0,"len must be a power of two");
+
+    /**
+     * Constructor, creates an empty queue
+     */
+    SpscQueue() : putPos(0), getPos(0) {}
+
+    /**
+     * Producer side. Get the contiguous free space in the queue, so that the
+     * producer can write elements in place and then call commit().
+     * \param span on return points to the first free element
+     * \return the number of contiguous free elements starting at span, can be
+     * zero if the queue is full
+     */
+    unsigned int reserve(T *& span)
+    {
+        unsigned int put=putPos; //Only the producer writes putPos
+        unsigned int free=len-(put-load(getPos));
+        unsigned int index=put & (len-1);
+        span=&buffer[index];
+        return free<len-index ? free : len-index;
+    }
+
+    /**
+     * Producer side. Make elements written in the span returned by reserve()
+     * available to the consumer.
+     * \param n number of elements to commit, must not be greater than the
+     * value returned by reserve()
+     */
+    void commit(unsigned int n)
+    {
+        store(putPos,putPos+n);
+    }
+
+    /**
+     * Producer side. Copy one element in the queue, if not full.
+     * \param elem element to add
+     * \return true if the element was added, false if the queue was full
+     */
+    bool put(const T& elem)
+    {
+        T *span;
+        if(reserve(span)==0) return false;
+        *span=elem;
+        commit(1);
+        return true;
+    }
+
+    /**
+     * Consumer side. Get the contiguous elements available in the queue, so
+     * that the consumer can read them in place and then call consume().
+     * \param span on return points to the first available element
+     * \return the number of contiguous elements starting at span, can be
+     * zero if the queue is empty
+     */
+    unsigned int peek(const T *& span) const
+    {
+        unsigned int get=getPos; //Only the consumer writes getPos
+        unsigned int avail=load(putPos)-get;
+        unsigned int index=get & (len-1);
+        span=&buffer[index];
+        return avail<len-index ? avail : len-index;
+    }
+
+    /**
+     * Consumer side. Free elements returned by peek() once the consumer is
+     * done with them.
+     * \param n number of elements to consume, must not be greater than the
+     * value returned by peek()
+     */
+    void consume(unsigned int n)
+    {
+        store(getPos,getPos+n);
+    }
+
+    /**
+     * Consumer side. Copy one element from the queue, if not empty.
+     * \param elem an element from the queue. The element is valid only if the
+     * return value is true
+     * \return true if an element was got, false if the queue was empty
+     */
+    bool get(T& elem)
+    {
+        const T *span;
+        if(peek(span)==0) return false;
+        elem=*span;
+        consume(1);
+        return true;
+    }
+
+    /**
+     * Can be called by both the producer and the consumer, the result may be
+     * stale as soon as it is returned if the other side is active.
+     * \return the number of elements in the queue
+     */
+    unsigned int size() const { return load(putPos)-load(getPos); }
+
+    /**
+     * \return true if the queue is empty
+     */
+    bool isEmpty() const { return size()==0; }
+
+    /**
+     * \return true if the queue is full
+     */
+    bool isFull() const { return size()==len; }
+
+    /**
+     * \return the maximum number of elements the queue can hold
+     */
+    unsigned int capacity() const { return len; }
+
+    /**
+     * Empty the queue. Can only be called while neither the producer nor the
+     * consumer are accessing the queue.
+     */
+    void reset()
+    {
+        store(putPos,0);
+        store(getPos,0);
+    }
+
+private:
+    //Unwanted methods
+    SpscQueue(const SpscQueue&);
+    SpscQueue& operator= (const SpscQueue&);
+
+    /**
+     * Read an index written by the other side. The acquire ordering makes
+     * sure that the elements are read after the index
+     */
+    static unsigned int load(const unsigned int& index)
+    {
+        return __atomic_load_n(&index,__ATOMIC_ACQUIRE);
+    }
+
+    /**
+     * Write an index read by the other side. The release ordering makes sure
+     * that the elements are written before the index
+     */
+    static void store(unsigned int& index, unsigned int value)
+    {
+        __atomic_store_n(&index,value,__ATOMIC_RELEASE);
+    }
+
+    T buffer[len];        ///< Queued elements, used as a ring buffer
+    //The indices run freely and wrap around, as len is a power of two their
+    //difference is the number of elements in the queue also when they wrap
+    unsigned int putPos;  ///< Elements committed, written by the producer
+    unsigned int getPos;  ///< Elements consumed, written by the consumer
+};
+
+/**
+ * \}
+ */
+
+} //namespace miosix
+
+#endif //SPSC_QUEUE_H
@@ -41,13 +41,71 @@ namespace miosix {
 // class Mutex
 //
 
-Mutex::Mutex(Options opt): owner(0), next(0), waiting()
+Mutex::Mutex(Options opt): fastOwner(0), owner(0), next(0), waiting(0)
 {
     recursiveDepth= opt==RECURSIVE ? 0 : -1;
 }
 
+void Mutex::PKdisableFastPath()
+{
+    //With the kernel paused no other thread can run, and a thread preempted
+    //during a compare and swap on fastOwner will see it fail, so a plain read
+    //and write is enough
+    int f=fastOwner;
+    if(f==FAST_PATH_DISABLED) return;
+    fastOwner=FAST_PATH_DISABLED;
+    owner=reinterpret_cast<Thread*>(f);
+    if(owner==0) return;
+    //Mutex locked through the fast path, add it to the owner's list
+    //Save original thread priority, if the thread has not yet locked
+    //another mutex
+    if(owner->mutexLocked==0) owner->savedPriority=owner->getPriority();
+    this->next=owner->mutexLocked;
+    owner->mutexLocked=this;
+}
+
+void Mutex::PKaddToWaitingList(Thread *t)
+{
+    Priority pr=t->getPriority();
+    if(waiting==0 || waiting->getPriority()<pr)
+    {
+        t->mutexWaitingNext=waiting;
+        waiting=t;
+        return;
+    }
+    Thread *walk=waiting;
+    while(walk->mutexWaitingNext!=0 &&
+          walk->mutexWaitingNext->getPriority()>=pr)
+        walk=walk->mutexWaitingNext;
+    t->mutexWaitingNext=walk->mutexWaitingNext;
+    walk->mutexWaitingNext=t;
+}
+
+void Mutex::PKremoveFromWaitingList(Thread *t)
+{
+    if(waiting==t)
+    {
+        waiting=t->mutexWaitingNext;
+    } else {
+        Thread *walk=waiting;
+        for(;;)
+        {
+            //t not in the waiting list? impossible
+            if(walk==0) errorHandler(UNEXPECTED);
+            if(walk->mutexWaitingNext==t)
+            {
+                walk->mutexWaitingNext=t->mutexWaitingNext;
+                break;
+            }
+            walk=walk->mutexWaitingNext;
+        }
+    }
+    t->mutexWaitingNext=0;
+}
+
 void Mutex::PKlock(PauseKernelLock& dLock)
 {
+    PKdisableFastPath();
     Thread *p=Thread::getCurrentThread();
     if(owner==0)
     {
@@ -74,9 +132,7 @@ void Mutex::PKlock(PauseKernelLock& dLock)
     }
 
     //Add thread to mutex' waiting queue
-    waiting.push_back(p);
-    LowerPriority l;
-    push_heap(waiting.begin(),waiting.end(),l);
+    PKaddToWaitingList(p);
 
     //Handle priority inheritance
     if(p->mutexWaiting!=0) errorHandler(UNEXPECTED);
@@ -88,8 +144,9 @@ void Mutex::PKlock(PauseKernelLock& dLock)
         {
             Scheduler::PKsetPriority(walk,p->getPriority());
             if(walk->mutexWaiting==0) break;
-            make_heap(walk->mutexWaiting->waiting.begin(),
-                      walk->mutexWaiting->waiting.end(),l);
+            //Priority changed, move walk to its new place in the list
+            walk->mutexWaiting->PKremoveFromWaitingList(walk);
+            walk->mutexWaiting->PKaddToWaitingList(walk);
             walk=walk->mutexWaiting->owner;
         }
     }
@@ -116,6 +173,7 @@ void Mutex::PKlock(PauseKernelLock& dLock)
 
 void Mutex::PKlockToDepth(PauseKernelLock& dLock, unsigned int depth)
 {
+    PKdisableFastPath();
     Thread *p=Thread::getCurrentThread();
     if(owner==0)
     {
@@ -143,9 +201,7 @@ void Mutex::PKlockToDepth(PauseKernelLock& dLock, unsigned int depth)
     }
 
     //Add thread to mutex' waiting queue
-    waiting.push_back(p);
-    LowerPriority l;
-    push_heap(waiting.begin(),waiting.end(),l);
+    PKaddToWaitingList(p);
 
     //Handle priority inheritance
     if(p->mutexWaiting!=0) errorHandler(UNEXPECTED);
@@ -157,8 +213,9 @@ void Mutex::PKlockToDepth(PauseKernelLock& dLock, unsigned int depth)
         {
             Scheduler::PKsetPriority(walk,p->getPriority());
             if(walk->mutexWaiting==0) break;
-            make_heap(walk->mutexWaiting->waiting.begin(),
-                      walk->mutexWaiting->waiting.end(),l);
+            //Priority changed, move walk to its new place in the list
+            walk->mutexWaiting->PKremoveFromWaitingList(walk);
+            walk->mutexWaiting->PKaddToWaitingList(walk);
             walk=walk->mutexWaiting->owner;
         }
     }
@@ -186,6 +243,7 @@ void Mutex::PKlockToDepth(PauseKernelLock& dLock, unsigned int depth)
 
 bool Mutex::PKtryLock(PauseKernelLock& dLock)
 {
+    PKdisableFastPath();
     Thread *p=Thread::getCurrentThread();
     if(owner==0)
     {
@@ -208,6 +266,7 @@ bool Mutex::PKtryLock(PauseKernelLock& dLock)
 
 bool Mutex::PKunlock(PauseKernelLock& dLock)
 {
+    PKdisableFastPath();
     Thread *p=Thread::getCurrentThread();
     if(owner!=p) return false;
 
@@ -249,21 +308,19 @@ bool Mutex::PKunlock(PauseKernelLock& dLock)
         Mutex *walk=owner->mutexLocked;
         while(walk!=0)
         {
-            if(walk->waiting.empty()==false)
-                pr=max(pr,walk->waiting.front()->getPriority());
+            if(walk->waiting!=0)
+                pr=max(pr,walk->waiting->getPriority());
             walk=walk->next;
         }
         if(pr!=owner->getPriority()) Scheduler::PKsetPriority(owner,pr);
     }
 
     //Choose next thread to lock the mutex
-    if(waiting.empty()==false)
+    if(waiting!=0)
     {
         //There is at least another thread waiting
-        owner=waiting.front();
-        LowerPriority l;
-        pop_heap(waiting.begin(),waiting.end(),l);
-        waiting.pop_back();
+        owner=waiting;
+        PKremoveFromWaitingList(owner);
         if(owner->mutexWaiting!=this) errorHandler(UNEXPECTED);
         owner->mutexWaiting=0;
         owner->PKwakeup();
@@ -272,19 +329,18 @@ bool Mutex::PKunlock(PauseKernelLock& dLock)
         this->next=owner->mutexLocked;
         owner->mutexLocked=this;
         //Handle priority inheritance of new owner
-        if(waiting.empty()==false &&
-           waiting.front()->getPriority()>owner->getPriority())
-                Scheduler::PKsetPriority(owner,waiting.front()->getPriority());
+        if(waiting!=0 && waiting->getPriority()>owner->getPriority())
+                Scheduler::PKsetPriority(owner,waiting->getPriority());
         return owner->getPriority() > p->getPriority();
     } else {
-        owner=0; //No threads waiting
-        std::vector<Thread *>().swap(waiting); //Save some RAM
+        PKenableFastPath(); //No threads waiting
         return false;
     }
 }
 
 unsigned int Mutex::PKunlockAllDepthLevels(PauseKernelLock& dLock)
 {
+    PKdisableFastPath();
     Thread *p=Thread::getCurrentThread();
     if(owner!=p) return 0;
 
@@ -320,21 +376,19 @@ unsigned int Mutex::PKunlockAllDepthLevels(PauseKernelLock& dLock)
         Mutex *walk=owner->mutexLocked;
         while(walk!=0)
         {
-            if(walk->waiting.empty()==false)
-                pr=max(pr,walk->waiting.front()->getPriority());
+            if(walk->waiting!=0)
+                pr=max(pr,walk->waiting->getPriority());
             walk=walk->next;
         }
         if(pr!=owner->getPriority()) Scheduler::PKsetPriority(owner,pr);
     }
 
     //Choose next thread to lock the mutex
-    if(waiting.empty()==false)
+    if(waiting!=0)
     {
         //There is at least another thread waiting
-        owner=waiting.front();
-        LowerPriority l;
-        pop_heap(waiting.begin(),waiting.end(),l);
-        waiting.pop_back();
+        owner=waiting;
+        PKremoveFromWaitingList(owner);
         if(owner->mutexWaiting!=this) errorHandler(UNEXPECTED);
         owner->mutexWaiting=0;
         owner->PKwakeup();
@@ -343,12 +397,10 @@ unsigned int Mutex::PKunlockAllDepthLevels(PauseKernelLock& dLock)
         this->next=owner->mutexLocked;
         owner->mutexLocked=this;
         //Handle priority inheritance of new owner
-        if(waiting.empty()==false &&
-           waiting.front()->getPriority()>owner->getPriority())
-                Scheduler::PKsetPriority(owner,waiting.front()->getPriority());
+        if(waiting!=0 && waiting->getPriority()>owner->getPriority())
+                Scheduler::PKsetPriority(owner,waiting->getPriority());
     } else {
-        owner=0; //No threads waiting
-        std::vector<Thread *>().swap(waiting); //Save some RAM
+        PKenableFastPath(); //No threads waiting
     }
     
     if(recursiveDepth<0) return 0;
@@ -369,15 +421,7 @@ void ConditionVariable::wait(Mutex& m)
     
     WaitingData w;
     w.p=Thread::getCurrentThread();
-    w.next=0; 
-    //Add entry to tail of list
-    if(first==0)
-    {
-        first=last=&w;
-    } else {
-       last->next=&w;
-       last=&w;
-    }
+    addToWaitingList(&w);
     //Unlock mutex and wait
     {
         FastInterruptDisableLock l;
@@ -398,24 +442,83 @@ void ConditionVariable::wait(FastMutex& m)
     
     WaitingData w;
     w.p=Thread::getCurrentThread();
-    w.next=0;
-    //Add entry to tail of list
-    if(first==0)
+    addToWaitingList(&w);
+    //Unlock mutex and wait
+    w.p->flags.IRQsetCondWait(true);
+
+    unsigned int depth=IRQdoMutexUnlockAllDepthLevels(m.get());
     {
-        first=last=&w;
-    } else {
-       last->next=&w;
-       last=&w;
+        FastInterruptEnableLock eLock(dLock);
+        Thread::yield(); //Here the wait becomes effective
+    }
+    IRQdoMutexLockToDepth(m.get(),dLock,depth);
+}
+
+TimedWaitResult ConditionVariable::timedWait(Mutex& m, long long absTime)
+{
+    PauseKernelLock dLock;
+    if(absTime<=getTick()) return TimedWaitResult::Timeout;
+
+    WaitingData w;
+    w.p=Thread::getCurrentThread();
+    addToWaitingList(&w);
+    //The SleepData variable has to be in scope till it is removed from the
+    //sleeping list
+    SleepData d;
+    d.p=w.p;
+    d.wakeup_time=absTime;
+    //Unlock mutex and wait
+    {
+        FastInterruptDisableLock l;
+        w.p->flags.IRQsetCondWait(true);
+        IRQaddTimeoutToSleepingList(&d);
     }
+
+    unsigned int depth=m.PKunlockAllDepthLevels(dLock);
+    {
+        RestartKernelLock eLock(dLock);
+        Thread::yield(); //Here the wait becomes effective
+    }
+    TimedWaitResult result=TimedWaitResult::NoTimeout;
+    {
+        FastInterruptDisableLock l;
+        IRQremoveTimeoutFromSleepingList(&d);
+        //If still in the list no one signaled us, so the timeout expired
+        if(IRQremoveFromWaitingList(first,last,&w))
+            result=TimedWaitResult::Timeout;
+    }
+    m.PKlockToDepth(dLock,depth);
+    return result;
+}
+
+TimedWaitResult ConditionVariable::timedWait(FastMutex& m, long long absTime)
+{
+    FastInterruptDisableLock dLock;
+    if(absTime<=getTick()) return TimedWaitResult::Timeout;
+
+    WaitingData w;
+    w.p=Thread::getCurrentThread();
+    addToWaitingList(&w);
+    //The SleepData variable has to be in scope till it is removed from the
+    //sleeping list
+    SleepData d;
+    d.p=w.p;
+    d.wakeup_time=absTime;
     //Unlock mutex and wait
     w.p->flags.IRQsetCondWait(true);
+    IRQaddTimeoutToSleepingList(&d);
 
     unsigned int depth=IRQdoMutexUnlockAllDepthLevels(m.get());
     {
         FastInterruptEnableLock eLock(dLock);
         Thread::yield(); //Here the wait becomes effective
     }
+    IRQremoveTimeoutFromSleepingList(&d);
+    //If still in the list no one signaled us, so the timeout expired
+    TimedWaitResult result=TimedWaitResult::NoTimeout;
+    if(IRQremoveFromWaitingList(first,last,&w)) result=TimedWaitResult::Timeout;
     IRQdoMutexLockToDepth(m.get(),dLock,depth);
+    return result;
 }
 
 void ConditionVariable::signal()
@@ -463,6 +566,251 @@ void ConditionVariable::broadcast()
     if(hppw) Thread::yield();
 }
 
+void ConditionVariable::addToWaitingList(WaitingData *w)
+{
+    w->next=0;
+    //Add entry to tail of list
+    if(first==0)
+    {
+        first=last=w;
+    } else {
+       last->next=w;
+       last=w;
+    }
+}
+
+//
+// class Semaphore
+//
+
+void Semaphore::IRQsignal(bool& hppw)
+{
+    if(first==0)
+    {
+        count++;
+        return;
+    }
+    //Hand over the count directly to the first waiting thread
+    WaitingData *w=first;
+    first=first->next;
+    w->p->IRQwakeup();
+    if(w->p->IRQgetPriority()>Thread::IRQgetCurrentThread()->IRQgetPriority())
+        hppw=true;
+    w->p=0;
+}
+
+void Semaphore::signal()
+{
+    bool hppw=false;
+    {
+        FastInterruptDisableLock dLock;
+        IRQsignal(hppw);
+    }
+    //If the woken thread has higher priority than our priority, yield
+    if(hppw) Thread::yield();
+}
+
+void Semaphore::wait()
+{
+    FastInterruptDisableLock dLock;
+    if(IRQtryWait()) return;
+    WaitingData w;
+    w.p=Thread::IRQgetCurrentThread();
+    IRQaddToWaitingList(&w);
+    //The while is necessary to protect against spurious wakeups
+    while(w.p)
+    {
+        Thread::IRQwait();
+        {
+            FastInterruptEnableLock eLock(dLock);
+            Thread::yield();
+        }
+    }
+}
+
+TimedWaitResult Semaphore::timedWait(long long absTime)
+{
+    FastInterruptDisableLock dLock;
+    if(IRQtryWait()) return TimedWaitResult::NoTimeout;
+    WaitingData w;
+    w.p=Thread::IRQgetCurrentThread();
+    IRQaddToWaitingList(&w);
+    //The count may have been handed over to us even if the timeout expired
+    //in the meantime
+    while(w.p)
+    {
+        if(Thread::IRQenableIrqAndTimedWait(dLock,absTime)
+            ==TimedWaitResult::Timeout && w.p)
+        {
+            IRQremoveFromWaitingList(first,last,&w);
+            return TimedWaitResult::Timeout;
+        }
+    }
+    return TimedWaitResult::NoTimeout;
+}
+
+void Semaphore::IRQaddToWaitingList(WaitingData *w)
+{
+    w->next=0;
+    if(first==0)
+    {
+        first=last=w;
+    } else {
+       last->next=w;
+       last=w;
+    }
+}
+
+//
+// class EventFlags
+//
+
+void EventFlags::IRQsignal(unsigned int setFlags, bool& hppw)
+{
+    flags|=setFlags;
+    WaitingData *prev=0;
+    WaitingData *walk=first;
+    while(walk!=0)
+    {
+        WaitingData *next=walk->next;
+        if(IRQcheckCondition(walk))
+        {
+            //Remove from list and wake
+            if(prev==0) first=next; else prev->next=next;
+            if(last==walk) last=prev;
+            walk->p->IRQwakeup();
+            if(walk->p->IRQgetPriority()>
+                Thread::IRQgetCurrentThread()->IRQgetPriority()) hppw=true;
+            walk->p=0;
+        } else prev=walk;
+        walk=next;
+    }
+}
+
+void EventFlags::signal(unsigned int setFlags)
+{
+    bool hppw=false;
+    {
+        FastInterruptDisableLock dLock;
+        IRQsignal(setFlags,hppw);
+    }
+    //If a woken thread has higher priority than our priority, yield
+    if(hppw) Thread::yield();
+}
+
+unsigned int EventFlags::wait(unsigned int mask, WaitMode mode,
+        bool clearOnExit)
+{
+    return waitImpl(mask,-1,mode,clearOnExit);
+}
+
+unsigned int EventFlags::timedWait(unsigned int mask, long long absTime,
+        WaitMode mode, bool clearOnExit)
+{
+    return waitImpl(mask,absTime,mode,clearOnExit);
+}
+
+bool EventFlags::IRQcheckCondition(WaitingData *w)
+{
+    unsigned int set=flags & w->mask;
+    if(w->mode==ANY ? set==0 : set!=w->mask) return false;
+    w->result=set;
+    if(w->clearOnExit) flags&=~w->mask;
+    return true;
+}
+
+unsigned int EventFlags::waitImpl(unsigned int mask, long long absTime,
+        WaitMode mode, bool clearOnExit)
+{
+    FastInterruptDisableLock dLock;
+    WaitingData w;
+    w.p=Thread::IRQgetCurrentThread();
+    w.mask=mask;
+    w.mode=mode;
+    w.clearOnExit=clearOnExit;
+    if(IRQcheckCondition(&w)) return w.result;
+    w.next=0;
+    if(first==0)
+    {
+        first=last=&w;
+    } else {
+       last->next=&w;
+       last=&w;
+    }
+    //The while is necessary to protect against spurious wakeups
+    while(w.p)
+    {
+        if(absTime<0)
+        {
+            Thread::IRQwait();
+            {
+                FastInterruptEnableLock eLock(dLock);
+                Thread::yield();
+            }
+        } else if(Thread::IRQenableIrqAndTimedWait(dLock,absTime)
+                    ==TimedWaitResult::Timeout && w.p) {
+            IRQremoveFromWaitingList(first,last,&w);
+            return 0;
+        }
+    }
+    return w.result;
+}
+
+//
+// class RWMutex
+//
+
+void RWMutex::lock()
+{
+    //Holding writerMutex prevents new readers from entering
+    writerMutex.lock();
+    FastInterruptDisableLock dLock;
+    //The while is necessary to protect against spurious wakeups
+    while(readers>0)
+    {
+        writer=Thread::IRQgetCurrentThread();
+        Thread::IRQwait();
+        {
+            FastInterruptEnableLock eLock(dLock);
+            Thread::yield();
+        }
+    }
+    writer=0;
+}
+
+bool RWMutex::tryLock()
+{
+    if(writerMutex.tryLock()==false) return false;
+    if(readers==0) return true;
+    writerMutex.unlock();
+    return false;
+}
+
+void RWMutex::lockShared()
+{
+    //If a writer holds or is waiting for the lock we block here, lending it
+    //our priority
+    Lock<Mutex> l(writerMutex);
+    FastInterruptDisableLock dLock;
+    readers++;
+}
+
+void RWMutex::unlockShared()
+{
+    bool hppw=false;
+    {
+        FastInterruptDisableLock dLock;
+        if(--readers>0 || writer==0) return;
+        //Last reader leaving, wake the writer waiting for it
+        writer->IRQwakeup();
+        if(writer->IRQgetPriority()>Thread::IRQgetCurrentThread()->IRQgetPriority())
+            hppw=true;
+        writer=0;
+    }
+    //If the woken thread has higher priority than our priority, yield
+    if(hppw) Thread::yield();
+}
+
 //
 // class Timer
 //
@@ -31,6 +31,7 @@
 #define SYNC_H
 
 #include "kernel.h"
+#include "interfaces/atomic_ops.h"
 #include <vector>
 
 namespace miosix {
@@ -136,6 +137,8 @@ class ConditionVariable;
  * mutex with new or on the stack must be done with care, to avoid deleting a
  * locked mutex, and to avoid situations where a thread tries to lock a
  * deleted mutex.<br>
+ * Locking a free mutex and unlocking a mutex no other thread is waiting for
+ * is done with an atomic compare and swap, without pausing the kernel.
  */
 class Mutex
 {
@@ -161,6 +164,8 @@ public:
      */
     void lock()
     {
+        //Fast path, lock a free mutex
+        if(atomicCompareAndSwap(&fastOwner,0,currentThreadAsInt())==0) return;
         PauseKernelLock dLock;
         PKlock(dLock);
     }
@@ -173,6 +178,9 @@ public:
      */
     bool tryLock()
     {
+        //Fast path, lock a free mutex
+        if(atomicCompareAndSwap(&fastOwner,0,currentThreadAsInt())==0)
+            return true;
         PauseKernelLock dLock;
         return PKtryLock(dLock);
     }
@@ -182,6 +190,14 @@ public:
      */
     void unlock()
     {
+        //Fast path, no thread is waiting and the mutex was locked through the
+        //fast path (thus it can't be locked recursively more than once)
+        int self=currentThreadAsInt();
+        //The compare and swap is the release operation, but atomic ops only
+        //have a compiler barrier after the store, so prevent the compiler
+        //from moving memory accesses of the critical section past it
+        asm volatile("":::"memory");
+        if(atomicCompareAndSwap(&fastOwner,self,0)==self) return;
         bool hppw;
         {
             PauseKernelLock dLock;
@@ -198,6 +214,50 @@ private:
     Mutex& operator = (const Mutex& s);///< No publc operator =
     //Uses default destructor
 
+    /**
+     * \return the current thread, as stored in fastOwner
+     */
+    static int currentThreadAsInt()
+    {
+        return reinterpret_cast<int>(Thread::getCurrentThread());
+    }
+
+    /**
+     * Called at the beginning of all the functions that lock or unlock the
+     * mutex with the kernel paused. If the mutex has been locked through the
+     * fast path, set owner and add the mutex to the owner's list of locked
+     * mutexes, and then disable the fast path till the mutex becomes free, so
+     * that owner is the only field to be checked.<br>
+     * Can be called only with the kernel paused.
+     */
+    void PKdisableFastPath();
+
+    /**
+     * Called when the mutex becomes free with the kernel paused, enables
+     * the fast path again.<br>
+     * Can be called only with the kernel paused.
+     */
+    void PKenableFastPath()
+    {
+        owner=0;
+        fastOwner=0;
+    }
+
+    /**
+     * Add a thread to the list of threads waiting for this mutex, after the
+     * threads with higher or equal priority.<br>
+     * Can be called only with the kernel paused.
+     * \param t thread to add
+     */
+    void PKaddToWaitingList(Thread *t);
+
+    /**
+     * Remove a thread from the list of threads waiting for this mutex.<br>
+     * Can be called only with the kernel paused.
+     * \param t thread to remove
+     */
+    void PKremoveFromWaitingList(Thread *t);
+
     /**
      * Lock mutex, can be called only with kernel paused one level deep
      * (pauseKernel calls can be nested). If another thread holds the mutex,
@@ -250,16 +310,28 @@ private:
      */
     unsigned int PKunlockAllDepthLevels(PauseKernelLock& dLock);
 
+    /// Value of fastOwner when the fast path is disabled
+    static const int FAST_PATH_DISABLED=1;
+
+    /// Used by the fast path. Zero if the mutex is free, the owner thread
+    /// if the mutex was locked through the fast path, or FAST_PATH_DISABLED if
+    /// owner holds the owner thread.
+    volatile int fastOwner;
+
     /// Thread currently inside critical section, if NULL the critical section
-    /// is free
+    /// is free. Only meaningful when fastOwner is FAST_PATH_DISABLED
     Thread *owner;
 
     /// If this mutex is locked, it is added to a list of mutexes held by the
     /// thread that owns this mutex. This field is necessary to make the list.
+    /// Mutexes locked through the fast path are added to the list only when
+    /// the fast path is disabled
     Mutex *next;
 
-    /// Waiting thread are stored in this min-heap, sorted by priority
-    std::vector<Thread *> waiting;
+    /// Waiting threads are stored in this list, sorted by priority, highest
+    /// first. The list is linked through Thread::mutexWaitingNext, so no
+    /// memory is allocated
+    Thread *waiting;
 
     /// Used to hold nesting depth for recursive mutexes, -1 if not recursive
     int recursiveDepth;
@@ -427,6 +499,40 @@ public:
      */
     void wait(FastMutex& m);
 
+    /**
+     * Unlock the mutex and wait until woken up or the timeout expires.
+     * If more threads call wait() they must do so specifying the same mutex,
+     * otherwise the behaviour is undefined.
+     * \param l A Lock instance that locked a Mutex
+     * \param absTime absolute timeout time in ticks, as returned by getTick()
+     * \return whether the return was due to a signal or the timeout
+     */
+    template<typename T>
+    TimedWaitResult timedWait(Lock<T>& l, long long absTime)
+    {
+        return timedWait(l.get(),absTime);
+    }
+
+    /**
+     * Unlock the Mutex and wait until woken up or the timeout expires.
+     * If more threads call wait() they must do so specifying the same mutex,
+     * otherwise the behaviour is undefined.
+     * \param m a locked Mutex
+     * \param absTime absolute timeout time in ticks, as returned by getTick()
+     * \return whether the return was due to a signal or the timeout
+     */
+    TimedWaitResult timedWait(Mutex& m, long long absTime);
+
+    /**
+     * Unlock the FastMutex and wait until woken up or the timeout expires.
+     * If more threads call wait() they must do so specifying the same mutex,
+     * otherwise the behaviour is undefined.
+     * \param m a locked Mutex
+     * \param absTime absolute timeout time in ticks, as returned by getTick()
+     * \return whether the return was due to a signal or the timeout
+     */
+    TimedWaitResult timedWait(FastMutex& m, long long absTime);
+
     /**
      * Wakeup one waiting thread.
      * Currently implemented policy is fifo.
@@ -454,10 +560,378 @@ private:
         WaitingData *next;///<\internal Next thread in the list
     };
 
+    /**
+     * \internal
+     * Add an entry to the tail of the waiting list
+     * \param w entry to add
+     */
+    void addToWaitingList(WaitingData *w);
+
     WaitingData *first;///<Pointer to first element of waiting fifo
     WaitingData *last;///<Pointer to last element of waiting fifo
 };
 
+/**
+ * A counting semaphore, that can be signaled also from interrupt routines.
+ * It is meant as a replacement for the Thread::IRQwait() and
+ * Thread::IRQwakeup() handshake between a driver's interrupt routine and the
+ * thread waiting for an operation to complete.<br>
+ * Signaling the semaphore takes constant time, as the count is directly handed
+ * over to the first waiting thread, if any. Waiting threads are woken up in
+ * fifo order.
+ */
+class Semaphore
+{
+public:
+    /**
+     * Constructor, initializes the semaphore.
+     * \param initialCount initial value of the semaphore counter
+     */
+    Semaphore(unsigned int initialCount=0)
+            : count(initialCount), first(0), last(0) {}
+
+    /**
+     * Increment the semaphore counter, or wake up the first waiting thread.
+     * Can ONLY be used inside an IRQ, or when interrupts are disabled.
+     * \param hppw is not modified if no thread is woken or if the woken thread
+     * has a lower or equal priority than the currently running thread, else is
+     * set to true
+     */
+    void IRQsignal(bool& hppw);
+
+    /**
+     * Increment the semaphore counter, or wake up the first waiting thread.
+     * Can ONLY be used inside an IRQ, or when interrupts are disabled.
+     */
+    void IRQsignal()
+    {
+        bool hppw;
+        IRQsignal(hppw);
+    }
+
+    /**
+     * Increment the semaphore counter, or wake up the first waiting thread.
+     * Yields if the woken thread has a higher priority than the current one.
+     */
+    void signal();
+
+    /**
+     * If the semaphore counter is greater than zero decrement it, otherwise
+     * wait until another thread or an interrupt routine signals the semaphore.
+     */
+    void wait();
+
+    /**
+     * Same as wait(), but returns if the semaphore is not signaled before
+     * the timeout expires.
+     * \param absTime absolute timeout time in ticks, as returned by getTick()
+     * \return whether the return was due to a signal or the timeout
+     */
+    TimedWaitResult timedWait(long long absTime);
+
+    /**
+     * Decrement the semaphore counter only if it is greater than zero.
+     * \return true if the counter was decremented
+     */
+    bool tryWait()
+    {
+        FastInterruptDisableLock dLock;
+        return IRQtryWait();
+    }
+
+    /**
+     * Same as tryWait(), but is meant to be used only inside an IRQ or when
+     * interrupts are disabled.
+     * \return true if the counter was decremented
+     */
+    bool IRQtryWait()
+    {
+        if(count==0) return false;
+        count--;
+        return true;
+    }
+
+    /**
+     * Set the semaphore counter to zero, discarding the signals that no
+     * thread has waited for yet.
+     */
+    void reset()
+    {
+        FastInterruptDisableLock dLock;
+        count=0;
+    }
+
+    /**
+     * \return the semaphore counter
+     */
+    unsigned int getCount() const { return count; }
+
+private:
+    //Unwanted methods
+    Semaphore(const Semaphore&);
+    Semaphore& operator= (const Semaphore&);
+
+    /**
+     * \internal
+     * \struct WaitingData
+     * This struct is used to make a list of waiting threads.
+     */
+    struct WaitingData
+    {
+        Thread *p;///<\internal Thread that is waiting, NULL once signaled
+        WaitingData *next;///<\internal Next thread in the list
+    };
+
+    /**
+     * \internal
+     * Add an entry to the tail of the waiting list.
+     * Must be called with interrupts disabled.
+     * \param w entry to add
+     */
+    void IRQaddToWaitingList(WaitingData *w);
+
+    volatile unsigned int count;///< Semaphore counter
+    WaitingData *first;///<Pointer to first element of waiting fifo
+    WaitingData *last;///<Pointer to last element of waiting fifo
+};
+
+/**
+ * A set of 32 event flags, that can be set also from interrupt routines.
+ * Threads can wait for any or all of a set of flags to be set. It is meant
+ * for drivers and threads that need to wait for more than one kind of event,
+ * such as a transfer completed and an error.
+ */
+class EventFlags
+{
+public:
+    /**
+     * Possible wait modes
+     */
+    enum WaitMode
+    {
+        ANY, ///< Wait until at least one of the flags in the mask is set
+        ALL  ///< Wait until all the flags in the mask are set
+    };
+
+    /**
+     * Constructor, initializes the event flags.
+     * \param initialFlags initial value of the flags
+     */
+    EventFlags(unsigned int initialFlags=0)
+            : flags(initialFlags), first(0), last(0) {}
+
+    /**
+     * Set some flags, waking up the threads whose wait condition becomes true.
+     * Can ONLY be used inside an IRQ, or when interrupts are disabled.
+     * \param setFlags flags to set
+     * \param hppw is not modified if no thread is woken or if the woken threads
+     * have a lower or equal priority than the currently running thread, else
+     * is set to true
+     */
+    void IRQsignal(unsigned int setFlags, bool& hppw);
+
+    /**
+     * Set some flags, waking up the threads whose wait condition becomes true.
+     * Can ONLY be used inside an IRQ, or when interrupts are disabled.
+     * \param setFlags flags to set
+     */
+    void IRQsignal(unsigned int setFlags)
+    {
+        bool hppw;
+        IRQsignal(setFlags,hppw);
+    }
+
+    /**
+     * Set some flags, waking up the threads whose wait condition becomes true.
+     * Yields if a woken thread has a higher priority than the current one.
+     * \param setFlags flags to set
+     */
+    void signal(unsigned int setFlags);
+
+    /**
+     * Clear some flags
+     * \param clearFlags flags to clear
+     */
+    void clear(unsigned int clearFlags)
+    {
+        FastInterruptDisableLock dLock;
+        flags&=~clearFlags;
+    }
+
+    /**
+     * Same as clear(), but is meant to be used only inside an IRQ or when
+     * interrupts are disabled.
+     * \param clearFlags flags to clear
+     */
+    void IRQclear(unsigned int clearFlags) { flags&=~clearFlags; }
+
+    /**
+     * \return the current value of the flags
+     */
+    unsigned int get() const { return flags; }
+
+    /**
+     * Wait until the flags in mask are set.
+     * \param mask flags to wait for, must not be zero
+     * \param mode whether to wait for any or all of the flags in mask
+     * \param clearOnExit if true, the flags in mask are cleared when the wait
+     * condition becomes true
+     * \return the flags in mask that were set when the wait condition became
+     * true
+     */
+    unsigned int wait(unsigned int mask, WaitMode mode=ANY,
+            bool clearOnExit=true);
+
+    /**
+     * Same as wait(), but returns if the wait condition does not become true
+     * before the timeout expires.
+     * \param mask flags to wait for, must not be zero
+     * \param absTime absolute timeout time in ticks, as returned by getTick()
+     * \param mode whether to wait for any or all of the flags in mask
+     * \param clearOnExit if true, the flags in mask are cleared when the wait
+     * condition becomes true
+     * \return the flags in mask that were set when the wait condition became
+     * true, or zero if the timeout expired
+     */
+    unsigned int timedWait(unsigned int mask, long long absTime,
+            WaitMode mode=ANY, bool clearOnExit=true);
+
+private:
+    //Unwanted methods
+    EventFlags(const EventFlags&);
+    EventFlags& operator= (const EventFlags&);
+
+    /**
+     * \internal
+     * \struct WaitingData
+     * This struct is used to make a list of waiting threads.
+     */
+    struct WaitingData
+    {
+        Thread *p;///<\internal Thread that is waiting, NULL once woken
+        WaitingData *next;///<\internal Next thread in the list
+        unsigned int mask;///<\internal Flags the thread is waiting for
+        WaitMode mode;///<\internal Wait mode
+        bool clearOnExit;///<\internal Clear flags in mask when woken
+        unsigned int result;///<\internal Flags that woke the thread
+    };
+
+    /**
+     * \internal
+     * Check if the wait condition of a thread is true, and if so set its
+     * result and clear the flags if requested.
+     * Must be called with interrupts disabled.
+     * \param w waiting data of the thread
+     * \return true if the wait condition is true
+     */
+    bool IRQcheckCondition(WaitingData *w);
+
+    /**
+     * \internal
+     * Common part of wait() and timedWait()
+     * \param mask flags to wait for
+     * \param absTime absolute timeout time in ticks, or -1 for no timeout
+     * \param mode whether to wait for any or all of the flags in mask
+     * \param clearOnExit whether to clear the flags in mask
+     * \return the flags in mask that were set, or zero on timeout
+     */
+    unsigned int waitImpl(unsigned int mask, long long absTime, WaitMode mode,
+            bool clearOnExit);
+
+    volatile unsigned int flags;///< Event flags
+    WaitingData *first;///<Pointer to first element of waiting fifo
+    WaitingData *last;///<Pointer to last element of waiting fifo
+};
+
+/**
+ * A reader-writer mutex. Any number of readers can hold the lock in shared mode
+ * at the same time, while a writer holds it exclusively.<br>
+ * Writers are preferred: once a writer is waiting, new readers are blocked
+ * until it has released the lock, so readers can't starve writers. Writers
+ * are serialized by a priority inheritance Mutex, that readers also briefly
+ * lock on their way in, so a reader or writer blocked by a writer lends it
+ * its priority. Threads holding the lock in shared mode do not inherit the
+ * priority of a writer waiting for them to leave.<br>
+ * The mutex is not recursive, neither in shared nor in exclusive mode. Can be
+ * used with Lock<RWMutex> for exclusive locking and with SharedLock for shared
+ * locking.
+ */
+class RWMutex
+{
+public:
+    /**
+     * Constructor, initializes the mutex.
+     */
+    RWMutex() : readers(0), writer(0) {}
+
+    /**
+     * Lock the mutex in exclusive mode, waiting for other writers to
+     * release it, and for readers to leave.
+     */
+    void lock();
+
+    /**
+     * Lock the mutex in exclusive mode only if no other thread holds it.
+     * \return true if the lock was acquired
+     */
+    bool tryLock();
+
+    /**
+     * Unlock the mutex from exclusive mode.
+     */
+    void unlock() { writerMutex.unlock(); }
+
+    /**
+     * Lock the mutex in shared mode, waiting for the writer that holds it or
+     * is waiting for it, if any.
+     */
+    void lockShared();
+
+    /**
+     * Unlock the mutex from shared mode.
+     */
+    void unlockShared();
+
+private:
+    RWMutex(const RWMutex&);
+    RWMutex& operator= (const RWMutex&);
+
+    Mutex writerMutex;///< Held by writers, and briefly by readers
+    volatile unsigned int readers;///< Number of threads holding a shared lock
+    Thread *writer;///< Writer waiting for readers to leave, if any
+};
+
+/**
+ * Very simple RAII style class to lock a RWMutex in shared mode in an
+ * exception-safe way.
+ */
+class SharedLock
+{
+public:
+    /**
+     * Constructor: locks the mutex in shared mode
+     * \param m mutex to lock
+     */
+    explicit SharedLock(RWMutex& m) : mutex(m)
+    {
+        mutex.lockShared();
+    }
+
+    /**
+     * Destructor: unlocks the mutex
+     */
+    ~SharedLock()
+    {
+        mutex.unlockShared();
+    }
+
+private:
+    SharedLock(const SharedLock&);
+    SharedLock& operator= (const SharedLock&);
+
+    RWMutex& mutex;///< Reference to locked mutex
+};
+
 /**
  * A timer that can be used to measure time intervals.<br>Its resolution equals
  * the kernel tick.<br>Maximum interval is 2^31-1 ticks.
@@ -0,0 +1,122 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "thread_pool.h"
+
+#ifdef WITH_THREAD_POOL
+
+#include "kernel.h"
+#include <cstdlib>
+
+namespace miosix {
+
+/**
+ * \return true if THREAD_POOL_STACK_SIZES is in strictly ascending order,
+ * starting from class i
+ */
+static constexpr bool ascendingClasses(unsigned int i=1)
+{
+    return i>=THREAD_POOL_CLASSES ||
+        (THREAD_POOL_STACK_SIZES[i]>THREAD_POOL_STACK_SIZES[i-1] &&
+         ascendingClasses(i+1));
+}
+
+static_assert(ascendingClasses(),
+              "THREAD_POOL_STACK_SIZES must be in ascending order");
+
+//
+// class ThreadPool
+//
+
+unsigned int ThreadPool::blockSize(unsigned int i)
+{
+    unsigned int size=Thread::memorySize(THREAD_POOL_STACK_SIZES[i]);
+    //sizeof(Thread) may not be a multiple of the stack alignment
+    size+=CTXSAVE_STACK_ALIGNMENT-1;
+    size/=CTXSAVE_STACK_ALIGNMENT;
+    size*=CTXSAVE_STACK_ALIGNMENT;
+    return size;
+}
+
+bool ThreadPool::init()
+{
+    for(unsigned int i=0;i<THREAD_POOL_CLASSES;i++)
+    {
+        unsigned int size=blockSize(i);
+        pool[i]=static_cast<char*>(malloc(size*THREAD_POOL_BLOCKS[i]));
+        if(pool[i]==NULL) return false;
+        //Link all the blocks in the free list, through their first word
+        freeList[i]=NULL;
+        for(unsigned int j=THREAD_POOL_BLOCKS[i];j>0;j--)
+        {
+            void **block=reinterpret_cast<void**>(pool[i]+(j-1)*size);
+            *block=freeList[i];
+            freeList[i]=block;
+        }
+    }
+    return true;
+}
+
+unsigned int *ThreadPool::allocate(unsigned int& stacksize)
+{
+    for(unsigned int i=0;i<THREAD_POOL_CLASSES;i++)
+    {
+        if(stacksize>THREAD_POOL_STACK_SIZES[i]) continue;
+        //Can't use FastInterruptDisableLock as this is also called before
+        //the kernel is started
+        InterruptDisableLock dLock;
+        void **block=static_cast<void**>(freeList[i]);
+        if(block==NULL) return NULL; //Class exhausted
+        freeList[i]=*block;
+        stacksize=THREAD_POOL_STACK_SIZES[i];
+        return reinterpret_cast<unsigned int*>(block);
+    }
+    return NULL; //Stack larger than the largest class
+}
+
+bool ThreadPool::deallocate(void *base)
+{
+    char *p=static_cast<char*>(base);
+    for(unsigned int i=0;i<THREAD_POOL_CLASSES;i++)
+    {
+        unsigned int size=blockSize(i);
+        if(p<pool[i] || p>=pool[i]+size*THREAD_POOL_BLOCKS[i]) continue;
+        InterruptDisableLock dLock;
+        void **block=static_cast<void**>(base);
+        *block=freeList[i];
+        freeList[i]=block;
+        return true;
+    }
+    return false;
+}
+
+char *ThreadPool::pool[THREAD_POOL_CLASSES]={0};
+void *ThreadPool::freeList[THREAD_POOL_CLASSES]={0};
+
+} //namespace miosix
+
+#endif //WITH_THREAD_POOL
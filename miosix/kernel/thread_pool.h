@@ -0,0 +1,93 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by agent                                           *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "config/miosix_settings.h"
+
+#ifdef WITH_THREAD_POOL
+
+namespace miosix {
+
+/**
+ * \internal
+ * Pools of fixed size memory blocks used to allocate threads, one pool for
+ * each class in THREAD_POOL_STACK_SIZES. Each block can hold the watermark,
+ * the stack and the Thread object. Free blocks are kept in a list, so
+ * allocation and deallocation take constant time.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * \internal
+     * Allocate the memory for the pools. Called once by startKernel(), before
+     * any thread is created.
+     * \return false if there is not enough memory
+     */
+    static bool init();
+
+    /**
+     * \internal
+     * Allocate a block for a thread.
+     * \param stacksize requested stack size. If a block is allocated it is
+     * rounded up to the stack size of the class the block belongs to
+     * \return the block, or NULL if no block is available, in this case the
+     * caller should allocate the thread in the heap
+     */
+    static unsigned int *allocate(unsigned int& stacksize);
+
+    /**
+     * \internal
+     * Deallocate a block.
+     * \param base pointer to the memory of a thread
+     * \return true if the memory belonged to a pool and has been deallocated,
+     * false if it does not belong to the pools, and should be freed
+     */
+    static bool deallocate(void *base);
+
+private:
+    ThreadPool();
+
+    /**
+     * \param i pool class
+     * \return the size of a block of class i, rounded to the stack alignment,
+     * otherwise the stack and Thread object of every other block would be
+     * misaligned
+     */
+    static unsigned int blockSize(unsigned int i);
+
+    static char *pool[THREAD_POOL_CLASSES];     ///< Memory of each class
+    static void *freeList[THREAD_POOL_CLASSES]; ///< Free blocks of each class
+};
+
+} //namespace miosix
+
+#endif //WITH_THREAD_POOL
+
+#endif //THREAD_POOL_H
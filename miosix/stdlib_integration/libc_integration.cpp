@@ -41,6 +41,7 @@
 #include "config/miosix_settings.h"
 //// Filesystem
 #include "filesystem/file_access.h"
+#include "filesystem/uio.h"
 //// Console
 #include "kernel/logging.h"
 //// kernel interface
@@ -48,6 +49,9 @@
 #include "interfaces/bsp.h"
 #include "interfaces/delays.h"
 #include "board_settings.h"
+#ifdef WITH_HIGH_RESOLUTION_TIMER
+#include "drivers/stm32_hrtimer.h"
+#endif //WITH_HIGH_RESOLUTION_TIMER
 
 using namespace std;
 
@@ -382,6 +386,153 @@ int read(int fd, void *buf, size_t cnt)
     return _read_r(miosix::CReentrancyAccessor::getReent(),fd,buf,cnt);
 }
 
+/**
+ * \internal
+ * _readv_r, read from a file into multiple buffers
+ */
+ssize_t _readv_r(struct _reent *ptr, int fd, const struct iovec *iov, int iovcnt)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        ssize_t result=miosix::getFileDescriptorTable().readv(fd,iov,iovcnt);
+        if(result>=0) return result;
+        ptr->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        ptr->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        int result=_read_r(ptr,fd,iov[i].iov_base,iov[i].iov_len);
+        if(result<0) return total>0 ? total : -1;
+        total+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break;
+    }
+    return total;
+    #endif //WITH_FILESYSTEM
+}
+
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+{
+    return _readv_r(miosix::CReentrancyAccessor::getReent(),fd,iov,iovcnt);
+}
+
+/**
+ * \internal
+ * _writev_r, write to a file from multiple buffers
+ */
+ssize_t _writev_r(struct _reent *ptr, int fd, const struct iovec *iov, int iovcnt)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        ssize_t result=miosix::getFileDescriptorTable().writev(fd,iov,iovcnt);
+        if(result>=0) return result;
+        ptr->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        ptr->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        int result=_write_r(ptr,fd,iov[i].iov_base,iov[i].iov_len);
+        if(result<0) return total>0 ? total : -1;
+        total+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break;
+    }
+    return total;
+    #endif //WITH_FILESYSTEM
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    return _writev_r(miosix::CReentrancyAccessor::getReent(),fd,iov,iovcnt);
+}
+
+/**
+ * \internal
+ * _pread_r, read from a file at a given offset
+ */
+ssize_t _pread_r(struct _reent *ptr, int fd, void *buf, size_t cnt, off_t pos)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        ssize_t result=miosix::getFileDescriptorTable().pread(fd,buf,cnt,pos);
+        if(result>=0) return result;
+        ptr->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        ptr->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    ptr->_errno=ESPIPE;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+ssize_t pread(int fd, void *buf, size_t cnt, off_t pos)
+{
+    return _pread_r(miosix::CReentrancyAccessor::getReent(),fd,buf,cnt,pos);
+}
+
+/**
+ * \internal
+ * _pwrite_r, write to a file at a given offset
+ */
+ssize_t _pwrite_r(struct _reent *ptr, int fd, const void *buf, size_t cnt,
+        off_t pos)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        ssize_t result=miosix::getFileDescriptorTable().pwrite(fd,buf,cnt,pos);
+        if(result>=0) return result;
+        ptr->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        ptr->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    ptr->_errno=ESPIPE;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t cnt, off_t pos)
+{
+    return _pwrite_r(miosix::CReentrancyAccessor::getReent(),fd,buf,cnt,pos);
+}
+
 /**
  * \internal
  * _lseek_r, move file pointer
@@ -910,12 +1061,19 @@ int gettimeofday(struct timeval *tv, void *tz)
  */
 int nanosleep(const struct timespec *req, struct timespec *rem)
 {
+    #ifdef WITH_HIGH_RESOLUTION_TIMER
+    //Sleep the whole interval on the high resolution timer, no busy wait
+    long long ns=static_cast<long long>(req->tv_sec)*1000000000LL+req->tv_nsec;
+    miosix::HighResolutionTimer::instance().sleep(ns);
+    return 0;
+    #else //WITH_HIGH_RESOLUTION_TIMER
     if(req->tv_sec) miosix::Thread::sleep(req->tv_sec*1000);
     unsigned int microseconds=req->tv_nsec/1000; //No sub-microsecond support yet
     if(microseconds>=1000) miosix::Thread::sleep(microseconds/1000);
     microseconds %= 1000;
     if(microseconds) miosix::delayUs(microseconds);
     return 0;
+    #endif //WITH_HIGH_RESOLUTION_TIMER
 }
 
 